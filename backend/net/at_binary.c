@@ -0,0 +1,552 @@
+#include "at_binary.h"
+#include "at_lz4.h"
+#include "at_net.h"
+#include "at_stream.h"
+#include "../../core/src/at_internal.h"
+#include "../../core/src/at_frame_index.h"
+#include "acoustic/at.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ATRB_V1_HEADER_SIZE 16
+#define ATRB_V1_FRAME_ENTRY_SIZE 8
+#define ATRB_V2_HEADER_SIZE 24
+#define ATRB_V2_FRAME_ENTRY_SIZE 16
+#define ATRB_TEMPORAL_HEADER_SIZE 4
+#define ATRB_QUANTIZED_MAX 65535.0f
+
+struct AT_BinaryEncoder
+{
+    AT_Simulation *simulation;
+    const AT_FrameIndex *index;
+    AT_BinaryOptions options;
+    uint16_t flags;
+    float log_min, log_max; // log2 energy range for quantization
+
+    uint32_t *counts;    // per frame entries as written to the frame table
+    uint32_t *raw_sizes; // per frame block size before compression
+    uint32_t *sizes;     // per frame block size as stored
+    uint8_t **blocks;    // LZ4 only: stored frame blocks, written as is
+    uint32_t max_raw_size;
+    size_t size;
+
+    // temporal only: scratch lists for the frame being encoded
+    uint32_t *delta_updates;
+    uint32_t *delta_slots;
+    uint32_t *delta_removed;
+};
+
+// what a frame block stores: keyframes (and every non temporal frame) update all
+// their voxels, delta frames only the voxels that differ from their keyframe
+typedef struct
+{
+    const uint32_t *updates;
+    const uint32_t *update_slots; // position of each update within the frame, NULL when all are updated
+    uint32_t num_updates;
+    const uint32_t *removed;
+    uint32_t num_removed;
+} AT_FrameDelta;
+
+static inline uint32_t varint_size(uint32_t v)
+{
+    uint32_t n = 1;
+    while (v >= 0x80)
+    {
+        v >>= 7;
+        n++;
+    }
+    return n;
+}
+
+static inline uint8_t *varint_put(uint8_t *dst, uint32_t v)
+{
+    while (v >= 0x80)
+    {
+        *dst++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *dst++ = (uint8_t)v;
+    return dst;
+}
+
+static inline uint16_t quantize_energy(const AT_BinaryEncoder *enc, float energy)
+{
+    if (enc->log_max <= enc->log_min)
+        return 0;
+    float q = (log2f(energy) - enc->log_min) * (ATRB_QUANTIZED_MAX / (enc->log_max - enc->log_min));
+    return (uint16_t)fminf(fmaxf(q + 0.5f, 0.0f), ATRB_QUANTIZED_MAX);
+}
+
+static inline bool is_temporal(const AT_BinaryEncoder *enc)
+{
+    return enc->options.keyframe_interval > 0;
+}
+
+static inline bool temporal_changed(const AT_BinaryEncoder *enc, float energy, float key_energy)
+{
+    return fabsf(energy - key_energy) > enc->options.delta_threshold * key_energy;
+}
+
+// merge walk over the (sorted) voxels of a frame and of its keyframe
+static AT_FrameDelta frame_delta(AT_BinaryEncoder *enc, uint32_t frame)
+{
+    const uint32_t count = AT_frame_index_count(enc->index, frame);
+    const uint32_t *voxels = AT_frame_index_voxels(enc->index, frame);
+    if (!is_temporal(enc) || frame % enc->options.keyframe_interval == 0)
+        return (AT_FrameDelta){.updates = voxels, .num_updates = count};
+
+    const uint32_t key = frame - frame % enc->options.keyframe_interval;
+    const uint32_t key_count = AT_frame_index_count(enc->index, key);
+    const uint32_t *key_voxels = AT_frame_index_voxels(enc->index, key);
+
+    AT_FrameDelta delta = {.updates = enc->delta_updates, .update_slots = enc->delta_slots, .removed = enc->delta_removed};
+    uint32_t i = 0, k = 0;
+    while (i < count || k < key_count)
+    {
+        if (k == key_count || (i < count && voxels[i] < key_voxels[k]))
+        {
+            enc->delta_slots[delta.num_updates] = i;
+            enc->delta_updates[delta.num_updates++] = voxels[i++];
+        }
+        else if (i == count || key_voxels[k] < voxels[i])
+        {
+            enc->delta_removed[delta.num_removed++] = key_voxels[k++];
+        }
+        else
+        {
+            float energy = AT_frame_index_energy(enc->index, enc->simulation, frame, i);
+            float key_energy = AT_frame_index_energy(enc->index, enc->simulation, key, k);
+            if (temporal_changed(enc, energy, key_energy))
+            {
+                enc->delta_slots[delta.num_updates] = i;
+                enc->delta_updates[delta.num_updates++] = voxels[i];
+            }
+            i++;
+            k++;
+        }
+    }
+    return delta;
+}
+
+static uint32_t varint_deltas_size(const uint32_t *voxels, uint32_t count)
+{
+    uint32_t size = 0, prev = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        size += varint_size(voxels[i] - prev);
+        prev = voxels[i];
+    }
+    return size;
+}
+
+static uint8_t *varint_deltas_put(uint8_t *dst, const uint32_t *voxels, uint32_t count)
+{
+    uint32_t prev = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+        dst = varint_put(dst, voxels[i] - prev);
+        prev = voxels[i];
+    }
+    return dst;
+}
+
+static uint32_t frame_raw_size(const AT_BinaryEncoder *enc, const AT_FrameDelta *delta)
+{
+    if (enc->options.version == AT_ATRB_VERSION_1)
+        return delta->num_updates * 8;
+
+    uint32_t size = delta->num_updates * (enc->options.quantize_energies ? 2 : 4) +
+                    varint_deltas_size(delta->updates, delta->num_updates);
+    if (is_temporal(enc))
+        size += varint_size(delta->num_removed) + varint_deltas_size(delta->removed, delta->num_removed);
+    return size;
+}
+
+// writes the uncompressed frame block into dst, dst holds frame_raw_size bytes
+static void encode_frame(const AT_BinaryEncoder *enc, uint32_t frame, const AT_FrameDelta *delta, uint8_t *dst)
+{
+    if (enc->options.version == AT_ATRB_VERSION_1)
+    {
+        memcpy(dst, delta->updates, (size_t)delta->num_updates * 4);
+        dst += (size_t)delta->num_updates * 4;
+    }
+    else
+    {
+        if (is_temporal(enc))
+        {
+            dst = varint_put(dst, delta->num_removed);
+            dst = varint_deltas_put(dst, delta->removed, delta->num_removed);
+        }
+        dst = varint_deltas_put(dst, delta->updates, delta->num_updates);
+    }
+
+    for (uint32_t i = 0; i < delta->num_updates; i++)
+    {
+        const uint32_t slot = delta->update_slots ? delta->update_slots[i] : i;
+        float energy = AT_frame_index_energy(enc->index, enc->simulation, frame, slot);
+        if (enc->options.quantize_energies)
+        {
+            uint16_t q = quantize_energy(enc, energy);
+            memcpy(dst, &q, 2);
+            dst += 2;
+        }
+        else
+        {
+            memcpy(dst, &energy, 4);
+            dst += 4;
+        }
+    }
+}
+
+static void find_energy_range(AT_BinaryEncoder *enc)
+{
+    float lo = INFINITY, hi = -INFINITY;
+    for (uint32_t f = 0; f < enc->index->num_frames; f++)
+    {
+        const uint32_t count = AT_frame_index_count(enc->index, f);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            float e = AT_frame_index_energy(enc->index, enc->simulation, f, i);
+            lo = fminf(lo, e);
+            hi = fmaxf(hi, e);
+        }
+    }
+    enc->log_min = lo <= hi ? log2f(lo) : 0.0f;
+    enc->log_max = lo <= hi ? log2f(hi) : 0.0f;
+}
+
+static AT_Result compress_frames(AT_BinaryEncoder *enc)
+{
+    const uint32_t num_frames = enc->index->num_frames;
+    uint8_t *raw = malloc(enc->max_raw_size > 0 ? enc->max_raw_size : 1);
+    uint8_t *packed = malloc(AT_lz4_compress_bound(enc->max_raw_size));
+    if (!raw || !packed)
+    {
+        free(raw);
+        free(packed);
+        return AT_ERR_ALLOC_ERROR;
+    }
+
+    AT_Result res = AT_OK;
+    for (uint32_t f = 0; f < num_frames; f++)
+    {
+        AT_FrameDelta delta = frame_delta(enc, f);
+        encode_frame(enc, f, &delta, raw);
+        size_t packed_size = AT_lz4_compress(raw, enc->raw_sizes[f], packed);
+
+        //incompressible blocks are stored raw, flagged by size == raw size
+        const uint8_t *block = raw;
+        enc->sizes[f] = enc->raw_sizes[f];
+        if (packed_size < enc->raw_sizes[f])
+        {
+            block = packed;
+            enc->sizes[f] = (uint32_t)packed_size;
+        }
+
+        enc->blocks[f] = malloc(enc->sizes[f] > 0 ? enc->sizes[f] : 1);
+        if (!enc->blocks[f])
+        {
+            res = AT_ERR_ALLOC_ERROR;
+            break;
+        }
+        memcpy(enc->blocks[f], block, enc->sizes[f]);
+    }
+
+    free(raw);
+    free(packed);
+    return res;
+}
+
+AT_Result AT_binary_encoder_create(AT_BinaryEncoder **out_encoder, AT_Simulation *simulation,
+                                   const AT_FrameIndex *index, const AT_BinaryOptions *options)
+{
+    if (!out_encoder || *out_encoder || !simulation || !index)
+        return AT_ERR_INVALID_ARGUMENT;
+
+    AT_BinaryOptions opts = options ? *options : (AT_BinaryOptions){.version = AT_ATRB_VERSION_1};
+    if (opts.version != AT_ATRB_VERSION_1 && opts.version != AT_ATRB_VERSION_2)
+        return AT_ERR_INVALID_ARGUMENT;
+    if (opts.version == AT_ATRB_VERSION_1 &&
+        (opts.quantize_energies || opts.compress_frames || opts.keyframe_interval > 0))
+        return AT_ERR_INVALID_ARGUMENT;
+    if (!(opts.delta_threshold >= 0.0f))
+        return AT_ERR_INVALID_ARGUMENT;
+
+    const uint32_t num_frames = index->num_frames;
+    AT_BinaryEncoder *enc = calloc(1, sizeof(AT_BinaryEncoder));
+    if (!enc)
+        return AT_ERR_ALLOC_ERROR;
+
+    enc->simulation = simulation;
+    enc->index = index;
+    enc->options = opts;
+    enc->flags = (opts.quantize_energies ? AT_ATRB_FLAG_QUANTIZED : 0) |
+                 (opts.compress_frames ? AT_ATRB_FLAG_LZ4 : 0) |
+                 (opts.keyframe_interval > 0 ? AT_ATRB_FLAG_TEMPORAL : 0);
+    enc->counts = malloc(sizeof(uint32_t) * (num_frames > 0 ? num_frames : 1));
+    enc->raw_sizes = malloc(sizeof(uint32_t) * (num_frames > 0 ? num_frames : 1));
+    enc->sizes = malloc(sizeof(uint32_t) * (num_frames > 0 ? num_frames : 1));
+    if (!enc->counts || !enc->raw_sizes || !enc->sizes)
+    {
+        AT_binary_encoder_destroy(enc);
+        return AT_ERR_ALLOC_ERROR;
+    }
+
+    if (is_temporal(enc))
+    {
+        //a delta frame updates at most its own voxels and removes at most its keyframe's
+        uint32_t max_count = 0;
+        for (uint32_t f = 0; f < num_frames; f++)
+        {
+            if (AT_frame_index_count(index, f) > max_count)
+                max_count = AT_frame_index_count(index, f);
+        }
+        enc->delta_updates = malloc(sizeof(uint32_t) * (max_count > 0 ? max_count : 1));
+        enc->delta_slots = malloc(sizeof(uint32_t) * (max_count > 0 ? max_count : 1));
+        enc->delta_removed = malloc(sizeof(uint32_t) * (max_count > 0 ? max_count : 1));
+    }
+    if (is_temporal(enc) && (!enc->delta_updates || !enc->delta_slots || !enc->delta_removed))
+    {
+        AT_binary_encoder_destroy(enc);
+        return AT_ERR_ALLOC_ERROR;
+    }
+
+    if (opts.quantize_energies)
+        find_energy_range(enc);
+
+    for (uint32_t f = 0; f < num_frames; f++)
+    {
+        AT_FrameDelta delta = frame_delta(enc, f);
+        enc->counts[f] = delta.num_updates;
+        enc->raw_sizes[f] = frame_raw_size(enc, &delta);
+        enc->sizes[f] = enc->raw_sizes[f];
+        if (enc->raw_sizes[f] > enc->max_raw_size)
+            enc->max_raw_size = enc->raw_sizes[f];
+    }
+
+    if (opts.compress_frames)
+    {
+        enc->blocks = calloc(num_frames > 0 ? num_frames : 1, sizeof(uint8_t *));
+        AT_Result res = enc->blocks ? compress_frames(enc) : AT_ERR_ALLOC_ERROR;
+        if (res != AT_OK)
+        {
+            AT_binary_encoder_destroy(enc);
+            return res;
+        }
+    }
+
+    enc->size = opts.version == AT_ATRB_VERSION_1
+                    ? ATRB_V1_HEADER_SIZE + (size_t)num_frames * ATRB_V1_FRAME_ENTRY_SIZE
+                    : ATRB_V2_HEADER_SIZE + (size_t)num_frames * ATRB_V2_FRAME_ENTRY_SIZE;
+    if (is_temporal(enc))
+        enc->size += ATRB_TEMPORAL_HEADER_SIZE;
+    for (uint32_t f = 0; f < num_frames; f++)
+        enc->size += enc->sizes[f];
+
+    *out_encoder = enc;
+    return AT_OK;
+}
+
+size_t AT_binary_encoder_size(const AT_BinaryEncoder *encoder)
+{
+    return encoder->size;
+}
+
+AT_Result AT_binary_encoder_write(AT_BinaryEncoder *encoder, AT_WriteFunc write, void *user_data)
+{
+    if (!encoder || !write)
+        return AT_ERR_INVALID_ARGUMENT;
+
+    AT_BinaryEncoder *enc = encoder;
+    const uint32_t num_frames = enc->index->num_frames;
+    const bool v2 = enc->options.version == AT_ATRB_VERSION_2;
+
+    AT_StreamWriter *w = AT_stream_create(write, user_data);
+    // compressed blocks are already in memory, the others are encoded one frame at a time
+    uint8_t *scratch = enc->blocks ? NULL : malloc(enc->max_raw_size > 0 ? enc->max_raw_size : 1);
+    if (!w || (!enc->blocks && !scratch))
+    {
+        free(w);
+        free(scratch);
+        return AT_ERR_ALLOC_ERROR;
+    }
+
+    /* Header */
+    AT_Result res = AT_stream_put(w, "ATRB", 4);
+    if (res == AT_OK) res = AT_stream_put_u32(w, num_frames);
+    if (res == AT_OK) res = AT_stream_put_u32(w, enc->index->num_voxels);
+    if (res == AT_OK) res = AT_stream_put_u32(w, v2 ? (uint32_t)enc->options.version | ((uint32_t)enc->flags << 16) : 0);
+    if (res == AT_OK && v2) res = AT_stream_put(w, &enc->log_min, 4);
+    if (res == AT_OK && v2) res = AT_stream_put(w, &enc->log_max, 4);
+    if (res == AT_OK && is_temporal(enc)) res = AT_stream_put_u32(w, enc->options.keyframe_interval);
+
+    /* Frame table */
+    size_t data_pos = v2 ? ATRB_V2_HEADER_SIZE + (size_t)num_frames * ATRB_V2_FRAME_ENTRY_SIZE
+                         : ATRB_V1_HEADER_SIZE + (size_t)num_frames * ATRB_V1_FRAME_ENTRY_SIZE;
+    if (is_temporal(enc))
+        data_pos += ATRB_TEMPORAL_HEADER_SIZE;
+    for (uint32_t f = 0; f < num_frames && res == AT_OK; f++)
+    {
+        res = AT_stream_put_u32(w, (uint32_t)data_pos);
+        if (res == AT_OK) res = AT_stream_put_u32(w, enc->counts[f]);
+        if (res == AT_OK && v2) res = AT_stream_put_u32(w, enc->sizes[f]);
+        if (res == AT_OK && v2) res = AT_stream_put_u32(w, enc->raw_sizes[f]);
+        data_pos += enc->sizes[f];
+    }
+
+    /* Frame data */
+    for (uint32_t f = 0; f < num_frames && res == AT_OK; f++)
+    {
+        if (enc->blocks)
+        {
+            res = AT_stream_put(w, enc->blocks[f], enc->sizes[f]);
+        }
+        else
+        {
+            AT_FrameDelta delta = frame_delta(enc, f);
+            encode_frame(enc, f, &delta, scratch);
+            res = AT_stream_put(w, scratch, enc->sizes[f]);
+        }
+    }
+
+    if (res == AT_OK)
+        res = AT_stream_flush(w);
+    free(scratch);
+    free(w);
+    return res;
+}
+
+void AT_binary_encoder_destroy(AT_BinaryEncoder *encoder)
+{
+    if (!encoder)
+        return;
+    if (encoder->blocks)
+    {
+        for (uint32_t f = 0; f < encoder->index->num_frames; f++)
+            free(encoder->blocks[f]);
+        free(encoder->blocks);
+    }
+    free(encoder->counts);
+    free(encoder->raw_sizes);
+    free(encoder->sizes);
+    free(encoder->delta_updates);
+    free(encoder->delta_slots);
+    free(encoder->delta_removed);
+    free(encoder);
+}
+
+struct AT_PyramidEncoder
+{
+    uint32_t num_levels;
+    const AT_FrameIndex *levels[AT_FRAME_PYRAMID_MAX_LEVELS + 1]; // coarsest first
+    AT_BinaryEncoder *encoders[AT_FRAME_PYRAMID_MAX_LEVELS + 1];
+    size_t size;
+};
+
+AT_Result AT_pyramid_encoder_create(AT_PyramidEncoder **out_encoder, AT_Simulation *simulation,
+                                    const AT_FrameIndex *index, const AT_FramePyramid *pyramid,
+                                    const AT_BinaryOptions *options)
+{
+    if (!out_encoder || *out_encoder || !simulation || !index || !pyramid)
+        return AT_ERR_INVALID_ARGUMENT;
+
+    AT_PyramidEncoder *enc = calloc(1, sizeof(AT_PyramidEncoder));
+    if (!enc)
+        return AT_ERR_ALLOC_ERROR;
+
+    for (uint32_t i = pyramid->num_levels; i > 0; i--)
+        enc->levels[enc->num_levels++] = pyramid->levels[i - 1];
+    enc->levels[enc->num_levels++] = index;
+
+    enc->size = AT_ATRP_HEADER_SIZE;
+    for (uint32_t i = 0; i < enc->num_levels; i++)
+    {
+        AT_Result res = AT_binary_encoder_create(&enc->encoders[i], simulation, enc->levels[i], options);
+        if (res != AT_OK)
+        {
+            AT_pyramid_encoder_destroy(enc);
+            return res;
+        }
+        enc->size += AT_ATRP_LEVEL_HEADER_SIZE + AT_binary_encoder_size(enc->encoders[i]);
+    }
+
+    *out_encoder = enc;
+    return AT_OK;
+}
+
+size_t AT_pyramid_encoder_size(const AT_PyramidEncoder *encoder)
+{
+    return encoder->size;
+}
+
+AT_Result AT_pyramid_encoder_write(AT_PyramidEncoder *encoder, AT_WriteFunc write, void *user_data)
+{
+    if (!encoder || !write)
+        return AT_ERR_INVALID_ARGUMENT;
+
+    uint32_t header[2] = {0, encoder->num_levels};
+    memcpy(header, "ATRP", 4);
+    AT_Result res = write(user_data, header, sizeof(header));
+
+    // every level goes out whole before the next one starts, so a reader can show it right away
+    for (uint32_t i = 0; i < encoder->num_levels && res == AT_OK; i++)
+    {
+        const AT_FrameIndex *level = encoder->levels[i];
+        uint32_t level_header[4] = {level->grid[0], level->grid[1], level->grid[2],
+                                    (uint32_t)AT_binary_encoder_size(encoder->encoders[i])};
+        res = write(user_data, level_header, sizeof(level_header));
+        if (res == AT_OK)
+            res = AT_binary_encoder_write(encoder->encoders[i], write, user_data);
+    }
+    return res;
+}
+
+void AT_pyramid_encoder_destroy(AT_PyramidEncoder *encoder)
+{
+    if (!encoder)
+        return;
+    for (uint32_t i = 0; i < encoder->num_levels; i++)
+        AT_binary_encoder_destroy(encoder->encoders[i]);
+    free(encoder);
+}
+
+AT_Result AT_frame_stream_write_header(AT_WriteFunc write, void *user_data, const uint32_t grid[3])
+{
+    if (!write || !grid)
+        return AT_ERR_INVALID_ARGUMENT;
+
+    uint32_t header[4] = {0, grid[0], grid[1], grid[2]};
+    memcpy(header, "ATRS", 4);
+    return write(user_data, header, sizeof(header));
+}
+
+AT_Result AT_frame_stream_write_window(AT_WriteFunc write, void *user_data, AT_Simulation *simulation,
+                                       const AT_FrameIndex *window, const AT_BinaryOptions *options)
+{
+    if (!write || !window)
+        return AT_ERR_INVALID_ARGUMENT;
+
+    AT_BinaryEncoder *encoder = NULL;
+    AT_Result res = AT_binary_encoder_create(&encoder, simulation, window, options);
+    if (res != AT_OK)
+        return res;
+
+    uint32_t window_header[2] = {window->frame_start, (uint32_t)AT_binary_encoder_size(encoder)};
+    res = write(user_data, window_header, sizeof(window_header));
+    if (res == AT_OK)
+        res = AT_binary_encoder_write(encoder, write, user_data);
+    AT_binary_encoder_destroy(encoder);
+    return res;
+}
+
+AT_Result AT_frame_stream_write_end(AT_WriteFunc write, void *user_data, uint32_t num_frames)
+{
+    if (!write)
+        return AT_ERR_INVALID_ARGUMENT;
+
+    uint32_t end[2] = {num_frames, 0};
+    return write(user_data, end, sizeof(end));
+}
@@ -0,0 +1,148 @@
+#ifndef AT_BINARY_H
+#define AT_BINARY_H
+
+#include "../../core/include/acoustic/at.h"
+#include "at_net.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * ATRB simulation result format, all multi-byte values little-endian.
+ *
+ * Version 1:
+ *   Header      16 bytes: magic "ATRB" (4) + numFrames (4) + numVoxels (4) + reserved (4, zero)
+ *   Frame table  numFrames * 8 bytes: offset (4) + count (4) per frame
+ *   Frame data   per frame: indices[count] (uint32) then energies[count] (float32)
+ *
+ * Version 2:
+ *   Header      24 bytes: magic "ATRB" (4) + numFrames (4) + numVoxels (4)
+ *                         + version (2, = 2) + flags (2) + log2 energy min (4) + max (4)
+ *                         [+ keyframe interval (4), TEMPORAL flag only]
+ *   Frame table  numFrames * 16 bytes: offset (4) + count (4) + size (4) + raw size (4)
+ *   Frame data   per frame block of size bytes, LZ4 block compressed when the
+ *                LZ4 flag is set and size != raw size, otherwise stored as is.
+ *                Uncompressed the block holds:
+ *                  indices as LEB128 varints, the first index then deltas to the previous one
+ *                  energies[count] as float32, or uint16 when the QUANTIZED flag is set:
+ *                    energy = 2^(min + q * (max - min) / 65535)
+ *
+ * Temporal frames (TEMPORAL flag): every keyframe interval'th frame is a keyframe,
+ * the others only hold what differs from their keyframe, so any frame decodes from
+ * its keyframe plus itself. Each block is prefixed with removals:
+ *   numRemoved varint, removed indices as varint deltas (voxels of the keyframe
+ *   that are silent in this frame), then indices / energies as above for the
+ *   voxels that are new or whose energy moved by more than the delta threshold
+ *   relative to the keyframe. Voxels within the threshold keep the keyframe energy.
+ *   Keyframes have numRemoved = 0 and list every voxel, count is the updated voxels.
+ *
+ * The version sits where v1 has its reserved word, so a zero there reads as v1.
+ * Energies are broadband, the sum over all octave bands.
+ */
+#define AT_ATRB_VERSION_1 1
+#define AT_ATRB_VERSION_2 2
+
+#define AT_ATRB_FLAG_QUANTIZED (1u << 0)
+#define AT_ATRB_FLAG_LZ4 (1u << 1)
+#define AT_ATRB_FLAG_TEMPORAL (1u << 2)
+
+struct AT_BinaryOptions
+{
+    uint16_t version;           // AT_ATRB_VERSION_1 / AT_ATRB_VERSION_2
+    bool quantize_energies;     // v2 only: 16 bit log quantized energies instead of float32
+    bool compress_frames;       // v2 only: LZ4 compress each frame block
+    uint32_t keyframe_interval; // v2 only: > 0 enables temporal frames with a keyframe every n frames
+    float delta_threshold;      // temporal: relative energy change to the keyframe worth an update
+};
+
+// prepared ATRB encoding of one simulation result: knows its exact size before
+// anything is written, LZ4 frame blocks are compressed up front and kept until written
+typedef struct AT_BinaryEncoder AT_BinaryEncoder;
+
+AT_Result AT_binary_encoder_create(
+        AT_BinaryEncoder **out_encoder,
+        AT_Simulation *simulation,
+        const AT_FrameIndex *index,
+        const AT_BinaryOptions *options
+);
+
+size_t AT_binary_encoder_size(const AT_BinaryEncoder *encoder);
+
+// streams header, frame table and frame blocks through write in fixed size chunks
+AT_Result AT_binary_encoder_write(
+        AT_BinaryEncoder *encoder,
+        AT_WriteFunc write,
+        void *user_data
+);
+
+void AT_binary_encoder_destroy(AT_BinaryEncoder *encoder);
+
+/*
+ * ATRP progressive stream, the mip levels of an AT_FramePyramid and then the full result:
+ *   Header      8 bytes: magic "ATRP" (4) + numLevels (4), the full result included
+ *   Levels      coarsest first, each: grid x, y, z (3 * 4) + size (4) followed by a
+ *               complete ATRB document of size bytes whose indices address that grid
+ *
+ * Every level holds the same energy per frame, so a reader can draw each one as
+ * soon as its document has arrived and the picture only sharpens from there.
+ */
+#define AT_ATRP_HEADER_SIZE 8
+#define AT_ATRP_LEVEL_HEADER_SIZE 16
+
+typedef struct AT_PyramidEncoder AT_PyramidEncoder;
+
+AT_Result AT_pyramid_encoder_create(
+        AT_PyramidEncoder **out_encoder,
+        AT_Simulation *simulation,
+        const AT_FrameIndex *index,
+        const AT_FramePyramid *pyramid, // mip levels of index
+        const AT_BinaryOptions *options // applied to every level
+);
+
+size_t AT_pyramid_encoder_size(const AT_PyramidEncoder *encoder);
+
+AT_Result AT_pyramid_encoder_write(
+        AT_PyramidEncoder *encoder,
+        AT_WriteFunc write,
+        void *user_data
+);
+
+void AT_pyramid_encoder_destroy(AT_PyramidEncoder *encoder);
+
+/*
+ * ATRS frame stream, a result sent while it is still being simulated:
+ *   Header      16 bytes: magic "ATRS" (4) + grid x, y, z (3 * 4)
+ *   Windows     in timeline order, each: frameStart (4) + size (4) followed by a
+ *               complete ATRB document of size bytes holding the frames from
+ *               frameStart on, the next window starts where this one ends
+ *   End         frameStart = total frames (4) + size 0 (4)
+ *
+ * Windows are written as frames become final (AT_simulation_run_progressive), a
+ * reader can play back everything before the next window's frameStart right away.
+ */
+#define AT_ATRS_HEADER_SIZE 16
+#define AT_ATRS_WINDOW_HEADER_SIZE 8
+
+AT_Result AT_frame_stream_write_header(
+        AT_WriteFunc write,
+        void *user_data,
+        const uint32_t grid[3]
+);
+
+// one window, window->frame_start places it on the timeline
+AT_Result AT_frame_stream_write_window(
+        AT_WriteFunc write,
+        void *user_data,
+        AT_Simulation *simulation,
+        const AT_FrameIndex *window,
+        const AT_BinaryOptions *options // NULL writes ATRB v1
+);
+
+AT_Result AT_frame_stream_write_end(
+        AT_WriteFunc write,
+        void *user_data,
+        uint32_t num_frames
+);
+
+#endif // AT_BINARY_H
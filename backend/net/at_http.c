@@ -0,0 +1,183 @@
+#include "at_http.h"
+#include "acoustic/at.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#define AT_HTTP_READ_SIZE 4096
+
+// offset of the "\r\n\r\n" ending the headers in data[from .. len), or len
+static size_t find_header_end(const char *data, size_t from, size_t len)
+{
+    for (size_t i = from; i + 4 <= len; i++)
+    {
+        if (data[i] == '\r' && data[i + 1] == '\n' && data[i + 2] == '\r' && data[i + 3] == '\n')
+            return i;
+    }
+    return len;
+}
+
+const char *AT_http_request_header(const AT_HttpRequest *request, const char *name)
+{
+    if (request->header_len == 0)
+        return NULL;
+
+    const size_t name_len = strlen(name);
+    const char *end = request->data + request->header_len;
+    // skip the request line, every header then starts right after a "\r\n"
+    const char *line = strstr(request->data, "\r\n");
+    while (line && line + 2 < end)
+    {
+        line += 2;
+        if ((size_t)(end - line) > name_len && strncasecmp(line, name, name_len) == 0 && line[name_len] == ':')
+        {
+            const char *value = line + name_len + 1;
+            while (*value == ' ' || *value == '\t')
+                value++;
+            return value;
+        }
+        line = strstr(line, "\r\n");
+    }
+    return NULL;
+}
+
+AT_HttpParseState AT_http_request_parse(AT_HttpRequest *request, size_t max_body)
+{
+    if (request->header_len == 0)
+    {
+        // the terminator may straddle the previous read, back up by its length
+        size_t from = request->scanned > 3 ? request->scanned - 3 : 0;
+        size_t end = find_header_end(request->data, from, request->len);
+        if (end == request->len)
+        {
+            request->scanned = request->len;
+            return request->len > AT_HTTP_MAX_HEADER_SIZE ? AT_HTTP_TOO_LARGE : AT_HTTP_INCOMPLETE;
+        }
+        request->scanned = request->len;
+        // header_len stays 0, that is how an oversized header tells from an oversized body
+        if (end + 4 > AT_HTTP_MAX_HEADER_SIZE)
+            return AT_HTTP_TOO_LARGE;
+        request->header_len = end + 4;
+
+        char version[16] = "";
+        if (sscanf(request->data, "%7s %255s %15s", request->method, request->path, version) != 3 ||
+            strncmp(version, "HTTP/", 5) != 0)
+            return AT_HTTP_BAD_REQUEST;
+
+        // a body has to announce its length, chunked uploads are not accepted
+        const char *transfer_encoding = AT_http_request_header(request, "Transfer-Encoding");
+        if (transfer_encoding && strncasecmp(transfer_encoding, "identity", 8) != 0)
+            return AT_HTTP_BAD_REQUEST;
+
+        const char *content_length = AT_http_request_header(request, "Content-Length");
+        if (content_length)
+        {
+            char *digits_end = NULL;
+            unsigned long long length = strtoull(content_length, &digits_end, 10);
+            if (digits_end == content_length || (*digits_end != '\r' && *digits_end != ' ') ||
+                content_length[0] == '-')
+                return AT_HTTP_BAD_REQUEST;
+            if (length > max_body)
+                return AT_HTTP_TOO_LARGE;
+            request->content_length = (size_t)length;
+        }
+
+        const char *expect = AT_http_request_header(request, "Expect");
+        request->expects_continue = expect && strncasecmp(expect, "100-continue", 12) == 0;
+
+        const char *connection = AT_http_request_header(request, "Connection");
+        request->keep_alive = strcmp(version, "HTTP/1.0") == 0
+                                  ? connection && strncasecmp(connection, "keep-alive", 10) == 0
+                                  : !connection || strncasecmp(connection, "close", 5) != 0;
+    }
+
+    const size_t end = request->header_len + request->content_length;
+    if (request->len < end)
+        return AT_HTTP_INCOMPLETE;
+    if (!request->complete)
+    {
+        // the buffer always has room for it, see AT_http_request_receive
+        request->next_byte = request->data[end];
+        request->data[end] = '\0';
+        request->complete = true;
+    }
+    return AT_HTTP_COMPLETE;
+}
+
+AT_Result AT_http_request_receive(AT_HttpRequest *request, int client_fd, size_t max_body,
+                                  AT_HttpParseState *out_state)
+{
+    AT_HttpParseState state = AT_http_request_parse(request, max_body);
+    if (state != AT_HTTP_INCOMPLETE)
+    {
+        *out_state = state;
+        return AT_OK;
+    }
+
+    if (request->header_len > 0 && request->expects_continue && !request->continue_sent)
+    {
+        const char *resp = "HTTP/1.1 100 Continue\r\n\r\n";
+        write(client_fd, resp, strlen(resp));
+        request->continue_sent = true;
+    }
+
+    // once the headers are in the buffer grows straight to the whole request,
+    // until then in read sized steps, one spare byte for the NUL
+    size_t needed = request->header_len > 0 ? request->header_len + request->content_length + 1
+                                            : request->len + AT_HTTP_READ_SIZE + 1;
+    if (needed > request->capacity)
+    {
+        size_t capacity = request->capacity > 0 ? request->capacity : AT_HTTP_READ_SIZE;
+        while (capacity < needed)
+            capacity *= 2;
+        if (request->header_len > 0)
+            capacity = needed;
+        char *data = realloc(request->data, capacity);
+        if (!data)
+            return AT_ERR_ALLOC_ERROR;
+        request->data = data;
+        request->capacity = capacity;
+    }
+
+    ssize_t bytes = read(client_fd, request->data + request->len, request->capacity - 1 - request->len);
+    if (bytes <= 0)
+        return AT_ERR_NETWORK_FAILURE;
+    request->len += (size_t)bytes;
+    request->data[request->len] = '\0';
+
+    *out_state = AT_http_request_parse(request, max_body);
+    return AT_OK;
+}
+
+void AT_http_request_next(AT_HttpRequest *request)
+{
+    const size_t end = request->header_len + request->content_length;
+    if (request->complete)
+        request->data[end] = request->next_byte;
+    const size_t rest = request->len > end ? request->len - end : 0;
+    if (rest > 0)
+        memmove(request->data, request->data + end, rest);
+
+    *request = (AT_HttpRequest){.data = request->data, .len = rest, .capacity = request->capacity};
+    if (request->data)
+        request->data[rest] = '\0';
+}
+
+char *AT_http_request_body(const AT_HttpRequest *request)
+{
+    return request->data + request->header_len;
+}
+
+size_t AT_http_request_body_size(const AT_HttpRequest *request)
+{
+    return request->content_length;
+}
+
+void AT_http_request_free(AT_HttpRequest *request)
+{
+    free(request->data);
+    *request = (AT_HttpRequest){0};
+}
@@ -0,0 +1,60 @@
+#ifndef AT_HTTP_H
+#define AT_HTTP_H
+
+#include "../../core/include/acoustic/at.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define AT_HTTP_MAX_HEADER_SIZE 16384
+
+typedef enum
+{
+    AT_HTTP_INCOMPLETE,    // more bytes are needed
+    AT_HTTP_COMPLETE,      // request line, headers and the whole body are buffered
+    AT_HTTP_BAD_REQUEST,   // malformed request line or Content-Length
+    AT_HTTP_TOO_LARGE,     // headers (header_len still 0) or body over their limit
+} AT_HttpParseState;
+
+// requests read off one connection, buffered in a single growable allocation so the
+// body can be handed on (e.g. parsed as a GLB) without another copy, bytes of a
+// pipelined next request stay behind the current one until AT_http_request_next
+typedef struct
+{
+    char *data;
+    size_t len;
+    size_t capacity;
+    size_t scanned;        // bytes already searched for the end of the headers
+    size_t header_len;     // up to and including the blank line, 0 until it arrived
+    size_t content_length;
+    bool expects_continue; // client waits for a 100 Continue before sending the body
+    bool continue_sent;
+    bool keep_alive;       // HTTP/1.1 without "Connection: close", or a 1.0 keep-alive
+    bool complete;
+    char next_byte;        // first byte after the body, replaced by its NUL terminator
+    char method[8];
+    char path[256];
+} AT_HttpRequest;
+
+// examines what is buffered so far, only ever looks at new bytes once the headers are in
+AT_HttpParseState AT_http_request_parse(AT_HttpRequest *request, size_t max_body);
+
+// one read() from client_fd, so it only blocks when nothing is waiting, then parses,
+// answers Expect: 100-continue, AT_ERR_NETWORK_FAILURE when the client hung up
+AT_Result AT_http_request_receive(AT_HttpRequest *request, int client_fd, size_t max_body,
+                                  AT_HttpParseState *out_state);
+
+// drops the complete current request, whatever was read past it becomes the next one
+void AT_http_request_next(AT_HttpRequest *request);
+
+// NUL terminated, the terminator is not part of body_size
+char *AT_http_request_body(const AT_HttpRequest *request);
+size_t AT_http_request_body_size(const AT_HttpRequest *request);
+
+// value of a header, matched case-insensitively, NULL when absent, not NUL terminated:
+// the value runs to the next "\r\n"
+const char *AT_http_request_header(const AT_HttpRequest *request, const char *name);
+
+void AT_http_request_free(AT_HttpRequest *request);
+
+#endif // AT_HTTP_H
@@ -0,0 +1,201 @@
+#include "at_json.h"
+#include "at_net.h"
+#include "at_stream.h"
+#include "../../core/src/at_internal.h"
+#include "../../core/src/at_frame_index.h"
+#include "acoustic/at.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#define JSON_FLOAT_DIGITS 9
+
+// exactly representable powers of ten, larger ones are built from two of these
+static const double POW10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// v * 10^e, dividing by exact powers keeps negative e as accurate as positive ones
+static inline double scale_pow10(double v, int e)
+{
+    for (; e > 22; e -= 22)
+        v *= POW10[22];
+    for (; e < -22; e += 22)
+        v /= POW10[22];
+    return e >= 0 ? v * POW10[e] : v / POW10[-e];
+}
+
+size_t AT_json_format_u32(char *dst, uint32_t value)
+{
+    char tmp[AT_JSON_U32_MAX_LENGTH];
+    size_t n = 0;
+    do
+    {
+        tmp[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+
+    for (size_t i = 0; i < n; i++)
+        dst[i] = tmp[n - 1 - i];
+    return n;
+}
+
+size_t AT_json_format_float(char *dst, float value)
+{
+    char *p = dst;
+    if (!isfinite(value) || value == 0.0f)
+    {
+        *p = '0';
+        return 1;
+    }
+
+    double v = value;
+    if (v < 0.0)
+    {
+        *p++ = '-';
+        v = -v;
+    }
+
+    // 9 digit integer mantissa: v = digits * 10^(exp10 - 8)
+    int exp10 = (int)floor(log10(v));
+    uint32_t digits = (uint32_t)(scale_pow10(v, JSON_FLOAT_DIGITS - 1 - exp10) + 0.5);
+    if (digits >= 1000000000u)
+    {
+        digits = (digits + 5) / 10;
+        exp10++;
+    }
+    else if (digits < 100000000u)
+    {
+        // log10 landed just below a power of ten
+        digits = (uint32_t)(scale_pow10(v, JSON_FLOAT_DIGITS - exp10) + 0.5);
+        exp10--;
+    }
+
+    int num_digits = JSON_FLOAT_DIGITS;
+    while (num_digits > 1 && digits % 10 == 0)
+    {
+        digits /= 10;
+        num_digits--;
+    }
+    char d[JSON_FLOAT_DIGITS];
+    for (int i = num_digits - 1; i >= 0; i--)
+    {
+        d[i] = (char)('0' + digits % 10);
+        digits /= 10;
+    }
+
+    if (exp10 < -5 || exp10 >= JSON_FLOAT_DIGITS)
+    {
+        *p++ = d[0];
+        if (num_digits > 1)
+        {
+            *p++ = '.';
+            memcpy(p, d + 1, (size_t)num_digits - 1);
+            p += num_digits - 1;
+        }
+        *p++ = 'e';
+        if (exp10 < 0)
+        {
+            *p++ = '-';
+            exp10 = -exp10;
+        }
+        p += AT_json_format_u32(p, (uint32_t)exp10);
+    }
+    else if (exp10 < 0)
+    {
+        *p++ = '0';
+        *p++ = '.';
+        for (int i = 0; i < -exp10 - 1; i++)
+            *p++ = '0';
+        memcpy(p, d, (size_t)num_digits);
+        p += num_digits;
+    }
+    else
+    {
+        int int_digits = exp10 + 1;
+        for (int i = 0; i < int_digits; i++)
+            *p++ = i < num_digits ? d[i] : '0';
+        if (num_digits > int_digits)
+        {
+            *p++ = '.';
+            memcpy(p, d + int_digits, (size_t)(num_digits - int_digits));
+            p += num_digits - int_digits;
+        }
+    }
+    return (size_t)(p - dst);
+}
+
+// {"<voxel>":<energy>} plus a leading comma when it is not the first entry
+#define JSON_ENTRY_MAX_LENGTH (AT_JSON_U32_MAX_LENGTH + AT_JSON_FLOAT_MAX_LENGTH + 7)
+// ,"frame_<n>":[
+#define JSON_FRAME_MAX_LENGTH (AT_JSON_U32_MAX_LENGTH + 12)
+
+AT_Result AT_simulation_write_json(AT_Simulation *simulation, const AT_FrameFilter *filter,
+                                   AT_WriteFunc write, void *user_data)
+{
+    if (!simulation || !write)
+        return AT_ERR_INVALID_ARGUMENT;
+
+    AT_FrameIndex *index = NULL;
+    AT_Result res = AT_frame_index_create(&index, simulation, filter);
+    if (res != AT_OK)
+        return res;
+
+    AT_StreamWriter *w = AT_stream_create(write, user_data);
+    if (!w)
+    {
+        AT_frame_index_destroy(index);
+        return AT_ERR_ALLOC_ERROR;
+    }
+
+    res = AT_stream_put(w, "{", 1);
+    for (uint32_t f = 0; f < index->num_frames && res == AT_OK; f++)
+    {
+        char *p = NULL;
+        res = AT_stream_reserve(w, JSON_FRAME_MAX_LENGTH, &p);
+        if (res != AT_OK)
+            break;
+        char *start = p;
+        if (f > 0)
+            *p++ = ',';
+        memcpy(p, "\"frame_", 7);
+        p += 7;
+        p += AT_json_format_u32(p, index->frame_start + f);
+        memcpy(p, "\":[", 3);
+        p += 3;
+        AT_stream_commit(w, (size_t)(p - start));
+
+        const uint32_t count = AT_frame_index_count(index, f);
+        const uint32_t *frame_voxels = AT_frame_index_voxels(index, f);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            res = AT_stream_reserve(w, JSON_ENTRY_MAX_LENGTH, &p);
+            if (res != AT_OK)
+                break;
+            start = p;
+            if (i > 0)
+                *p++ = ',';
+            memcpy(p, "{\"", 2);
+            p += 2;
+            p += AT_json_format_u32(p, frame_voxels[i]);
+            memcpy(p, "\":", 2);
+            p += 2;
+            p += AT_json_format_float(p, AT_frame_index_energy(index, simulation, f, i));
+            *p++ = '}';
+            AT_stream_commit(w, (size_t)(p - start));
+        }
+
+        if (res == AT_OK)
+            res = AT_stream_put(w, "]", 1);
+    }
+
+    if (res == AT_OK)
+        res = AT_stream_put(w, "}", 1);
+    if (res == AT_OK)
+        res = AT_stream_flush(w);
+    free(w);
+    AT_frame_index_destroy(index);
+    return res;
+}
@@ -0,0 +1,37 @@
+#ifndef AT_JSON_H
+#define AT_JSON_H
+
+#include "../../core/include/acoustic/at.h"
+#include "at_net.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+// longest text AT_json_format_float / AT_json_format_u32 produce
+#define AT_JSON_FLOAT_MAX_LENGTH 16
+#define AT_JSON_U32_MAX_LENGTH 10
+
+// writes value with 9 significant digits (enough for any float to round-trip),
+// trailing zeros trimmed, exponent form outside 1e-5 .. 1e9, non-finite as 0,
+// no terminator, returns the length
+size_t AT_json_format_float(char *dst, float value);
+
+size_t AT_json_format_u32(char *dst, uint32_t value);
+
+/** \brief Streams the simulation result as JSON through write.
+
+    {"frame_0":[{"<voxel>":<energy>},...],"frame_1":[...],...}
+
+    Frames are emitted straight from the frame-major index, nothing is built
+    up in memory beyond the stream chunk.
+
+    \param filter NULL exports every voxel with energy > 0.
+ */
+AT_Result AT_simulation_write_json(
+        AT_Simulation *simulation,
+        const AT_FrameFilter *filter,
+        AT_WriteFunc write,
+        void *user_data
+);
+
+#endif // AT_JSON_H
@@ -0,0 +1,90 @@
+#include "at_lz4.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define LZ4_HASH_BITS 12
+#define LZ4_MIN_MATCH 4
+#define LZ4_MAX_OFFSET 65535
+#define LZ4_LAST_LITERALS 5 // the block must end with at least 5 literals
+#define LZ4_MF_LIMIT 12     // the last match must start 12 bytes before the end
+
+static inline uint32_t read_u32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline uint32_t hash_u32(uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - LZ4_HASH_BITS);
+}
+
+static uint8_t *write_length(uint8_t *op, size_t len)
+{
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+static uint8_t *write_literals(uint8_t *op, uint8_t *token, const uint8_t *literals, size_t len)
+{
+    *token = (uint8_t)((len < 15 ? len : 15) << 4);
+    if (len >= 15) op = write_length(op, len - 15);
+    memcpy(op, literals, len);
+    return op + len;
+}
+
+size_t AT_lz4_compress(const uint8_t *src, size_t size, uint8_t *dst)
+{
+    uint32_t table[1 << LZ4_HASH_BITS] = {0};
+    uint8_t *op = dst;
+    size_t anchor = 0;
+
+    if (size > LZ4_MF_LIMIT) {
+        const size_t match_limit = size - LZ4_MF_LIMIT;
+        const size_t match_end_limit = size - LZ4_LAST_LITERALS;
+        size_t ip = 0;
+
+        while (ip < match_limit) {
+            const uint32_t seq = read_u32(src + ip);
+            const uint32_t h = hash_u32(seq);
+            const size_t ref = table[h];
+            table[h] = (uint32_t)ip;
+
+            //empty slots read as position 0, the byte compare rejects them
+            if (ref >= ip || ip - ref > LZ4_MAX_OFFSET || read_u32(src + ref) != seq) {
+                ip++;
+                continue;
+            }
+
+            size_t match_len = LZ4_MIN_MATCH;
+            while (ip + match_len < match_end_limit && src[ref + match_len] == src[ip + match_len]) {
+                match_len++;
+            }
+
+            uint8_t *token = op++;
+            op = write_literals(op, token, src + anchor, ip - anchor);
+
+            const uint16_t offset = (uint16_t)(ip - ref);
+            *op++ = (uint8_t)(offset & 0xFF);
+            *op++ = (uint8_t)(offset >> 8);
+
+            const size_t ml = match_len - LZ4_MIN_MATCH;
+            *token |= (uint8_t)(ml < 15 ? ml : 15);
+            if (ml >= 15) op = write_length(op, ml - 15);
+
+            ip += match_len;
+            anchor = ip;
+        }
+    }
+
+    uint8_t *token = op++;
+    op = write_literals(op, token, src + anchor, size - anchor);
+    return (size_t)(op - dst);
+}
@@ -0,0 +1,20 @@
+#ifndef AT_LZ4_H
+#define AT_LZ4_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// minimal LZ4 block format compressor (no frame format, no dictionary),
+// greedy single-probe hash matching, output decodes with any LZ4 block decoder
+
+// worst case compressed size for an input of size bytes
+static inline size_t AT_lz4_compress_bound(size_t size)
+{
+    return size + size / 255 + 16;
+}
+
+// compresses src into dst, dst must hold AT_lz4_compress_bound(size) bytes,
+// returns the compressed size
+size_t AT_lz4_compress(const uint8_t *src, size_t size, uint8_t *dst);
+
+#endif // AT_LZ4_H
@@ -0,0 +1,187 @@
+#include "at_model_cache.h"
+#include "at_sha256.h"
+#include "acoustic/at.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct
+{
+    uint64_t key;    // first 8 bytes of digest, what clients name the model by
+    uint8_t digest[AT_SHA256_SIZE];
+    size_t size;     // of the GLB, compared along with the digest
+    AT_Model *model; // NULL for a free slot
+    uint32_t refs;
+    uint64_t last_used;
+} AT_ModelCacheEntry;
+
+struct AT_ModelCache
+{
+    pthread_mutex_t lock;
+    AT_ModelCacheEntry *entries;
+    uint32_t capacity;
+    uint64_t clock; // bumped on every use, orders the entries for eviction
+};
+
+static uint64_t digest_key(const uint8_t digest[AT_SHA256_SIZE])
+{
+    uint64_t key = 0;
+    for (int i = 0; i < 8; i++)
+        key = key << 8 | digest[i];
+    return key;
+}
+
+static AT_ModelCacheEntry *find_entry(AT_ModelCache *cache, uint64_t key)
+{
+    for (uint32_t i = 0; i < cache->capacity; i++)
+    {
+        if (cache->entries[i].model && cache->entries[i].key == key)
+            return &cache->entries[i];
+    }
+    return NULL;
+}
+
+AT_Result AT_model_cache_create(AT_ModelCache **out_cache, uint32_t capacity)
+{
+    if (!out_cache || *out_cache || capacity == 0)
+        return AT_ERR_INVALID_ARGUMENT;
+
+    AT_ModelCache *cache = calloc(1, sizeof(AT_ModelCache));
+    AT_ModelCacheEntry *entries = calloc(capacity, sizeof(AT_ModelCacheEntry));
+    if (!cache || !entries)
+    {
+        free(cache);
+        free(entries);
+        return AT_ERR_ALLOC_ERROR;
+    }
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->entries = entries;
+    cache->capacity = capacity;
+
+    *out_cache = cache;
+    return AT_OK;
+}
+
+AT_Result AT_model_cache_insert(AT_ModelCache *cache, const void *glb, size_t size, uint64_t *out_key,
+                                bool *out_cached)
+{
+    if (!cache || !glb || size == 0 || !out_key || !out_cached)
+        return AT_ERR_INVALID_ARGUMENT;
+
+    // SHA-256 and the size, a hit has to be the same bytes, a client must not be able
+    // to craft an upload that is served another one's model
+    uint8_t digest[AT_SHA256_SIZE];
+    AT_sha256(glb, size, digest);
+    const uint64_t key = digest_key(digest);
+    pthread_mutex_lock(&cache->lock);
+    AT_ModelCacheEntry *entry = find_entry(cache, key);
+    const bool same = entry && entry->size == size && memcmp(entry->digest, digest, AT_SHA256_SIZE) == 0;
+    if (same)
+        entry->last_used = ++cache->clock;
+    pthread_mutex_unlock(&cache->lock);
+    // another file with the same key, ids would become ambiguous
+    if (entry && !same)
+        return AT_ERR_INVALID_ARGUMENT;
+    if (entry)
+    {
+        *out_key = key;
+        *out_cached = true;
+        return AT_OK;
+    }
+
+    // parsed without the lock, other uploads and lookups go on meanwhile
+    AT_Model *model = NULL;
+    AT_Result res = AT_model_create_from_memory(&model, glb, size, NULL, 0);
+    if (res != AT_OK)
+        return res;
+
+    pthread_mutex_lock(&cache->lock);
+    bool cached = false;
+    entry = find_entry(cache, key);
+    if (entry && (entry->size != size || memcmp(entry->digest, digest, AT_SHA256_SIZE) != 0))
+    {
+        pthread_mutex_unlock(&cache->lock);
+        AT_model_destroy(model);
+        return AT_ERR_INVALID_ARGUMENT;
+    }
+    if (entry)
+    {
+        // the same file finished parsing on another worker first, keep that one
+        cached = true;
+    }
+    else
+    {
+        for (uint32_t i = 0; i < cache->capacity; i++)
+        {
+            AT_ModelCacheEntry *candidate = &cache->entries[i];
+            if (candidate->refs > 0)
+                continue;
+            if (!entry || !candidate->model || (entry->model && candidate->last_used < entry->last_used))
+                entry = candidate;
+        }
+        if (entry)
+        {
+            if (entry->model)
+                AT_model_destroy(entry->model);
+            *entry = (AT_ModelCacheEntry){.key = key, .size = size, .model = model};
+            memcpy(entry->digest, digest, AT_SHA256_SIZE);
+            model = NULL;
+        }
+    }
+    if (entry)
+        entry->last_used = ++cache->clock;
+    pthread_mutex_unlock(&cache->lock);
+
+    if (model)
+        AT_model_destroy(model);
+    if (!entry)
+        return AT_ERR_ALLOC_ERROR;
+
+    *out_key = key;
+    *out_cached = cached;
+    return AT_OK;
+}
+
+AT_Model *AT_model_cache_acquire(AT_ModelCache *cache, uint64_t key)
+{
+    pthread_mutex_lock(&cache->lock);
+    AT_ModelCacheEntry *entry = find_entry(cache, key);
+    AT_Model *model = NULL;
+    if (entry)
+    {
+        entry->refs++;
+        entry->last_used = ++cache->clock;
+        model = entry->model;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return model;
+}
+
+void AT_model_cache_release(AT_ModelCache *cache, AT_Model *model)
+{
+    pthread_mutex_lock(&cache->lock);
+    for (uint32_t i = 0; i < cache->capacity; i++)
+    {
+        if (cache->entries[i].model == model)
+        {
+            cache->entries[i].refs--;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void AT_model_cache_destroy(AT_ModelCache *cache)
+{
+    if (!cache)
+        return;
+
+    for (uint32_t i = 0; i < cache->capacity; i++)
+        AT_model_destroy(cache->entries[i].model);
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->entries);
+    free(cache);
+}
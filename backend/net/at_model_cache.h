@@ -0,0 +1,37 @@
+#ifndef AT_MODEL_CACHE_H
+#define AT_MODEL_CACHE_H
+
+#include "../../core/include/acoustic/at.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// uploaded models keyed by the SHA-256 of their GLB bytes, so a client sending the
+// same file again reuses the parsed model, thread safe, entries nobody holds a
+// reference to are evicted least recently used first
+typedef struct AT_ModelCache AT_ModelCache;
+
+AT_Result AT_model_cache_create(AT_ModelCache **out_cache, uint32_t capacity);
+
+// parses glb unless the same bytes are cached already, *out_key names the model for
+// AT_model_cache_acquire, AT_ERR_ALLOC_ERROR when every entry is in use and
+// AT_ERR_INVALID_ARGUMENT when a different cached file has the same key
+AT_Result AT_model_cache_insert(
+        AT_ModelCache *cache,
+        const void *glb,
+        size_t size,
+        uint64_t *out_key,
+        bool *out_cached
+);
+
+// reference to the model of key, NULL when it was never uploaded or got evicted,
+// the model is shared and must only be read, give it back with AT_model_cache_release
+AT_Model *AT_model_cache_acquire(AT_ModelCache *cache, uint64_t key);
+
+void AT_model_cache_release(AT_ModelCache *cache, AT_Model *model);
+
+// every reference must have been released
+void AT_model_cache_destroy(AT_ModelCache *cache);
+
+#endif // AT_MODEL_CACHE_H
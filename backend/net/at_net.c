@@ -1,416 +1,2169 @@
 #include "at_net.h"
+#include "at_binary.h"
+#include "at_json.h"
 #include "../../core/src/at_internal.h"
 #include "../../core/src/at_voxel.h"
+#include "../../core/src/at_frame_index.h"
 #include "acoustic/at.h"
 #include "acoustic/at_result.h"
+#include "at_http.h"
+#include "at_model_cache.h"
+#include "at_pool.h"
 #include "cJSON.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <sys/socket.h>
+#include <sys/time.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
-#define BUFFER_SIZE 4096
+#define AT_SERVER_QUEUE_CAPACITY 16
+#define AT_SERVER_MAX_BODY (256u << 20) // fits any room model worth uploading
+#define AT_SERVER_MODEL_CACHE_CAPACITY 8
+#define AT_SERVER_READ_TIMEOUT_S 5  // a request that started arriving has this long to finish
+#define AT_SERVER_IDLE_TIMEOUT_S 30 // a kept alive connection waits this long for its next one
+#define AT_SERVER_MAX_CONNECTIONS 256
+#define AT_SERVER_MAX_JOBS 64
+#define AT_SERVER_MAX_SOURCES 16
+#define AT_SERVER_MAX_RECEIVERS 256
+#define AT_SERVER_MAX_RAYS (1u << 20) // per source, 16 sources of them already take 1.5 GB of rays
+#define AT_CHUNK_SIZE 65536
+
+// every response carries these so the dev frontend can call the server
+#define AT_CORS_HEADERS                                            \
+    "Access-Control-Allow-Origin: http://localhost:5173\r\n"       \
+    "Access-Control-Allow-Methods: GET, POST, DELETE, OPTIONS\r\n" \
+    "Access-Control-Allow-Headers: content-type\r\n"
 
 typedef struct sockaddr_in sockaddr_in;
 typedef struct sockaddr sockaddr;
 
-AT_Result AT_simulation_to_json(cJSON **out_json, AT_Simulation *simulation)
+typedef struct
 {
-    if (!out_json || *out_json || !simulation)
-        return AT_ERR_INVALID_ARGUMENT;
-
-    size_t FRAME_NUM_BUFFER_LENGTH = sizeof(uint8_t);
-    cJSON *json = cJSON_CreateObject();
+    uint8_t *buf;
+    size_t pos;
+    size_t capacity;
+} AT_MemoryWriter;
 
-    AT_Voxel *voxels = simulation->voxel_grid;
-    uint32_t num_voxels = simulation->num_voxels;
-    uint32_t num_bins = AT_voxel_get_num_bins(simulation);
+static AT_Result write_to_memory(void *user_data, const void *data, size_t size)
+{
+    AT_MemoryWriter *m = user_data;
+    if (m->pos + size > m->capacity)
+    {
+        size_t capacity = m->capacity > 0 ? m->capacity : 4096;
+        while (capacity < m->pos + size)
+            capacity *= 2;
+        uint8_t *buf = realloc(m->buf, capacity);
+        if (!buf)
+            return AT_ERR_ALLOC_ERROR;
+        m->buf = buf;
+        m->capacity = capacity;
+    }
+    memcpy(m->buf + m->pos, data, size);
+    m->pos += size;
+    return AT_OK;
+}
 
-    for (uint32_t f = 0; f < num_bins; f++)
+AT_Result AT_write_to_fd(void *user_data, const void *data, size_t size)
+{
+    int fd = *(int *)user_data;
+    const uint8_t *src = data;
+    size_t sent = 0;
+    while (sent < size)
     {
+        ssize_t w = write(fd, src + sent, size - sent);
+        if (w <= 0)
+            return AT_ERR_NETWORK_FAILURE;
+        sent += (size_t)w;
+    }
+    return AT_OK;
+}
 
-        char frame_num[FRAME_NUM_BUFFER_LENGTH];
-        sprintf(frame_num, "frame_%d", f);
+// HTTP/1.1 chunked body on a socket, writes are gathered into chunks of up to
+// AT_CHUNK_SIZE bytes, flush_chunk sends what is gathered so far as its own chunk
+typedef struct
+{
+    int fd;
+    size_t len;
+    uint8_t buf[AT_CHUNK_SIZE];
+} AT_ChunkedWriter;
 
-        cJSON *frame_data = cJSON_CreateArray();
+static AT_Result flush_chunk(AT_ChunkedWriter *c)
+{
+    if (c->len == 0)
+        return AT_OK;
+    char size_line[32];
+    int n = snprintf(size_line, sizeof(size_line), "%zx\r\n", c->len);
+    AT_Result res = AT_write_to_fd(&c->fd, size_line, (size_t)n);
+    if (res == AT_OK)
+        res = AT_write_to_fd(&c->fd, c->buf, c->len);
+    if (res == AT_OK)
+        res = AT_write_to_fd(&c->fd, "\r\n", 2);
+    c->len = 0;
+    return res;
+}
 
-        for (uint32_t v = 0; v < num_voxels; v++)
+static AT_Result write_chunked(void *user_data, const void *data, size_t size)
+{
+    AT_ChunkedWriter *c = user_data;
+    const uint8_t *src = data;
+    while (size > 0)
+    {
+        size_t n = size < AT_CHUNK_SIZE - c->len ? size : AT_CHUNK_SIZE - c->len;
+        memcpy(c->buf + c->len, src, n);
+        c->len += n;
+        src += n;
+        size -= n;
+        if (c->len == AT_CHUNK_SIZE)
         {
+            AT_Result res = flush_chunk(c);
+            if (res != AT_OK)
+                return res;
+        }
+    }
+    return AT_OK;
+}
+
+// flushes the rest and the zero length chunk that ends the body
+static AT_Result finish_chunked(AT_ChunkedWriter *c)
+{
+    AT_Result res = flush_chunk(c);
+    return res == AT_OK ? AT_write_to_fd(&c->fd, "0\r\n\r\n", 5) : res;
+}
 
-            AT_Voxel voxel = voxels[v];
+AT_Result AT_write_to_file(void *user_data, const void *data, size_t size)
+{
+    FILE *file = user_data;
+    return fwrite(data, 1, size, file) == size ? AT_OK : AT_ERR_INVALID_ARGUMENT;
+}
 
-            float energy = (f < voxel.count) ? voxel.items[f] : 0;
+AT_Result AT_simulation_to_json(char **out_json, size_t *out_size, AT_Simulation *simulation,
+                                const AT_FrameFilter *filter)
+{
+    if (!out_json || *out_json || !out_size || !simulation)
+        return AT_ERR_INVALID_ARGUMENT;
 
-            // TODO: IF ENERGY OVER MIN THRESHOLD
-            if (energy <= 0)
-                continue;
+    AT_MemoryWriter memory = {0};
+    AT_Result res = AT_simulation_write_json(simulation, filter, write_to_memory, &memory);
+    // NUL terminated for callers that treat it as a C string, not counted in out_size
+    if (res == AT_OK)
+        res = write_to_memory(&memory, "", 1);
+    if (res != AT_OK)
+    {
+        free(memory.buf);
+        return res;
+    }
 
-            char voxel_num[num_voxels];
-            sprintf(voxel_num, "%d", v);
+    *out_json = (char *)memory.buf;
+    *out_size = memory.pos - 1;
+    return AT_OK;
+}
+
+AT_Result AT_simulation_to_binary(uint8_t **out_buf, size_t *out_size, AT_Simulation *simulation,
+                                  const AT_BinaryOptions *options, const AT_FrameFilter *filter)
+{
+    if (!out_buf || !out_size || !simulation)
+        return AT_ERR_INVALID_ARGUMENT;
 
-            cJSON *voxel_data = cJSON_CreateObject();
+    AT_FrameIndex *index = NULL;
+    AT_Result res = AT_frame_index_create(&index, simulation, filter);
+    if (res != AT_OK)
+        return res;
 
-            cJSON_AddNumberToObject(voxel_data, voxel_num, energy);
-            cJSON_AddItemToArray(frame_data, voxel_data);
-        }
+    AT_BinaryEncoder *encoder = NULL;
+    res = AT_binary_encoder_create(&encoder, simulation, index, options);
+    if (res != AT_OK)
+    {
+        AT_frame_index_destroy(index);
+        return res;
+    }
 
-        cJSON_AddItemToObject(json, frame_num, frame_data);
+    size_t total = AT_binary_encoder_size(encoder);
+    AT_MemoryWriter memory = {.buf = malloc(total), .pos = 0, .capacity = total};
+    res = memory.buf ? AT_binary_encoder_write(encoder, write_to_memory, &memory) : AT_ERR_ALLOC_ERROR;
+    AT_binary_encoder_destroy(encoder);
+    AT_frame_index_destroy(index);
+    if (res != AT_OK)
+    {
+        free(memory.buf);
+        return res;
     }
-    *out_json = json;
+
+    *out_buf = memory.buf;
+    *out_size = total;
     return AT_OK;
 }
 
-AT_Result AT_simulation_to_binary(uint8_t **out_buf, size_t *out_size, AT_Simulation *simulation)
+AT_Result AT_simulation_query_binary(uint8_t **out_buf, size_t *out_size, AT_Simulation *simulation,
+                                     const AT_FrameIndex *index, const AT_FrameQuery *query,
+                                     const AT_BinaryOptions *options)
 {
-    if (!out_buf || !out_size || !simulation)
+    if (!out_buf || !out_size || !simulation || !query)
         return AT_ERR_INVALID_ARGUMENT;
 
-    AT_Voxel *voxels = simulation->voxel_grid;
-    uint32_t num_voxels = simulation->num_voxels;
-    uint32_t num_frames = AT_voxel_get_num_bins(simulation);
+    // a one off query still pays for the full index, callers serving many keep theirs
+    AT_FrameIndex *full = NULL;
+    AT_Result res = index ? AT_OK : AT_frame_index_create(&full, simulation, NULL);
+    if (res != AT_OK)
+        return res;
 
-    /* First pass: count active voxels per frame */
-    uint32_t *counts = calloc(num_frames, sizeof(uint32_t));
-    if (!counts)
-        return AT_ERR_ALLOC_ERROR;
+    AT_FrameIndex *window = NULL;
+    res = AT_frame_index_query(&window, index ? index : full, simulation, query);
+    AT_frame_index_destroy(full);
+    if (res != AT_OK)
+        return res;
 
-    for (uint32_t f = 0; f < num_frames; f++)
+    AT_BinaryEncoder *encoder = NULL;
+    res = AT_binary_encoder_create(&encoder, simulation, window, options);
+    if (res != AT_OK)
     {
-        for (uint32_t v = 0; v < num_voxels; v++)
-        {
-            float energy = (f < voxels[v].count) ? voxels[v].items[f] : 0.0f;
-            if (energy > 0.0f)
-                counts[f]++;
-        }
+        AT_frame_index_destroy(window);
+        return res;
     }
 
-    /*
-     * Binary layout (all multi-byte values little-endian):
-     *   Header      16 bytes: magic "ATRB" (4) + numFrames (4) + numVoxels (4) + reserved (4)
-     *   Frame table  numFrames * 8 bytes: offset (4) + count (4) per frame
-     *   Frame data   per frame: indices[count] (uint32) then energies[count] (float32)
-     */
-    size_t header_sz = 16;
-    size_t table_sz = (size_t)num_frames * 8;
-    size_t data_sz = 0;
-    for (uint32_t f = 0; f < num_frames; f++)
-        data_sz += (size_t)counts[f] * 8;
-
-    size_t total = header_sz + table_sz + data_sz;
-    uint8_t *buf = malloc(total);
-    if (!buf)
-    {
-        free(counts);
-        return AT_ERR_ALLOC_ERROR;
-    }
-
-    /* Header */
-    buf[0] = 'A';
-    buf[1] = 'T';
-    buf[2] = 'R';
-    buf[3] = 'B';
-    memcpy(buf + 4, &num_frames, 4);
-    memcpy(buf + 8, &num_voxels, 4);
-    memset(buf + 12, 0, 4);
-
-    /* Frame table + data */
-    size_t data_pos = header_sz + table_sz;
-    for (uint32_t f = 0; f < num_frames; f++)
-    {
-        uint32_t off32 = (uint32_t)data_pos;
-        memcpy(buf + header_sz + (size_t)f * 8, &off32, 4);
-        memcpy(buf + header_sz + (size_t)f * 8 + 4, &counts[f], 4);
-
-        /* SoA: write all indices first, then all energies */
-        uint32_t written = 0;
-        for (uint32_t v = 0; v < num_voxels; v++)
-        {
-            float energy = (f < voxels[v].count) ? voxels[v].items[f] : 0.0f;
-            if (energy > 0.0f)
-            {
-                memcpy(buf + data_pos + (size_t)written * 4, &v, 4);
-                memcpy(buf + data_pos + (size_t)counts[f] * 4 + (size_t)written * 4, &energy, 4);
-                written++;
-            }
-        }
-        data_pos += (size_t)counts[f] * 8;
+    size_t total = AT_binary_encoder_size(encoder);
+    AT_MemoryWriter memory = {.buf = malloc(total), .pos = 0, .capacity = total};
+    res = memory.buf ? AT_binary_encoder_write(encoder, write_to_memory, &memory) : AT_ERR_ALLOC_ERROR;
+    AT_binary_encoder_destroy(encoder);
+    AT_frame_index_destroy(window);
+    if (res != AT_OK)
+    {
+        free(memory.buf);
+        return res;
     }
 
-    *out_buf = buf;
+    *out_buf = memory.buf;
     *out_size = total;
-    free(counts);
     return AT_OK;
 }
 
-void AT_raytracer()
+AT_Result AT_simulation_to_pyramid(uint8_t **out_buf, size_t *out_size, AT_Simulation *simulation,
+                                   const AT_BinaryOptions *options, const AT_FrameFilter *filter)
 {
-    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
-    int opt = 1;
-    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-    sockaddr_in address = {
-        .sin_family = AF_INET,
-        .sin_addr.s_addr = inet_addr("127.0.0.1"),
-        .sin_port = htons(8080)};
-    bind(server_fd, (sockaddr *)&address, sizeof(address));
-    listen(server_fd, 4);
-    printf("Server running on 127.0.0.1:8080\n");
+    if (!out_buf || !out_size || !simulation)
+        return AT_ERR_INVALID_ARGUMENT;
 
-    while (1)
+    AT_FrameIndex *index = NULL;
+    AT_FramePyramid *pyramid = NULL;
+    AT_PyramidEncoder *encoder = NULL;
+    AT_Result res = AT_frame_index_create(&index, simulation, filter);
+    if (res == AT_OK)
+        res = AT_frame_pyramid_create(&pyramid, index, simulation, 0);
+    if (res == AT_OK)
+        res = AT_pyramid_encoder_create(&encoder, simulation, index, pyramid, options);
+
+    AT_MemoryWriter memory = {0};
+    if (res == AT_OK)
     {
-        sockaddr_in client_addr;
-        socklen_t client_len = sizeof(client_addr);
-        int client_fd = accept(server_fd, (sockaddr *)&client_addr, &client_len);
-        if (client_fd < 0)
-            continue;
+        size_t total = AT_pyramid_encoder_size(encoder);
+        memory = (AT_MemoryWriter){.buf = malloc(total), .pos = 0, .capacity = total};
+        res = memory.buf ? AT_pyramid_encoder_write(encoder, write_to_memory, &memory) : AT_ERR_ALLOC_ERROR;
+    }
+    AT_pyramid_encoder_destroy(encoder);
+    AT_frame_pyramid_destroy(pyramid);
+    AT_frame_index_destroy(index);
+    if (res != AT_OK)
+    {
+        free(memory.buf);
+        return res;
+    }
 
-        // request headers
-        char buffer[BUFFER_SIZE] = {0};
-        int total = 0, bytes = 0;
-        while (total < BUFFER_SIZE - 1)
-        {
-            bytes = read(client_fd, buffer + total, BUFFER_SIZE - 1 - total);
-            if (bytes <= 0)
-                break;
-            total += bytes;
-            if (strstr(buffer, "\r\n\r\n"))
-                break;
-        }
+    *out_buf = memory.buf;
+    *out_size = memory.pos;
+    return AT_OK;
+}
 
-        // CORS preflight options
-        if (strncmp(buffer, "OPTIONS /run", 12) == 0)
-        {
-            const char *resp =
-                "HTTP/1.1 204 No Content\r\n"
-                "Access-Control-Allow-Origin: http://localhost:5173\r\n"
-                "Access-Control-Allow-Methods: POST, OPTIONS\r\n"
-                "Access-Control-Allow-Headers: content-type\r\n"
-                "Access-Control-Max-Age: 86400\r\n"
-                "Content-Length: 0\r\n"
-                "\r\n";
-            write(client_fd, resp, strlen(resp));
-            close(client_fd);
-            continue;
-        }
+AT_Result AT_simulation_to_binary_temporal(uint8_t **out_buf, size_t *out_size, AT_Simulation *simulation,
+                                           uint32_t keyframe_interval, float delta_threshold)
+{
+    if (keyframe_interval == 0)
+        return AT_ERR_INVALID_ARGUMENT;
 
-        // POST
-        if (strncmp(buffer, "POST /run", 9) != 0)
-        {
-            const char *err =
-                "HTTP/1.1 404 Not Found\r\n"
-                "Access-Control-Allow-Origin: http://localhost:5173\r\n"
-                "Access-Control-Allow-Methods: POST, OPTIONS\r\n"
-                "Access-Control-Allow-Headers: content-type\r\n"
-                "Content-Length: 0\r\n\r\n";
-            write(client_fd, err, strlen(err));
-            close(client_fd);
-            continue;
-        }
+    AT_BinaryOptions options = {
+        .version = AT_ATRB_VERSION_2,
+        .compress_frames = true,
+        .keyframe_interval = keyframe_interval,
+        .delta_threshold = delta_threshold};
+    return AT_simulation_to_binary(out_buf, out_size, simulation, &options, NULL);
+}
 
-        // find body start
-        char *body_start = strstr(buffer, "\r\n\r\n");
-        if (!body_start)
-        {
-            const char *err =
-                "HTTP/1.1 400 Bad Request\r\n"
-                "Access-Control-Allow-Origin: http://localhost:5173\r\n"
-                "Access-Control-Allow-Methods: POST, OPTIONS\r\n"
-                "Access-Control-Allow-Headers: content-type\r\n"
-                "Content-Length: 0\r\n\r\n";
-            write(client_fd, err, strlen(err));
-            close(client_fd);
-            continue;
-        }
-        body_start += 4;
-
-        // parse the content-length
-        int content_length = 0;
-        char *cl = strstr(buffer, "Content-Length: ");
-        if (!cl)
-            cl = strstr(buffer, "content-length: ");
-        if (cl)
-            content_length = atoi(cl + 16);
-
-        int header_len = (int)(body_start - buffer);
-        int body_received = total - header_len;
-        while (body_received < content_length)
+// frameStart / frameEnd / regionMin / regionMax / downsample of a request body
+static void parse_frame_query(const cJSON *cjson, AT_FrameQuery *query)
+{
+    const cJSON *j = cJSON_GetObjectItemCaseSensitive(cjson, "frameStart");
+    if (cJSON_IsNumber(j) && j->valueint > 0)
+        query->frame_start = (uint32_t)j->valueint;
+    j = cJSON_GetObjectItemCaseSensitive(cjson, "frameEnd");
+    if (cJSON_IsNumber(j) && j->valueint > 0)
+        query->frame_end = (uint32_t)j->valueint;
+    j = cJSON_GetObjectItemCaseSensitive(cjson, "downsample");
+    if (cJSON_IsNumber(j) && j->valueint > 0)
+        query->downsample = (uint32_t)j->valueint;
+
+    const cJSON *region_min = cJSON_GetObjectItemCaseSensitive(cjson, "regionMin");
+    const cJSON *region_max = cJSON_GetObjectItemCaseSensitive(cjson, "regionMax");
+    if (cJSON_GetArraySize(region_min) == 3 && cJSON_GetArraySize(region_max) == 3)
+    {
+        for (int a = 0; a < 3; a++)
         {
-            int space = BUFFER_SIZE - 1 - header_len - body_received;
-            // body too large :/
-            if (space <= 0)
-                break;
-            bytes = read(client_fd, buffer + header_len + body_received, space);
-            if (bytes <= 0)
-                break;
-            body_received += bytes;
+            const cJSON *lo = cJSON_GetArrayItem(region_min, a);
+            const cJSON *hi = cJSON_GetArrayItem(region_max, a);
+            query->min[a] = cJSON_IsNumber(lo) && lo->valueint > 0 ? (uint32_t)lo->valueint : 0;
+            query->max[a] = cJSON_IsNumber(hi) && hi->valueint > 0 ? (uint32_t)hi->valueint : 0;
         }
-        buffer[header_len + body_received] = '\0';
+    }
+}
+
+static bool frame_query_is_empty(const AT_FrameQuery *query)
+{
+    return query->frame_start == 0 && query->frame_end == 0 && query->downsample <= 1 &&
+           query->max[0] == 0 && query->max[1] == 0 && query->max[2] == 0;
+}
+
+static void send_status(int client_fd, const char *status)
+{
+    char resp[256];
+    snprintf(resp, sizeof(resp),
+             "HTTP/1.1 %s\r\n"
+             AT_CORS_HEADERS
+             "Content-Length: 0\r\n\r\n",
+             status);
+    write(client_fd, resp, strlen(resp));
+}
 
-        // parse config from JSON
+// 503 for a request the server has no room for right now
+static void send_busy(int client_fd)
+{
+    const char *resp =
+        "HTTP/1.1 503 Service Unavailable\r\n"
+        AT_CORS_HEADERS
+        "Retry-After: 1\r\n"
+        "Content-Length: 0\r\n\r\n";
+    write(client_fd, resp, strlen(resp));
+}
 
-        char filename[256] = {0};
-        char filepath[512] = {0};
-        float voxel_size = 0.0f;
-        uint32_t num_rays = 0;
-        uint32_t fps = 0;
-        AT_MaterialType material = {0};
+// encodes the queried window of index first so Content-Length is known, then streams
+// it into the socket, the X-AT headers place the window on the full timeline and grid,
+// as an ATRP mip stream when pyramid is set
+static AT_Result send_result(int client_fd, AT_Simulation *sim, const AT_FrameIndex *index,
+                             const AT_FrameQuery *query, const AT_BinaryOptions *options, bool pyramid)
+{
+    AT_Result res = AT_OK;
+    AT_FrameIndex *window = NULL;
+    if (!frame_query_is_empty(query))
+        res = AT_frame_index_query(&window, index, sim, query);
+    if (res != AT_OK)
+        return res;
 
-        cJSON *cjson = cJSON_Parse(body_start);
-        cJSON *j;
+    const AT_FrameIndex *sent = window ? window : index;
+    AT_FramePyramid *levels = NULL;
+    AT_PyramidEncoder *pyramid_encoder = NULL;
+    AT_BinaryEncoder *encoder = NULL;
+    if (pyramid)
+    {
+        res = AT_frame_pyramid_create(&levels, sent, sim, 0);
+        if (res == AT_OK)
+            res = AT_pyramid_encoder_create(&pyramid_encoder, sim, sent, levels, options);
+    }
+    else
+    {
+        res = AT_binary_encoder_create(&encoder, sim, sent, options);
+    }
 
-        j = cJSON_GetObjectItemCaseSensitive(cjson, "fileName");
-        if (cJSON_IsString(j))
-        {
-            strncpy(filename, j->valuestring, sizeof(filename) - 1);
-            snprintf(filepath, sizeof(filepath), "../assets/glb/%s", filename);
-        }
-        j = cJSON_GetObjectItemCaseSensitive(cjson, "voxelSize");
-        if (cJSON_IsNumber(j))
+    if (res == AT_OK)
+    {
+        char header[512];
+        snprintf(header, sizeof(header),
+                 "HTTP/1.1 200 OK\r\n"
+                 "Content-Type: application/octet-stream\r\n"
+                 AT_CORS_HEADERS
+                 "Access-Control-Expose-Headers: X-AT-Frame-Start, X-AT-Total-Frames, X-AT-Grid\r\n"
+                 "X-AT-Frame-Start: %u\r\n"
+                 "X-AT-Total-Frames: %u\r\n"
+                 "X-AT-Grid: %u,%u,%u\r\n"
+                 "Content-Length: %zu\r\n"
+                 "\r\n",
+                 sent->frame_start, index->num_frames,
+                 sent->grid[0], sent->grid[1], sent->grid[2],
+                 pyramid ? AT_pyramid_encoder_size(pyramid_encoder) : AT_binary_encoder_size(encoder));
+        write(client_fd, header, strlen(header));
+
+        res = pyramid ? AT_pyramid_encoder_write(pyramid_encoder, AT_write_to_fd, &client_fd)
+                      : AT_binary_encoder_write(encoder, AT_write_to_fd, &client_fd);
+    }
+
+    AT_pyramid_encoder_destroy(pyramid_encoder);
+    AT_frame_pyramid_destroy(levels);
+    AT_binary_encoder_destroy(encoder);
+    AT_frame_index_destroy(window);
+    return res;
+}
+
+// one POST body, everything a worker needs to run and answer it
+typedef struct
+{
+    char filepath[512];
+    uint64_t model_id; // an uploaded model, see POST /models, used over filepath
+    bool has_model_id;
+    float voxel_size;
+    uint32_t num_rays;
+    uint32_t fps;
+    AT_DepositionMode deposition;
+    AT_Attenuation attenuation;
+    AT_MaterialType material;
+    AT_Source sources[AT_SERVER_MAX_SOURCES];
+    float gains[AT_SERVER_MAX_SOURCES]; // energy gain per source, with several each gets a channel
+    uint32_t num_sources;
+    AT_Receiver receivers[AT_SERVER_MAX_RECEIVERS];
+    uint32_t num_receivers;
+    uint32_t image_source_order; // reflections up to this order reach the receivers from image sources, 0 for none
+    float crossover_time;        // seconds the receivers switch to rays at, 0 for the estimate
+    AT_FrameFilter filter;
+    AT_FrameQuery query;
+    AT_BinaryOptions binary_options;
+    bool pyramid;
+    bool stream;            // /run only: ATRS windows sent as their frames become final
+    float time_limit;       // seconds the simulation may take, 0 for no limit
+    uint32_t batch_rays;    // rays per batch, a batched job serves a snapshot after each one
+    float target_error;     // relative error a batched run stops at early
+    AT_AABB error_region;   // world box target_error is measured over
+    bool has_error_region;
+    uint32_t replaces_job;  // POST /jobs only: id of a job the new one supersedes, 0 for none
+} AT_RunConfig;
+
+// {"x","y","z"} object into out, false unless all three are numbers
+static bool parse_vec3(const cJSON *object, AT_Vec3 *out)
+{
+    const cJSON *x = cJSON_GetObjectItemCaseSensitive(object, "x");
+    const cJSON *y = cJSON_GetObjectItemCaseSensitive(object, "y");
+    const cJSON *z = cJSON_GetObjectItemCaseSensitive(object, "z");
+    if (!cJSON_IsNumber(x) || !cJSON_IsNumber(y) || !cJSON_IsNumber(z))
+        return false;
+    *out = AT_vec3((float)x->valuedouble, (float)y->valuedouble, (float)z->valuedouble);
+    return true;
+}
+
+static void parse_run_config(const char *body, AT_RunConfig *config)
+{
+    *config = (AT_RunConfig){
+        .num_sources = 1,
+        .gains = {1.0f},
+        .deposition = AT_DEPOSITION_MIDPOINT,
+        .attenuation = AT_attenuation_default(),
+        .binary_options = {
+            .version = AT_ATRB_VERSION_2,
+            .compress_frames = true}};
+
+    cJSON *cjson = cJSON_Parse(body);
+    cJSON *j;
+
+    j = cJSON_GetObjectItemCaseSensitive(cjson, "fileName");
+    if (cJSON_IsString(j))
+    {
+        snprintf(config->filepath, sizeof(config->filepath), "../assets/glb/%s", j->valuestring);
+    }
+    j = cJSON_GetObjectItemCaseSensitive(cjson, "modelId");
+    if (cJSON_IsString(j))
+    {
+        char *end = NULL;
+        config->model_id = strtoull(j->valuestring, &end, 16);
+        config->has_model_id = end != j->valuestring && *end == '\0';
+    }
+    j = cJSON_GetObjectItemCaseSensitive(cjson, "voxelSize");
+    if (cJSON_IsNumber(j))
+    {
+        config->voxel_size = (float)j->valuedouble;
+    }
+    j = cJSON_GetObjectItemCaseSensitive(cjson, "numRays");
+    if (cJSON_IsNumber(j) && j->valuedouble >= 0.0)
+    {
+        config->num_rays = j->valuedouble < AT_SERVER_MAX_RAYS ? (uint32_t)j->valuedouble : AT_SERVER_MAX_RAYS;
+    }
+    j = cJSON_GetObjectItemCaseSensitive(cjson, "fps");
+    if (cJSON_IsNumber(j))
+    {
+        config->fps = (uint32_t)j->valueint;
+    }
+    j = cJSON_GetObjectItemCaseSensitive(cjson, "deposition");
+    if (cJSON_IsString(j) && strcmp(j->valuestring, "accurate") == 0)
+    {
+        config->deposition = AT_DEPOSITION_ACCURATE;
+    }
+
+    // attenuation
+    j = cJSON_GetObjectItemCaseSensitive(cjson, "attenuation");
+    if (cJSON_IsString(j))
+    {
+        const char *attenuation_str = j->valuestring;
+        if (strcmp(attenuation_str, "Spreading") == 0)
         {
-            voxel_size = (float)j->valuedouble;
+            config->attenuation.model = AT_ATTENUATION_SPREADING;
         }
-        j = cJSON_GetObjectItemCaseSensitive(cjson, "numRays");
-        if (cJSON_IsNumber(j))
+        else if (strcmp(attenuation_str, "Legacy") == 0)
         {
-            num_rays = (uint32_t)j->valueint;
+            config->attenuation.model = AT_ATTENUATION_LEGACY;
         }
-        j = cJSON_GetObjectItemCaseSensitive(cjson, "fps");
-        if (cJSON_IsNumber(j))
+        else if (strcmp(attenuation_str, "None") == 0)
         {
-            fps = (uint32_t)j->valueint;
+            config->attenuation.model = AT_ATTENUATION_NONE;
         }
-
-        // material
-        j = cJSON_GetObjectItemCaseSensitive(cjson, "material");
-        if (cJSON_IsString(j))
+        else
         {
-            const char *material_str = j->valuestring;
-            if (strcmp(material_str, "Plastic") == 0)
-            {
-                material = AT_MATERIAL_PLASTIC;
-            }
-            else if (strcmp(material_str, "Wood") == 0)
-            {
-                material = AT_MATERIAL_WOOD;
-            }
-            else if (strcmp(material_str, "Concrete") == 0)
-            {
-                material = AT_MATERIAL_CONCRETE;
-            }
-            else
-            {
-                material = AT_MATERIAL_CONCRETE;
-            }
+            config->attenuation.model = AT_ATTENUATION_AIR;
         }
+    }
+    j = cJSON_GetObjectItemCaseSensitive(cjson, "speedOfSound");
+    if (cJSON_IsNumber(j))
+    {
+        config->attenuation.speed_of_sound = (float)j->valuedouble;
+    }
+    j = cJSON_GetObjectItemCaseSensitive(cjson, "temperature");
+    if (cJSON_IsNumber(j))
+    {
+        config->attenuation.temperature = (float)j->valuedouble;
+    }
+    j = cJSON_GetObjectItemCaseSensitive(cjson, "humidity");
+    if (cJSON_IsNumber(j))
+    {
+        config->attenuation.humidity = (float)j->valuedouble;
+    }
 
-        AT_Source source = {0};
+    // result encoding
+    j = cJSON_GetObjectItemCaseSensitive(cjson, "quantizeEnergies");
+    if (cJSON_IsBool(j))
+    {
+        config->binary_options.quantize_energies = cJSON_IsTrue(j);
+    }
+    j = cJSON_GetObjectItemCaseSensitive(cjson, "compressResult");
+    if (cJSON_IsBool(j))
+    {
+        config->binary_options.compress_frames = cJSON_IsTrue(j);
+    }
+    j = cJSON_GetObjectItemCaseSensitive(cjson, "minEnergy");
+    if (cJSON_IsNumber(j))
+    {
+        config->filter.min_energy = (float)j->valuedouble;
+    }
+    j = cJSON_GetObjectItemCaseSensitive(cjson, "relativeThreshold");
+    if (cJSON_IsNumber(j))
+    {
+        config->filter.relative_threshold = (float)j->valuedouble;
+    }
+    j = cJSON_GetObjectItemCaseSensitive(cjson, "maxVoxelsPerFrame");
+    if (cJSON_IsNumber(j) && j->valueint > 0)
+    {
+        config->filter.max_voxels = (uint32_t)j->valueint;
+    }
+    j = cJSON_GetObjectItemCaseSensitive(cjson, "keyframeInterval");
+    if (cJSON_IsNumber(j) && j->valueint > 0)
+    {
+        config->binary_options.keyframe_interval = (uint32_t)j->valueint;
+    }
+    j = cJSON_GetObjectItemCaseSensitive(cjson, "deltaThreshold");
+    if (cJSON_IsNumber(j))
+    {
+        config->binary_options.delta_threshold = (float)j->valuedouble;
+    }
+    parse_frame_query(cjson, &config->query);
+    j = cJSON_GetObjectItemCaseSensitive(cjson, "pyramid");
+    if (cJSON_IsBool(j))
+    {
+        config->pyramid = cJSON_IsTrue(j);
+    }
+    j = cJSON_GetObjectItemCaseSensitive(cjson, "stream");
+    if (cJSON_IsBool(j))
+    {
+        config->stream = cJSON_IsTrue(j);
+    }
+    j = cJSON_GetObjectItemCaseSensitive(cjson, "timeLimit");
+    if (cJSON_IsNumber(j) && j->valuedouble > 0.0)
+    {
+        config->time_limit = (float)j->valuedouble;
+    }
+    j = cJSON_GetObjectItemCaseSensitive(cjson, "batchRays");
+    if (cJSON_IsNumber(j) && j->valueint > 0)
+    {
+        config->batch_rays = (uint32_t)j->valueint;
+    }
+    j = cJSON_GetObjectItemCaseSensitive(cjson, "targetError");
+    if (cJSON_IsNumber(j) && j->valuedouble > 0.0)
+    {
+        config->target_error = (float)j->valuedouble;
+    }
+    j = cJSON_GetObjectItemCaseSensitive(cjson, "errorRegion");
+    if (cJSON_IsObject(j))
+    {
+        config->has_error_region =
+            parse_vec3(cJSON_GetObjectItemCaseSensitive(j, "min"), &config->error_region.min) &&
+            parse_vec3(cJSON_GetObjectItemCaseSensitive(j, "max"), &config->error_region.max);
+    }
+    j = cJSON_GetObjectItemCaseSensitive(cjson, "replaces");
+    if (cJSON_IsNumber(j) && j->valueint > 0)
+    {
+        config->replaces_job = (uint32_t)j->valueint;
+    }
 
-        // source
-        cJSON *source_position = cJSON_GetObjectItemCaseSensitive(cjson, "selectedSource");
-        source_position = cJSON_GetObjectItemCaseSensitive(source_position, "position");
-        j = cJSON_GetObjectItemCaseSensitive(source_position, "x");
-        if (cJSON_IsNumber(j))
+    // material
+    j = cJSON_GetObjectItemCaseSensitive(cjson, "material");
+    if (cJSON_IsString(j))
+    {
+        const char *material_str = j->valuestring;
+        if (strcmp(material_str, "Plastic") == 0)
         {
-            source.position.x = j->valuedouble;
+            config->material = AT_MATERIAL_PLASTIC;
         }
-        j = cJSON_GetObjectItemCaseSensitive(source_position, "y");
-        if (cJSON_IsNumber(j))
+        else if (strcmp(material_str, "Wood") == 0)
         {
-            source.position.y = j->valuedouble;
+            config->material = AT_MATERIAL_WOOD;
         }
-        j = cJSON_GetObjectItemCaseSensitive(source_position, "z");
-        if (cJSON_IsNumber(j))
+        else if (strcmp(material_str, "Concrete") == 0)
         {
-            source.position.z = j->valuedouble;
+            config->material = AT_MATERIAL_CONCRETE;
         }
-
-        // direction
-        cJSON *source_direction = cJSON_GetObjectItemCaseSensitive(cjson, "selectedSource");
-        source_direction = cJSON_GetObjectItemCaseSensitive(source_direction, "direction");
-        j = cJSON_GetObjectItemCaseSensitive(source_direction, "x");
-        if (cJSON_IsNumber(j))
+        else
         {
-            source.direction.x = j->valuedouble;
+            config->material = AT_MATERIAL_CONCRETE;
         }
-        j = cJSON_GetObjectItemCaseSensitive(source_direction, "y");
-        if (cJSON_IsNumber(j))
+    }
+
+    // source
+    cJSON *source_position = cJSON_GetObjectItemCaseSensitive(cjson, "selectedSource");
+    source_position = cJSON_GetObjectItemCaseSensitive(source_position, "position");
+    j = cJSON_GetObjectItemCaseSensitive(source_position, "x");
+    if (cJSON_IsNumber(j))
+    {
+        config->sources[0].position.x = j->valuedouble;
+    }
+    j = cJSON_GetObjectItemCaseSensitive(source_position, "y");
+    if (cJSON_IsNumber(j))
+    {
+        config->sources[0].position.y = j->valuedouble;
+    }
+    j = cJSON_GetObjectItemCaseSensitive(source_position, "z");
+    if (cJSON_IsNumber(j))
+    {
+        config->sources[0].position.z = j->valuedouble;
+    }
+
+    // direction
+    cJSON *source_direction = cJSON_GetObjectItemCaseSensitive(cjson, "selectedSource");
+    source_direction = cJSON_GetObjectItemCaseSensitive(source_direction, "direction");
+    j = cJSON_GetObjectItemCaseSensitive(source_direction, "x");
+    if (cJSON_IsNumber(j))
+    {
+        config->sources[0].direction.x = j->valuedouble;
+    }
+    j = cJSON_GetObjectItemCaseSensitive(source_direction, "y");
+    if (cJSON_IsNumber(j))
+    {
+        config->sources[0].direction.y = j->valuedouble;
+    }
+    j = cJSON_GetObjectItemCaseSensitive(source_direction, "z");
+    if (cJSON_IsNumber(j))
+    {
+        config->sources[0].direction.z = j->valuedouble;
+    }
+
+    // "sources" [{"position","direction","gain"}] replaces selectedSource, a source
+    // missing its position or direction is skipped
+    const cJSON *sources = cJSON_GetObjectItemCaseSensitive(cjson, "sources");
+    if (cJSON_IsArray(sources) && cJSON_GetArraySize(sources) > 0)
+    {
+        config->num_sources = 0;
+        const cJSON *item;
+        cJSON_ArrayForEach(item, sources)
         {
-            source.direction.y = j->valuedouble;
+            if (config->num_sources == AT_SERVER_MAX_SOURCES)
+                break;
+            AT_Source source = {0};
+            if (!parse_vec3(cJSON_GetObjectItemCaseSensitive(item, "position"), &source.position) ||
+                !parse_vec3(cJSON_GetObjectItemCaseSensitive(item, "direction"), &source.direction))
+                continue;
+            config->sources[config->num_sources] = source;
+            j = cJSON_GetObjectItemCaseSensitive(item, "gain");
+            config->gains[config->num_sources] = cJSON_IsNumber(j) && j->valuedouble >= 0.0 ? (float)j->valuedouble : 1.0f;
+            config->num_sources++;
         }
-        j = cJSON_GetObjectItemCaseSensitive(source_direction, "z");
-        if (cJSON_IsNumber(j))
+        // none usable, selectedSource is still there to fall back on
+        if (config->num_sources == 0)
+            config->num_sources = 1;
+    }
+
+    // "receivers" [{"position","radius"}], listeners the run records an energy-time curve
+    // at, see GET /jobs/{id}/receivers, one missing its position or radius is skipped
+    const cJSON *receivers = cJSON_GetObjectItemCaseSensitive(cjson, "receivers");
+    if (cJSON_IsArray(receivers))
+    {
+        const cJSON *item;
+        cJSON_ArrayForEach(item, receivers)
         {
-            source.direction.z = j->valuedouble;
+            if (config->num_receivers == AT_SERVER_MAX_RECEIVERS)
+                break;
+            AT_Receiver receiver = {0};
+            j = cJSON_GetObjectItemCaseSensitive(item, "radius");
+            if (!parse_vec3(cJSON_GetObjectItemCaseSensitive(item, "position"), &receiver.position) ||
+                !cJSON_IsNumber(j) || !(j->valuedouble > 0.0))
+                continue;
+            receiver.radius = (float)j->valuedouble;
+            config->receivers[config->num_receivers++] = receiver;
         }
+    }
+
+    // "imageSourceOrder" and "crossoverTime", the receivers' early reflections from image sources
+    j = cJSON_GetObjectItemCaseSensitive(cjson, "imageSourceOrder");
+    if (cJSON_IsNumber(j) && j->valuedouble >= 0.0)
+    {
+        config->image_source_order = (uint32_t)j->valuedouble;
+    }
+    j = cJSON_GetObjectItemCaseSensitive(cjson, "crossoverTime");
+    if (cJSON_IsNumber(j) && j->valuedouble >= 0.0)
+    {
+        config->crossover_time = (float)j->valuedouble;
+    }
 
-        printf("SOURCE DIRECTION: %f, %f, %f\n", source.direction.x, source.direction.y, source.direction.z);
-        printf("SOURCE POSITION: %f, %f, %f\n", source.position.x, source.position.y, source.position.z);
+    cJSON_Delete(cjson);
+}
 
-        cJSON_Delete(cjson);
+// the last finished run, kept so POST /query can serve windows of it, shared by
+// every worker answering a query and only destroyed once the last one lets go
+typedef struct
+{
+    AT_Model *model;
+    AT_ModelCache *model_cache; // model is a reference into it rather than owned
+    AT_Scene *scene;
+    AT_Simulation *sim; // set under the server's job_lock, job status polls read it
+    AT_FrameIndex *index;
+    uint32_t refs;
+    AT_RunConfig config; // the run's, a later one differing only in the source can reuse it
+    bool reusable;       // the run finished, its simulation can be run again
+} AT_ServerResult;
 
-        // run raytracer
+typedef enum
+{
+    AT_JOB_QUEUED,
+    AT_JOB_RUNNING,
+    AT_JOB_DONE,
+    AT_JOB_FAILED,
+    AT_JOB_CANCELLED,
+} AT_JobState;
 
-        AT_Model *model = NULL;
-        AT_Result res = AT_model_create(&model, filepath);
-        AT_handle_result(res, "Error creating model\n");
+static const char *AT_JOB_STATE_NAMES[] = {"queued", "running", "done", "failed", "cancelled"};
+static const char *AT_PHASE_NAMES[] = {"idle", "tracing", "depositing", "done", "cancelled"};
 
-        AT_Source sources[1];
-        sources[0] = source;
+// the normalised bins of a batched job after one of its batches, encoded as the job
+// asked, a GET /jobs/{id}/result while it runs sends the latest one
+typedef struct
+{
+    uint32_t refs; // the job's plus one per response being sent, under job_lock
+    uint32_t rays_done;
+    uint32_t num_rays;
+    float relative_error; // negative after the first batch
+    uint32_t frame_start;
+    uint32_t num_frames;
+    uint32_t grid[3];
+    size_t size;
+    uint8_t *data;
+} AT_JobSnapshot;
 
-        AT_SceneConfig conf = {
-            .environment = model,
-            .material = material,
-            .num_sources = 1,
-            .sources = sources};
+// a POST /jobs run, polled through GET /jobs/{id}, fields other than refs, state /
+// error and snapshot are only written by the worker running it before it is done
+typedef struct
+{
+    uint32_t id;
+    uint32_t refs; // the job table's plus one per queued request, under job_lock
+    AT_JobState state;
+    const char *error; // status line of a failed job
+    AT_CancelToken *cancel; // DELETE /jobs/{id} or a job replacing it stops the run
+    AT_RunConfig config;
+    AT_ServerResult *result; // owned reference
+    AT_JobSnapshot *snapshot; // owned reference to the latest batch, under job_lock
+} AT_Job;
 
-        AT_Scene *scene = NULL;
-        res = AT_scene_create(&scene, &conf);
-        AT_handle_result(res, "Error creating scene\n");
+typedef struct
+{
+    AT_WorkerPool *pool;
+    AT_ModelCache *models;
+    pthread_mutex_t result_lock;
+    AT_ServerResult *result;
+    AT_ServerResult *spare; // the last finished result nobody holds any more, see take_spare
 
-        AT_Settings settings = {
-            .fps = fps,
-            .num_rays = num_rays,
-            .voxel_size = voxel_size};
+    pthread_mutex_t job_lock;
+    AT_Job *jobs[AT_SERVER_MAX_JOBS];
+    uint32_t next_job_id;
 
-        AT_Simulation *sim = NULL;
-        res = AT_simulation_create(&sim, scene, &settings);
-        AT_handle_result(res, "Error creating simulation\n");
+    // open client connections, only the acceptor touches the table, workers hand a
+    // connection back through returned and a byte on wake_fds[1] once they answered
+    struct AT_Connection *connections[AT_SERVER_MAX_CONNECTIONS];
+    uint32_t num_connections;
+    pthread_mutex_t connection_lock;
+    struct AT_Connection *returned;
+    int wake_fds[2];
+} AT_Server;
 
-        res = AT_simulation_run(sim);
-        AT_handle_result(res, "Error running simulation\n");
+// one kept alive client, requests on it are answered one after the other, a
+// pipelined request waits in http's buffer until the one before it is answered
+typedef struct AT_Connection
+{
+    int fd;
+    AT_HttpRequest http;
+    double last_active; // monotonic seconds of the last byte in or response out
+    bool busy;          // a worker is answering, the acceptor neither reads it nor answers on it
+    bool peeked;        // busy with a pipelined request waiting, no longer polled for a hang up
+    bool broken;        // the response broke off, the client can only tell by the close
+    AT_CancelToken *hangup; // cancelled once the client hangs up mid request, stops its run
+    struct AT_Connection *next_returned;
+} AT_Connection;
 
-        uint8_t *result_buf = NULL;
-        size_t result_size = 0;
-        res = AT_simulation_to_binary(&result_buf, &result_size, sim);
-        AT_handle_result(res, "Error converting simulation to binary\n");
+typedef enum
+{
+    AT_REQUEST_RUN,
+    AT_REQUEST_QUERY,
+    AT_REQUEST_JOB,
+    AT_REQUEST_JOB_RESULT,
+    AT_REQUEST_JOB_ERRORS,
+    AT_REQUEST_JOB_RECEIVERS,
+    AT_REQUEST_MODEL,
+} AT_RequestKind;
 
-        char header[256];
-        snprintf(header, sizeof(header),
-                 "HTTP/1.1 200 OK\r\n"
-                 "Content-Type: application/octet-stream\r\n"
-                 "Access-Control-Allow-Origin: http://localhost:5173\r\n"
-                 "Access-Control-Allow-Methods: POST, OPTIONS\r\n"
-                 "Access-Control-Allow-Headers: content-type\r\n"
-                 "Content-Length: %zu\r\n"
-                 "\r\n",
-                 result_size);
-        write(client_fd, header, strlen(header));
+// a request the acceptor read in full and handed to the pool, the worker owns it
+typedef struct
+{
+    AT_Server *server;
+    AT_Connection *connection; // NULL for a job, its client already got the 202
+    int client_fd;             // connection's, -1 for a job
+    AT_RequestKind kind;
+    AT_Job *job; // reference held for AT_REQUEST_JOB and the GET /jobs/{id}/... requests
+    uint32_t receiver; // AT_REQUEST_JOB_RECEIVERS: the curve asked for, UINT32_MAX for every receiver's metrics
+} AT_Request;
 
-        size_t sent = 0;
-        while (sent < result_size)
-        {
-            ssize_t w = write(client_fd, result_buf + sent, result_size - sent);
-            if (w <= 0)
-                break;
-            sent += (size_t)w;
-        }
-        close(client_fd);
+// the request's body, used in place in the connection's buffer, never copied out
+static char *request_body(const AT_Request *request)
+{
+    return AT_http_request_body(&request->connection->http);
+}
 
-        AT_simulation_destroy(sim);
-        AT_scene_destroy(scene);
+static void server_result_destroy(AT_ServerResult *result)
+{
+    AT_frame_index_destroy(result->index);
+    AT_simulation_destroy(result->sim);
+    AT_scene_destroy(result->scene);
+    if (result->model_cache)
+        AT_model_cache_release(result->model_cache, result->model);
+    else
+        AT_model_destroy(result->model);
+    free(result);
+}
+
+static AT_ServerResult *server_result_acquire(AT_Server *server)
+{
+    pthread_mutex_lock(&server->result_lock);
+    AT_ServerResult *result = server->result;
+    if (result)
+        result->refs++;
+    pthread_mutex_unlock(&server->result_lock);
+    return result;
+}
+
+static void server_result_retain(AT_Server *server, AT_ServerResult *result)
+{
+    pthread_mutex_lock(&server->result_lock);
+    result->refs++;
+    pthread_mutex_unlock(&server->result_lock);
+}
+
+// the last reference to a finished result parks it as the spare instead, so the next
+// run in the same room skips the model, BVH and voxel setup, see server_result_take_spare
+static void server_result_release(AT_Server *server, AT_ServerResult *result)
+{
+    pthread_mutex_lock(&server->result_lock);
+    const bool last = --result->refs == 0;
+    AT_ServerResult *destroyed = last ? result : NULL;
+    if (last && result->reusable)
+    {
+        // its token belongs to the finished run and is freed with it
+        AT_simulation_set_cancel(result->sim, NULL);
+        destroyed = server->spare;
+        server->spare = result;
     }
+    pthread_mutex_unlock(&server->result_lock);
+    if (destroyed)
+        server_result_destroy(destroyed);
+}
 
-    close(server_fd);
+// several sources, or one at another level, deposit into a channel each, so a run
+// changing only gains re-mixes them instead of tracing again
+static bool run_config_has_channels(const AT_RunConfig *config)
+{
+    return config->num_sources > 1 || config->gains[0] != 1.0f;
+}
+
+// whether a simulation built for a can run b by only moving its sources or changing their gains
+static bool run_config_same_simulation(const AT_RunConfig *a, const AT_RunConfig *b)
+{
+    if (a->num_sources != b->num_sources || run_config_has_channels(a) != run_config_has_channels(b))
+        return false;
+    if (a->num_receivers != b->num_receivers ||
+        memcmp(a->receivers, b->receivers, sizeof(AT_Receiver) * a->num_receivers) != 0)
+        return false;
+    if (a->has_model_id != b->has_model_id)
+        return false;
+    if (a->has_model_id ? a->model_id != b->model_id : strcmp(a->filepath, b->filepath) != 0)
+        return false;
+    if (a->has_error_region != b->has_error_region)
+        return false;
+    if (a->has_error_region && (memcmp(&a->error_region.min, &b->error_region.min, sizeof(AT_Vec3)) != 0 ||
+                                memcmp(&a->error_region.max, &b->error_region.max, sizeof(AT_Vec3)) != 0))
+        return false;
+    return a->voxel_size == b->voxel_size && a->num_rays == b->num_rays && a->fps == b->fps &&
+           a->deposition == b->deposition && a->material == b->material &&
+           memcmp(&a->attenuation, &b->attenuation, sizeof(AT_Attenuation)) == 0 &&
+           a->time_limit == b->time_limit && a->batch_rays == b->batch_rays &&
+           a->target_error == b->target_error && a->image_source_order == b->image_source_order &&
+           a->crossover_time == b->crossover_time;
+}
+
+// the spare for the caller to own when config only moves its sources, NULL otherwise,
+// the current result is never handed out, queries keep reading it
+static AT_ServerResult *server_result_take_spare(AT_Server *server, const AT_RunConfig *config)
+{
+    pthread_mutex_lock(&server->result_lock);
+    AT_ServerResult *spare = server->spare;
+    if (spare && run_config_same_simulation(&spare->config, config))
+        server->spare = NULL;
+    else
+        spare = NULL;
+    pthread_mutex_unlock(&server->result_lock);
+    return spare;
+}
+
+// result arrives holding the caller's reference, which passes to the server
+static void server_result_publish(AT_Server *server, AT_ServerResult *result)
+{
+    pthread_mutex_lock(&server->result_lock);
+    AT_ServerResult *previous = server->result;
+    server->result = result;
+    pthread_mutex_unlock(&server->result_lock);
+    if (previous)
+        server_result_release(server, previous);
+}
+
+static void job_snapshot_release(AT_Server *server, AT_JobSnapshot *snapshot)
+{
+    if (!snapshot)
+        return;
+    pthread_mutex_lock(&server->job_lock);
+    const bool last = --snapshot->refs == 0;
+    pthread_mutex_unlock(&server->job_lock);
+    if (last)
+    {
+        free(snapshot->data);
+        free(snapshot);
+    }
+}
+
+static void job_release(AT_Server *server, AT_Job *job)
+{
+    pthread_mutex_lock(&server->job_lock);
+    const bool last = --job->refs == 0;
+    pthread_mutex_unlock(&server->job_lock);
+    if (last)
+    {
+        job_snapshot_release(server, job->snapshot);
+        server_result_release(server, job->result);
+        AT_cancel_token_destroy(job->cancel);
+        free(job);
+    }
+}
+
+// job with that id and a reference for the caller, NULL when unknown or evicted
+static AT_Job *job_acquire(AT_Server *server, uint32_t id)
+{
+    AT_Job *job = NULL;
+    pthread_mutex_lock(&server->job_lock);
+    for (uint32_t i = 0; i < AT_SERVER_MAX_JOBS && !job; i++)
+    {
+        if (server->jobs[i] && server->jobs[i]->id == id)
+            job = server->jobs[i];
+    }
+    if (job)
+        job->refs++;
+    pthread_mutex_unlock(&server->job_lock);
+    return job;
+}
+
+// new queued job in the table holding one reference for the caller, a full table
+// drops the oldest finished job, NULL when every slot is queued or running
+static AT_Job *job_create(AT_Server *server)
+{
+    AT_Job *job = calloc(1, sizeof(AT_Job));
+    AT_ServerResult *result = calloc(1, sizeof(AT_ServerResult));
+    AT_CancelToken *cancel = NULL;
+    if (!job || !result || AT_cancel_token_create(&cancel) != AT_OK)
+    {
+        free(job);
+        free(result);
+        return NULL;
+    }
+    result->refs = 1;
+    *job = (AT_Job){.refs = 2, .state = AT_JOB_QUEUED, .cancel = cancel, .result = result};
+
+    AT_Job *evicted = NULL;
+    pthread_mutex_lock(&server->job_lock);
+    int slot = -1;
+    for (int i = 0; i < AT_SERVER_MAX_JOBS; i++)
+    {
+        const AT_Job *other = server->jobs[i];
+        if (!other)
+        {
+            slot = i;
+            break;
+        }
+        const bool finished = other->state >= AT_JOB_DONE;
+        if (finished && (slot < 0 || other->id < server->jobs[slot]->id))
+            slot = i;
+    }
+    if (slot >= 0)
+    {
+        evicted = server->jobs[slot];
+        job->id = ++server->next_job_id;
+        server->jobs[slot] = job;
+    }
+    pthread_mutex_unlock(&server->job_lock);
+
+    if (slot < 0)
+    {
+        server_result_destroy(result);
+        AT_cancel_token_destroy(cancel);
+        free(job);
+        return NULL;
+    }
+    if (evicted)
+        job_release(server, evicted);
+    return job;
+}
+
+// takes the job out of the table again, for a job that never made it into the pool
+static void job_remove(AT_Server *server, AT_Job *job)
+{
+    pthread_mutex_lock(&server->job_lock);
+    for (int i = 0; i < AT_SERVER_MAX_JOBS; i++)
+    {
+        if (server->jobs[i] == job)
+            server->jobs[i] = NULL;
+    }
+    pthread_mutex_unlock(&server->job_lock);
+    job_release(server, job);
+}
+
+// the job with that id still queued or running gets cancelled, returns its state before
+static bool job_cancel(AT_Server *server, uint32_t id, AT_JobState *out_state)
+{
+    bool found = false;
+    pthread_mutex_lock(&server->job_lock);
+    for (uint32_t i = 0; i < AT_SERVER_MAX_JOBS && !found; i++)
+    {
+        AT_Job *job = server->jobs[i];
+        if (!job || job->id != id)
+            continue;
+        found = true;
+        *out_state = job->state;
+        if (job->state < AT_JOB_DONE)
+            AT_cancel_token_cancel(job->cancel);
+    }
+    pthread_mutex_unlock(&server->job_lock);
+    return found;
+}
+
+static const char *status_for_result(AT_Result res)
+{
+    // only a time limit gets here, a cancelled run has nobody left to answer;
+    // 504 as gRPC maps DEADLINE_EXCEEDED
+    if (res == AT_ERR_CANCELLED)
+        return "504 Gateway Timeout";
+    return res == AT_ERR_INVALID_ARGUMENT ? "400 Bad Request" : "500 Internal Server Error";
+}
+
+static void send_json(int client_fd, const char *status, const char *extra_headers, const char *json)
+{
+    char header[512];
+    snprintf(header, sizeof(header),
+             "HTTP/1.1 %s\r\n"
+             "Content-Type: application/json\r\n"
+             AT_CORS_HEADERS
+             "%s"
+             "Content-Length: %zu\r\n"
+             "\r\n",
+             status, extra_headers, strlen(json));
+    write(client_fd, header, strlen(header));
+    write(client_fd, json, strlen(json));
+}
+
+// GET /jobs/{id}, answered on the acceptor: only a snapshot of the job's counters
+static void send_job_status(int client_fd, AT_Server *server, uint32_t id)
+{
+    char json[512];
+    bool found = false;
+
+    pthread_mutex_lock(&server->job_lock);
+    for (uint32_t i = 0; i < AT_SERVER_MAX_JOBS && !found; i++)
+    {
+        const AT_Job *job = server->jobs[i];
+        if (!job || job->id != id)
+            continue;
+        found = true;
+
+        // the job's reference keeps the simulation alive while the lock is held
+        const AT_SimulationProgress progress = AT_simulation_progress(job->result->sim);
+        int n = snprintf(json, sizeof(json),
+                         "{\"id\":%u,\"state\":\"%s\",\"phase\":\"%s\",\"raysTotal\":%u,"
+                         "\"raysTraced\":%u,\"raysDeposited\":%u,\"bounces\":%llu",
+                         job->id, AT_JOB_STATE_NAMES[job->state], AT_PHASE_NAMES[progress.phase],
+                         progress.rays_total, progress.rays_traced, progress.rays_deposited,
+                         (unsigned long long)progress.bounces);
+        if (job->snapshot && job->snapshot->relative_error >= 0.0f)
+            n += snprintf(json + n, sizeof(json) - n, ",\"relativeError\":%g", job->snapshot->relative_error);
+        if (job->state == AT_JOB_FAILED)
+            snprintf(json + n, sizeof(json) - n, ",\"error\":\"%s\"}", job->error);
+        else
+            snprintf(json + n, sizeof(json) - n, "}");
+    }
+    pthread_mutex_unlock(&server->job_lock);
+
+    if (found)
+        send_json(client_fd, "200 OK", "", json);
+    else
+        send_status(client_fd, "404 Not Found");
+}
+
+// builds, or takes over from the spare, and runs the simulation described by config
+// into result, which keeps whatever was created on failure for the caller to destroy, on_frames runs it
+// progressively, see AT_simulation_run_progressive, a config with batches is run
+// with AT_simulation_run_batched, calling on_batch
+static AT_Result simulate(AT_Server *server, AT_ServerResult *result, const AT_RunConfig *config,
+                          AT_CancelToken *cancel, AT_FramesReadyFunc on_frames, AT_BatchReadyFunc on_batch,
+                          void *user_data)
+{
+    // cancelled while it waited in the queue
+    if (AT_cancel_token_is_cancelled(cancel))
+        return AT_ERR_CANCELLED;
+
+    AT_Result res = AT_OK;
+    AT_Simulation *sim = NULL;
+    AT_ServerResult *spare = server_result_take_spare(server, config);
+    if (spare)
+    {
+        // dragging a source around, the room, its BVH and the voxel memory stay,
+        // only the moved sources' rays are traced again
+        AT_frame_index_destroy(spare->index);
+        result->model = spare->model;
+        result->model_cache = spare->model_cache;
+        result->scene = spare->scene;
+        sim = spare->sim;
+        AT_simulation_set_cancel(sim, cancel);
+        for (uint32_t s = 0; s < config->num_sources && res == AT_OK; s++)
+        {
+            const AT_Source *was = &spare->config.sources[s], *now = &config->sources[s];
+            if (memcmp(&was->position, &now->position, sizeof(AT_Vec3)) != 0 ||
+                memcmp(&was->direction, &now->direction, sizeof(AT_Vec3)) != 0)
+                res = AT_simulation_set_source(sim, s, now);
+        }
+        free(spare);
+    }
+    else if (config->has_model_id)
+    {
+        result->model = AT_model_cache_acquire(server->models, config->model_id);
+        result->model_cache = result->model ? server->models : NULL;
+        // never uploaded or evicted since, the client has to send it again
+        res = result->model ? AT_OK : AT_ERR_INVALID_ARGUMENT;
+        AT_handle_result(res, "Error finding uploaded model\n");
+    }
+    else
+    {
+        res = AT_model_create(&result->model, config->filepath);
+        AT_handle_result(res, "Error creating model\n");
+    }
+
+    AT_SceneConfig conf = {
+        .environment = result->model,
+        .material = config->material,
+        .num_sources = config->num_sources,
+        .sources = config->sources};
+
+    if (res == AT_OK && !result->scene)
+    {
+        res = AT_scene_create(&result->scene, &conf);
+        AT_handle_result(res, "Error creating scene\n");
+    }
+
+    AT_Settings settings = {
+        .fps = config->fps,
+        .num_rays = config->num_rays,
+        .voxel_size = config->voxel_size,
+        .deposition = config->deposition,
+        .attenuation = &config->attenuation,
+        .cancel = cancel,
+        .time_limit = config->time_limit,
+        .batch_rays = config->batch_rays,
+        .target_error = config->target_error,
+        .error_region = config->has_error_region ? &config->error_region : NULL,
+        .source_channels = run_config_has_channels(config),
+        .receivers = config->receivers,
+        .num_receivers = config->num_receivers,
+        .image_source_order = config->image_source_order,
+        .crossover_time = config->crossover_time};
+
+    if (res == AT_OK && !sim)
+    {
+        res = AT_simulation_create(&sim, result->scene, &settings);
+        AT_handle_result(res, "Error creating simulation\n");
+    }
+    // the run mixes its channels with these
+    if (res == AT_OK && run_config_has_channels(config))
+        res = AT_simulation_mix_sources(sim, config->gains);
+    // from here on job status polls can read its progress
+    pthread_mutex_lock(&server->job_lock);
+    result->sim = sim;
+    pthread_mutex_unlock(&server->job_lock);
+
+    if (res == AT_OK)
+    {
+        // a stream with batches gets AT_ERR_INVALID_ARGUMENT, frames are only final after the last one
+        if (config->batch_rays > 0 && !on_frames)
+            res = AT_simulation_run_batched(result->sim, on_batch, user_data);
+        else
+            res = AT_simulation_run_progressive(result->sim, on_frames, user_data);
+        if (res != AT_ERR_CANCELLED)
+            AT_handle_result(res, "Error running simulation\n");
+    }
+    if (res == AT_OK)
+    {
+        res = AT_frame_index_create(&result->index, result->sim, &config->filter);
+        AT_handle_result(res, "Error indexing simulation result\n");
+    }
+    result->config = *config;
+    result->reusable = res == AT_OK;
+    return res;
+}
+
+static void handle_query(AT_Request *request, const AT_RunConfig *config)
+{
+    AT_ServerResult *result = server_result_acquire(request->server);
+    if (!result)
+    {
+        send_status(request->client_fd, "404 Not Found");
+        return;
+    }
+
+    AT_Result res = send_result(request->client_fd, result->sim, result->index, &config->query,
+                                &config->binary_options, config->pyramid);
+    if (res == AT_ERR_INVALID_ARGUMENT)
+        send_status(request->client_fd, "400 Bad Request");
+    else if (res != AT_OK)
+    {
+        fprintf(stderr, "Error streaming query result\n");
+        request->connection->broken = true;
+    }
+    server_result_release(request->server, result);
+}
+
+// a /run answered while it is still simulating, AT_FramesReadyFunc state
+typedef struct
+{
+    AT_ChunkedWriter out; // out.fd is the client
+    AT_ServerResult *result;
+    const AT_RunConfig *config;
+    uint32_t frames_sent;
+    bool started; // response headers are out, errors can no longer become a status
+} AT_FrameStream;
+
+// sends the frames that just became final as one ATRS window in its own chunk
+static AT_Result stream_frames(void *user_data, uint32_t num_final_frames)
+{
+    AT_FrameStream *stream = user_data;
+    if (num_final_frames <= stream->frames_sent)
+        return AT_OK;
+
+    AT_Simulation *sim = stream->result->sim;
+    AT_FrameIndex *window = NULL;
+    AT_Result res = AT_frame_index_create_range(&window, sim, &stream->config->filter,
+                                                stream->frames_sent, num_final_frames);
+    // the request's region / downsample cut every window, its frame range does not apply
+    AT_FrameQuery query = stream->config->query;
+    query.frame_start = query.frame_end = 0;
+    if (res == AT_OK && !frame_query_is_empty(&query))
+    {
+        AT_FrameIndex *cut = NULL;
+        res = AT_frame_index_query(&cut, window, sim, &query);
+        AT_frame_index_destroy(window);
+        window = cut;
+    }
+
+    if (res == AT_OK && !stream->started)
+    {
+        char header[512];
+        snprintf(header, sizeof(header),
+                 "HTTP/1.1 200 OK\r\n"
+                 "Content-Type: application/octet-stream\r\n"
+                 AT_CORS_HEADERS
+                 "Access-Control-Expose-Headers: X-AT-Grid\r\n"
+                 "X-AT-Grid: %u,%u,%u\r\n"
+                 "Transfer-Encoding: chunked\r\n"
+                 "\r\n",
+                 window->grid[0], window->grid[1], window->grid[2]);
+        res = AT_write_to_fd(&stream->out.fd, header, strlen(header));
+        if (res == AT_OK)
+            res = AT_frame_stream_write_header(write_chunked, &stream->out, window->grid);
+        stream->started = true;
+    }
+    if (res == AT_OK)
+        res = AT_frame_stream_write_window(write_chunked, &stream->out, sim, window,
+                                           &stream->config->binary_options);
+    // the window goes out now rather than when the chunk buffer happens to fill
+    if (res == AT_OK)
+        res = flush_chunk(&stream->out);
+    AT_frame_index_destroy(window);
+
+    stream->frames_sent = num_final_frames;
+    return res;
+}
+
+static void handle_run(AT_Request *request, const AT_RunConfig *config)
+{
+    AT_ServerResult *result = calloc(1, sizeof(AT_ServerResult));
+    AT_FrameStream *stream = config->stream ? calloc(1, sizeof(AT_FrameStream)) : NULL;
+    if (!result || (config->stream && !stream))
+    {
+        free(result);
+        free(stream);
+        send_status(request->client_fd, "500 Internal Server Error");
+        return;
+    }
+    result->refs = 1;
+    if (stream)
+    {
+        stream->out.fd = request->client_fd;
+        stream->result = result;
+        stream->config = config;
+    }
+
+    AT_CancelToken *hangup = request->connection->hangup;
+    AT_Result res = simulate(request->server, result, config, hangup, stream ? stream_frames : NULL, NULL, stream);
+    if (res != AT_OK)
+    {
+        // a stream that already started is cut short, the missing end and the close tell the
+        // client, one that hung up gets nothing at all
+        if ((!stream || !stream->started) && !AT_cancel_token_is_cancelled(hangup))
+            send_status(request->client_fd, status_for_result(res));
+        else
+            request->connection->broken = true;
+        server_result_destroy(result);
+        free(stream);
+        return;
+    }
+
+    if (stream)
+    {
+        res = AT_frame_stream_write_end(write_chunked, &stream->out, stream->frames_sent);
+        if (res == AT_OK)
+            res = finish_chunked(&stream->out);
+        free(stream);
+    }
+    else
+    {
+        res = send_result(request->client_fd, result->sim, result->index, &config->query,
+                          &config->binary_options, config->pyramid);
+        if (res == AT_ERR_INVALID_ARGUMENT)
+            send_status(request->client_fd, "400 Bad Request");
+    }
+    if (res != AT_OK && res != AT_ERR_INVALID_ARGUMENT)
+    {
+        fprintf(stderr, "Error streaming simulation result\n");
+        request->connection->broken = true;
+    }
+
+    server_result_publish(request->server, result);
+}
+
+// AT_BatchReadyFunc of a batched job, encodes the scaled bins as the job's latest snapshot
+static AT_Result snapshot_job(void *user_data, const AT_BatchProgress *batch)
+{
+    AT_Request *request = user_data;
+    AT_Job *job = request->job;
+    AT_Simulation *sim = job->result->sim;
+    const AT_RunConfig *config = &job->config;
+
+    // the filter's floor applies to the normalised energies
+    AT_FrameFilter filter = config->filter;
+    filter.min_energy /= batch->scale;
+
+    // a query carries its own energies, so the scaling never touches the bins
+    AT_FrameIndex *index = NULL, *window = NULL;
+    AT_BinaryEncoder *encoder = NULL;
+    AT_JobSnapshot *snapshot = calloc(1, sizeof(AT_JobSnapshot));
+    AT_Result res = snapshot ? AT_frame_index_create(&index, sim, &filter) : AT_ERR_ALLOC_ERROR;
+    if (res == AT_OK)
+        res = AT_frame_index_query(&window, index, sim, &config->query);
+    if (res == AT_OK)
+    {
+        for (uint32_t i = 0; i < window->num_entries; i++)
+            window->energies[i] *= batch->scale;
+        res = AT_binary_encoder_create(&encoder, sim, window, &config->binary_options);
+    }
+    if (res == AT_OK)
+    {
+        *snapshot = (AT_JobSnapshot){
+            .refs = 1,
+            .rays_done = batch->rays_done,
+            .num_rays = batch->num_rays,
+            .relative_error = batch->relative_error,
+            .frame_start = window->frame_start,
+            .num_frames = index->num_frames,
+            .grid = {window->grid[0], window->grid[1], window->grid[2]},
+            .size = AT_binary_encoder_size(encoder)};
+        AT_MemoryWriter memory = {.buf = malloc(snapshot->size), .capacity = snapshot->size};
+        res = memory.buf ? AT_binary_encoder_write(encoder, write_to_memory, &memory) : AT_ERR_ALLOC_ERROR;
+        snapshot->data = memory.buf;
+    }
+    AT_binary_encoder_destroy(encoder);
+    AT_frame_index_destroy(window);
+    AT_frame_index_destroy(index);
+    if (res != AT_OK)
+    {
+        // a lost snapshot is not worth failing the run over, the next batch brings another
+        if (snapshot)
+            free(snapshot->data);
+        free(snapshot);
+        return AT_OK;
+    }
+
+    pthread_mutex_lock(&request->server->job_lock);
+    AT_JobSnapshot *previous = job->snapshot;
+    job->snapshot = snapshot;
+    pthread_mutex_unlock(&request->server->job_lock);
+    job_snapshot_release(request->server, previous);
+    return AT_OK;
+}
+
+static void handle_job(AT_Request *request)
+{
+    AT_Server *server = request->server;
+    AT_Job *job = request->job;
+
+    pthread_mutex_lock(&server->job_lock);
+    job->state = AT_JOB_RUNNING;
+    pthread_mutex_unlock(&server->job_lock);
+
+    AT_Result res = simulate(server, job->result, &job->config, job->cancel, NULL, snapshot_job, request);
+
+    // a cancelled token means a client asked for it, otherwise the time limit hit
+    pthread_mutex_lock(&server->job_lock);
+    if (res == AT_OK)
+        job->state = AT_JOB_DONE;
+    else if (AT_cancel_token_is_cancelled(job->cancel))
+        job->state = AT_JOB_CANCELLED;
+    else
+        job->state = AT_JOB_FAILED;
+    job->error = job->state == AT_JOB_FAILED ? status_for_result(res) : NULL;
+    pthread_mutex_unlock(&server->job_lock);
+
+    // a finished job is also the last run /query serves from
+    if (res == AT_OK)
+    {
+        server_result_retain(server, job->result);
+        server_result_publish(server, job->result);
+    }
+}
+
+// a batched job's snapshot, the X-AT-Rays headers tell how far along it is
+static void send_snapshot(int client_fd, const AT_JobSnapshot *snapshot)
+{
+    char header[768];
+    snprintf(header, sizeof(header),
+             "HTTP/1.1 200 OK\r\n"
+             "Content-Type: application/octet-stream\r\n"
+             AT_CORS_HEADERS
+             "Access-Control-Expose-Headers: X-AT-Frame-Start, X-AT-Total-Frames, X-AT-Grid, "
+             "X-AT-Rays-Done, X-AT-Rays-Total, X-AT-Relative-Error\r\n"
+             "X-AT-Frame-Start: %u\r\n"
+             "X-AT-Total-Frames: %u\r\n"
+             "X-AT-Grid: %u,%u,%u\r\n"
+             "X-AT-Rays-Done: %u\r\n"
+             "X-AT-Rays-Total: %u\r\n"
+             "X-AT-Relative-Error: %g\r\n"
+             "Content-Length: %zu\r\n"
+             "\r\n",
+             snapshot->frame_start, snapshot->num_frames,
+             snapshot->grid[0], snapshot->grid[1], snapshot->grid[2],
+             snapshot->rays_done, snapshot->num_rays, snapshot->relative_error, snapshot->size);
+    write(client_fd, header, strlen(header));
+    AT_write_to_fd(&client_fd, snapshot->data, snapshot->size);
+}
+
+// GET /jobs/{id}/result, encoded with the options the job was posted with
+static void handle_job_result(AT_Request *request)
+{
+    AT_Server *server = request->server;
+    AT_Job *job = request->job;
+
+    pthread_mutex_lock(&server->job_lock);
+    const AT_JobState state = job->state;
+    const char *error = job->error;
+    AT_JobSnapshot *snapshot = state < AT_JOB_DONE ? job->snapshot : NULL;
+    if (snapshot)
+        snapshot->refs++;
+    pthread_mutex_unlock(&server->job_lock);
+
+    // a batched job still running answers with its latest batch
+    if (snapshot)
+    {
+        send_snapshot(request->client_fd, snapshot);
+        job_snapshot_release(server, snapshot);
+        return;
+    }
+
+    if (state == AT_JOB_FAILED)
+    {
+        send_status(request->client_fd, error);
+        return;
+    }
+    if (state == AT_JOB_CANCELLED)
+    {
+        send_status(request->client_fd, "410 Gone");
+        return;
+    }
+    if (state != AT_JOB_DONE)
+    {
+        send_status(request->client_fd, "409 Conflict");
+        return;
+    }
+
+    const AT_RunConfig *config = &job->config;
+    AT_Result res = send_result(request->client_fd, job->result->sim, job->result->index, &config->query,
+                                &config->binary_options, config->pyramid);
+    if (res == AT_ERR_INVALID_ARGUMENT)
+        send_status(request->client_fd, "400 Bad Request");
+    else if (res != AT_OK)
+    {
+        fprintf(stderr, "Error streaming job result\n");
+        request->connection->broken = true;
+    }
+}
+
+// GET /jobs/{id}/errors, AT_simulation_voxel_errors of a finished batched job as
+// little endian float32 per voxel, the grid in X-AT-Grid
+static void handle_job_errors(AT_Request *request)
+{
+    AT_Server *server = request->server;
+    AT_Job *job = request->job;
+
+    pthread_mutex_lock(&server->job_lock);
+    const AT_JobState state = job->state;
+    pthread_mutex_unlock(&server->job_lock);
+
+    if (state != AT_JOB_DONE || job->config.batch_rays == 0)
+    {
+        send_status(request->client_fd, state == AT_JOB_DONE ? "404 Not Found" : "409 Conflict");
+        return;
+    }
+
+    AT_Simulation *sim = job->result->sim;
+    float *errors = malloc(sizeof(float) * sim->num_voxels);
+    if (!errors || AT_simulation_voxel_errors(sim, errors) != AT_OK)
+    {
+        free(errors);
+        send_status(request->client_fd, "500 Internal Server Error");
+        return;
+    }
+
+    const size_t size = sizeof(float) * sim->num_voxels;
+    char header[512];
+    snprintf(header, sizeof(header),
+             "HTTP/1.1 200 OK\r\n"
+             "Content-Type: application/octet-stream\r\n"
+             AT_CORS_HEADERS
+             "Access-Control-Expose-Headers: X-AT-Grid\r\n"
+             "X-AT-Grid: %u,%u,%u\r\n"
+             "Content-Length: %zu\r\n"
+             "\r\n",
+             (uint32_t)sim->grid_dimensions.x, (uint32_t)sim->grid_dimensions.y, (uint32_t)sim->grid_dimensions.z,
+             size);
+    write(request->client_fd, header, strlen(header));
+    if (AT_write_to_fd(&request->client_fd, errors, size) != AT_OK)
+        request->connection->broken = true;
+    free(errors);
+}
+
+// GET /jobs/{id}/receivers, RT60, EDT and C80 per band of every receiver the job was
+// posted with, NaN as null, GET /jobs/{id}/receivers/{n} receiver n's energy-time curve
+// as little endian float32, num_bins * AT_NUM_BANDS energies then num_bins * 3 directions
+static void handle_job_receivers(AT_Request *request)
+{
+    AT_Server *server = request->server;
+    AT_Job *job = request->job;
+
+    pthread_mutex_lock(&server->job_lock);
+    const AT_JobState state = job->state;
+    pthread_mutex_unlock(&server->job_lock);
+
+    const uint32_t receiver = request->receiver;
+    if (state != AT_JOB_DONE || job->config.num_receivers == 0 ||
+        (receiver != UINT32_MAX && receiver >= job->config.num_receivers))
+    {
+        send_status(request->client_fd, state == AT_JOB_DONE ? "404 Not Found" : "409 Conflict");
+        return;
+    }
+
+    const AT_Simulation *sim = job->result->sim;
+    AT_EnergyTimeCurve etc;
+    if (receiver != UINT32_MAX)
+    {
+        if (AT_simulation_receiver_etc(sim, receiver, &etc) != AT_OK)
+        {
+            send_status(request->client_fd, "500 Internal Server Error");
+            return;
+        }
+        const size_t energy_size = sizeof(float) * etc.num_bins * AT_NUM_BANDS;
+        const size_t direction_size = sizeof(float) * etc.num_bins * 3;
+        char header[512];
+        snprintf(header, sizeof(header),
+                 "HTTP/1.1 200 OK\r\n"
+                 "Content-Type: application/octet-stream\r\n"
+                 AT_CORS_HEADERS
+                 "Access-Control-Expose-Headers: X-AT-Bins, X-AT-Bin-Width\r\n"
+                 "X-AT-Bins: %u\r\n"
+                 "X-AT-Bin-Width: %g\r\n"
+                 "Content-Length: %zu\r\n"
+                 "\r\n",
+                 etc.num_bins, etc.bin_width, energy_size + direction_size);
+        write(request->client_fd, header, strlen(header));
+        if (AT_write_to_fd(&request->client_fd, etc.energy, energy_size) != AT_OK ||
+            AT_write_to_fd(&request->client_fd, etc.direction, direction_size) != AT_OK)
+            request->connection->broken = true;
+        return;
+    }
+
+    AT_Result res = AT_OK;
+    cJSON *json = cJSON_CreateObject();
+    cJSON *list = cJSON_AddArrayToObject(json, "receivers");
+    for (uint32_t r = 0; r < job->config.num_receivers && list && res == AT_OK; r++)
+    {
+        AT_RoomAcoustics acoustics;
+        res = AT_simulation_receiver_etc(sim, r, &etc);
+        if (res == AT_OK)
+            res = AT_etc_room_acoustics(&etc, &acoustics);
+        if (res != AT_OK)
+            break;
+        cJSON *item = cJSON_CreateObject();
+        cJSON_AddItemToArray(list, item);
+        cJSON_AddItemToObject(item, "rt60", cJSON_CreateFloatArray(acoustics.rt60, AT_NUM_BANDS));
+        cJSON_AddItemToObject(item, "edt", cJSON_CreateFloatArray(acoustics.edt, AT_NUM_BANDS));
+        cJSON_AddItemToObject(item, "c80", cJSON_CreateFloatArray(acoustics.c80, AT_NUM_BANDS));
+    }
+    if (res == AT_OK && json)
+    {
+        cJSON_AddNumberToObject(json, "binWidth", etc.bin_width);
+        cJSON_AddNumberToObject(json, "numBins", etc.num_bins);
+    }
+    char *text = res == AT_OK && list ? cJSON_PrintUnformatted(json) : NULL;
+    if (text)
+        send_json(request->client_fd, "200 OK", "", text);
+    else
+        send_status(request->client_fd, "500 Internal Server Error");
+    cJSON_free(text);
+    cJSON_Delete(json);
+}
+
+// POST /models, the body is the GLB itself, parsed straight out of the request buffer
+static void handle_model_upload(AT_Request *request)
+{
+    uint64_t key = 0;
+    bool cached = false;
+    AT_Result res = AT_model_cache_insert(request->server->models, request_body(request),
+                                          AT_http_request_body_size(&request->connection->http), &key,
+                                          &cached);
+    if (res == AT_ERR_ALLOC_ERROR)
+    {
+        // every cached model is still in use by a run
+        send_busy(request->client_fd);
+        return;
+    }
+    if (res != AT_OK)
+    {
+        send_status(request->client_fd, status_for_result(res));
+        return;
+    }
+
+    char json[64];
+    snprintf(json, sizeof(json), "{\"modelId\":\"%016llx\",\"cached\":%s}", (unsigned long long)key,
+             cached ? "true" : "false");
+    send_json(request->client_fd, cached ? "200 OK" : "201 Created", "", json);
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// hands a connection a worker answered on back to the acceptor
+static void connection_return(AT_Server *server, AT_Connection *connection)
+{
+    pthread_mutex_lock(&server->connection_lock);
+    connection->next_returned = server->returned;
+    server->returned = connection;
+    pthread_mutex_unlock(&server->connection_lock);
+    write(server->wake_fds[1], "", 1);
+}
+
+// AT_TaskFunc of the server's pool
+static void run_request(void *task)
+{
+    AT_Request *request = task;
+    AT_RunConfig config;
+
+    switch (request->kind)
+    {
+    case AT_REQUEST_RUN:
+        parse_run_config(request_body(request), &config);
+        handle_run(request, &config);
+        break;
+    case AT_REQUEST_QUERY:
+        parse_run_config(request_body(request), &config);
+        handle_query(request, &config);
+        break;
+    case AT_REQUEST_JOB:
+        handle_job(request);
+        break;
+    case AT_REQUEST_JOB_RESULT:
+        handle_job_result(request);
+        break;
+    case AT_REQUEST_JOB_ERRORS:
+        handle_job_errors(request);
+        break;
+    case AT_REQUEST_JOB_RECEIVERS:
+        handle_job_receivers(request);
+        break;
+    case AT_REQUEST_MODEL:
+        handle_model_upload(request);
+        break;
+    }
+
+    if (request->job)
+        job_release(request->server, request->job);
+    if (request->connection)
+        connection_return(request->server, request->connection);
+    free(request);
+}
+
+static AT_Connection *connection_open(AT_Server *server, int client_fd)
+{
+    if (server->num_connections == AT_SERVER_MAX_CONNECTIONS)
+        return NULL;
+    AT_Connection *connection = calloc(1, sizeof(AT_Connection));
+    if (!connection || AT_cancel_token_create(&connection->hangup) != AT_OK)
+    {
+        free(connection);
+        return NULL;
+    }
+    connection->fd = client_fd;
+    connection->last_active = now_seconds();
+    // responses go out as a header write and a body write, with Nagle on a kept alive
+    // connection the body waits for the client's delayed ACK of the header (~40 ms)
+    int nodelay = 1;
+    setsockopt(client_fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    server->connections[server->num_connections++] = connection;
+    return connection;
+}
+
+static void connection_close(AT_Server *server, AT_Connection *connection)
+{
+    for (uint32_t i = 0; i < server->num_connections; i++)
+    {
+        if (server->connections[i] == connection)
+        {
+            server->connections[i] = server->connections[--server->num_connections];
+            break;
+        }
+    }
+    close(connection->fd);
+    AT_http_request_free(&connection->http);
+    AT_cancel_token_destroy(connection->hangup);
+    free(connection);
+}
+
+// answers a request that never fully parsed, its body is unread so the connection goes too
+static void reject_request(AT_Server *server, AT_Connection *connection, AT_HttpParseState state)
+{
+    const char *status = state == AT_HTTP_BAD_REQUEST ? "400 Bad Request"
+                         : connection->http.header_len == 0 ? "431 Request Header Fields Too Large"
+                                                            : "413 Content Too Large";
+    char resp[256];
+    snprintf(resp, sizeof(resp),
+             "HTTP/1.1 %s\r\n"
+             AT_CORS_HEADERS
+             "Connection: close\r\n"
+             "Content-Length: 0\r\n\r\n",
+             status);
+    write(connection->fd, resp, strlen(resp));
+    connection_close(server, connection);
+}
+
+// answers the connection's complete current request, the cheap ones right here,
+// false once it went to a worker, which then owns the connection until it returns it
+static bool handle_request(AT_Server *server, AT_Connection *connection)
+{
+    const int client_fd = connection->fd;
+    const char *method = connection->http.method, *path = connection->http.path;
+    char job_tail[32] = "";
+    uint32_t job_id = 0;
+    const bool is_job_path = sscanf(path, "/jobs/%u%31s", &job_id, job_tail) >= 1;
+    const bool is_post = strcmp(method, "POST") == 0;
+    const bool is_get = strcmp(method, "GET") == 0;
+
+    // CORS preflight options, cached by the browser for as long as it allows (Chromium
+    // caps it at 2 h), so a UI firing runs and queries pays for one per path
+    if (strcmp(method, "OPTIONS") == 0 &&
+        (strcmp(path, "/run") == 0 || strcmp(path, "/query") == 0 || strcmp(path, "/jobs") == 0 ||
+         strcmp(path, "/models") == 0 || is_job_path))
+    {
+        const char *resp =
+            "HTTP/1.1 204 No Content\r\n"
+            AT_CORS_HEADERS
+            "Access-Control-Max-Age: 7200\r\n"
+            "Content-Length: 0\r\n"
+            "\r\n";
+        write(client_fd, resp, strlen(resp));
+        return true;
+    }
+
+    // job status is a snapshot of a few counters, never worth a trip through the queue
+    if (is_get && is_job_path && job_tail[0] == '\0')
+    {
+        send_job_status(client_fd, server, job_id);
+        return true;
+    }
+
+    // cancelling is a flag the job's run checks, the worker frees up within a few ms
+    if (strcmp(method, "DELETE") == 0 && is_job_path && job_tail[0] == '\0')
+    {
+        AT_JobState state;
+        if (!job_cancel(server, job_id, &state))
+            send_status(client_fd, "404 Not Found");
+        else
+            send_status(client_fd, state < AT_JOB_DONE ? "202 Accepted" : "409 Conflict");
+        return true;
+    }
+
+    // "/receivers" asks for every receiver's metrics, "/receivers/{n}" for one curve
+    uint32_t receiver = UINT32_MAX;
+    int receiver_end = 0;
+    const bool is_receivers = strcmp(job_tail, "/receivers") == 0 ||
+                              (sscanf(job_tail, "/receivers/%u%n", &receiver, &receiver_end) == 1 &&
+                               job_tail[receiver_end] == '\0' && receiver != UINT32_MAX);
+
+    AT_RequestKind kind;
+    AT_Job *job = NULL;
+    if (is_get && is_job_path &&
+        (strcmp(job_tail, "/result") == 0 || strcmp(job_tail, "/errors") == 0 || is_receivers))
+    {
+        kind = is_receivers ? AT_REQUEST_JOB_RECEIVERS :
+               job_tail[1] == 'r' ? AT_REQUEST_JOB_RESULT : AT_REQUEST_JOB_ERRORS;
+        job = job_acquire(server, job_id);
+        if (!job)
+        {
+            send_status(client_fd, "404 Not Found");
+            return true;
+        }
+    }
+    else if (is_post && (strcmp(path, "/run") == 0 || strcmp(path, "/query") == 0 || strcmp(path, "/jobs") == 0))
+    {
+        kind = path[1] == 'r' ? AT_REQUEST_RUN : path[1] == 'q' ? AT_REQUEST_QUERY : AT_REQUEST_JOB;
+    }
+    else if (is_post && strcmp(path, "/models") == 0)
+    {
+        kind = AT_REQUEST_MODEL;
+    }
+    else
+    {
+        send_status(client_fd, "404 Not Found");
+        return true;
+    }
+
+    AT_Request *request = malloc(sizeof(AT_Request));
+    if (kind == AT_REQUEST_JOB && request)
+    {
+        job = job_create(server);
+        if (!job)
+        {
+            // every slot holds a job that is still queued or running
+            free(request);
+            send_busy(client_fd);
+            return true;
+        }
+        // parsed here, the connection's buffer moves on to its next request
+        parse_run_config(AT_http_request_body(&connection->http), &job->config);
+    }
+    if (!request)
+    {
+        if (job)
+            job_release(server, job);
+        send_status(client_fd, "500 Internal Server Error");
+        return true;
+    }
+    // a job's client is answered right away, the worker only runs it
+    const bool answered_here = kind == AT_REQUEST_JOB;
+    *request = (AT_Request){
+        .server = server,
+        .connection = answered_here ? NULL : connection,
+        .client_fd = answered_here ? -1 : client_fd,
+        .kind = kind,
+        .job = job,
+        .receiver = receiver};
+    job_id = job ? job->id : 0;
+    connection->busy = !answered_here;
+
+    if (!AT_worker_pool_submit(server->pool, request))
+    {
+        // every worker is busy and the queue is full, shed the load
+        if (kind == AT_REQUEST_JOB)
+            job_remove(server, job);
+        if (job)
+            job_release(server, job);
+        connection->busy = false;
+        send_busy(client_fd);
+        free(request);
+        return true;
+    }
+
+    if (answered_here)
+    {
+        // the run it supersedes stops now rather than finish for nobody
+        AT_JobState replaced_state;
+        if (job->config.replaces_job != 0)
+            job_cancel(server, job->config.replaces_job, &replaced_state);
+
+        char json[64], location[64];
+        snprintf(json, sizeof(json), "{\"id\":%u}", job_id);
+        snprintf(location, sizeof(location), "Location: /jobs/%u\r\n", job_id);
+        send_json(client_fd, "202 Accepted", location, json);
+    }
+    return answered_here;
+}
+
+// answers every complete request buffered on the connection in order, stops at the
+// first one a worker takes or at a partial one, which the next read continues
+static void connection_serve(AT_Server *server, AT_Connection *connection, AT_HttpParseState state)
+{
+    while (state == AT_HTTP_COMPLETE)
+    {
+        if (!handle_request(server, connection))
+            return;
+        if (!connection->http.keep_alive)
+        {
+            connection_close(server, connection);
+            return;
+        }
+        AT_http_request_next(&connection->http);
+        connection->last_active = now_seconds();
+        state = AT_http_request_parse(&connection->http, AT_SERVER_MAX_BODY);
+    }
+    if (state != AT_HTTP_INCOMPLETE)
+        reject_request(server, connection, state);
+}
+
+// a worker answered, the connection carries on with its next request or closes
+static void connection_resume(AT_Server *server, AT_Connection *connection)
+{
+    connection->busy = false;
+    connection->peeked = false;
+    if (connection->broken || !connection->http.keep_alive || AT_cancel_token_is_cancelled(connection->hangup))
+    {
+        connection_close(server, connection);
+        return;
+    }
+    AT_http_request_next(&connection->http);
+    connection->last_active = now_seconds();
+    connection_serve(server, connection, AT_http_request_parse(&connection->http, AT_SERVER_MAX_BODY));
+}
+
+AT_Result AT_raytracer_serve(const AT_ServerConfig *config)
+{
+    if (!config)
+        return AT_ERR_INVALID_ARGUMENT;
+
+    // a client hanging up mid response must not take the whole server down
+    signal(SIGPIPE, SIG_IGN);
+
+    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (server_fd < 0)
+        return AT_ERR_NETWORK_FAILURE;
+    int opt = 1;
+    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = inet_addr("127.0.0.1"),
+        .sin_port = htons(config->port)};
+    if (bind(server_fd, (sockaddr *)&address, sizeof(address)) < 0 || listen(server_fd, SOMAXCONN) < 0)
+    {
+        close(server_fd);
+        return AT_ERR_NETWORK_FAILURE;
+    }
+
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t num_workers = config->num_workers > 0 ? config->num_workers : (num_cpus > 0 ? (uint32_t)num_cpus : 1);
+    uint32_t queue_capacity = config->queue_capacity > 0 ? config->queue_capacity : AT_SERVER_QUEUE_CAPACITY;
+
+    AT_Server server = {.wake_fds = {-1, -1}};
+    pthread_mutex_init(&server.result_lock, NULL);
+    pthread_mutex_init(&server.job_lock, NULL);
+    pthread_mutex_init(&server.connection_lock, NULL);
+    AT_Result res = pipe(server.wake_fds) == 0 ? AT_OK : AT_ERR_NETWORK_FAILURE;
+    // a worker handing back a connection never waits on the acceptor draining the pipe
+    if (res == AT_OK)
+    {
+        fcntl(server.wake_fds[0], F_SETFL, O_NONBLOCK);
+        fcntl(server.wake_fds[1], F_SETFL, O_NONBLOCK);
+    }
+    if (res == AT_OK)
+        res = AT_model_cache_create(&server.models, AT_SERVER_MODEL_CACHE_CAPACITY);
+    if (res == AT_OK)
+        res = AT_worker_pool_create(&server.pool, num_workers, queue_capacity, run_request);
+    if (res != AT_OK)
+    {
+        AT_model_cache_destroy(server.models);
+        if (server.wake_fds[0] >= 0)
+        {
+            close(server.wake_fds[0]);
+            close(server.wake_fds[1]);
+        }
+        pthread_mutex_destroy(&server.connection_lock);
+        pthread_mutex_destroy(&server.job_lock);
+        pthread_mutex_destroy(&server.result_lock);
+        close(server_fd);
+        return res;
+    }
+    printf("Server running on 127.0.0.1:%u, %u workers\n", config->port, num_workers);
+
+    // this thread only accepts connections and reads requests, anything that runs a
+    // simulation or encodes a result goes to the pool so preflights never wait behind a
+    // run, idle kept alive connections cost a pollfd each and nothing else
+    struct pollfd fds[2 + AT_SERVER_MAX_CONNECTIONS];
+    AT_Connection *polled[AT_SERVER_MAX_CONNECTIONS];
+    while (1)
+    {
+        fds[0] = (struct pollfd){.fd = server_fd, .events = POLLIN};
+        fds[1] = (struct pollfd){.fd = server.wake_fds[0], .events = POLLIN};
+        nfds_t num_fds = 2;
+        for (uint32_t i = 0; i < server.num_connections; i++)
+        {
+            if (server.connections[i]->peeked)
+                continue;
+            polled[num_fds - 2] = server.connections[i];
+            fds[num_fds++] = (struct pollfd){.fd = server.connections[i]->fd, .events = POLLIN};
+        }
+        // wakes up at least once a second to time out idle connections
+        if (poll(fds, num_fds, 1000) < 0)
+            continue;
+
+        for (nfds_t i = 2; i < num_fds; i++)
+        {
+            if (!fds[i].revents)
+                continue;
+            AT_Connection *connection = polled[i - 2];
+            if (connection->busy)
+            {
+                // only a peek, the worker owns the buffer: end of stream is a client that
+                // gave up waiting, its run stops, anything else is a pipelined request
+                char byte;
+                ssize_t peeked = recv(connection->fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+                if (peeked == 0 || (peeked < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+                    AT_cancel_token_cancel(connection->hangup);
+                connection->peeked = true;
+                continue;
+            }
+            AT_HttpParseState state;
+            if (AT_http_request_receive(&connection->http, connection->fd, AT_SERVER_MAX_BODY, &state) != AT_OK)
+            {
+                // hung up, between requests or before one was complete, nobody to answer
+                connection_close(&server, connection);
+                continue;
+            }
+            connection->last_active = now_seconds();
+            connection_serve(&server, connection, state);
+        }
+
+        if (fds[1].revents)
+        {
+            char drain[64];
+            read(server.wake_fds[0], drain, sizeof(drain));
+            pthread_mutex_lock(&server.connection_lock);
+            AT_Connection *returned = server.returned;
+            server.returned = NULL;
+            pthread_mutex_unlock(&server.connection_lock);
+            while (returned)
+            {
+                AT_Connection *next = returned->next_returned;
+                connection_resume(&server, returned);
+                returned = next;
+            }
+        }
+
+        if (fds[0].revents)
+        {
+            int client_fd = accept(server_fd, NULL, NULL);
+            if (client_fd >= 0 && !connection_open(&server, client_fd))
+            {
+                send_busy(client_fd);
+                close(client_fd);
+            }
+        }
+
+        // a started request has to finish quickly, an idle connection may wait longer
+        const double now = now_seconds();
+        for (uint32_t i = server.num_connections; i-- > 0;)
+        {
+            AT_Connection *connection = server.connections[i];
+            const double timeout = connection->http.len > 0 ? AT_SERVER_READ_TIMEOUT_S : AT_SERVER_IDLE_TIMEOUT_S;
+            if (!connection->busy && now - connection->last_active > timeout)
+                connection_close(&server, connection);
+        }
+    }
+
+    AT_worker_pool_destroy(server.pool);
+    while (server.num_connections > 0)
+        connection_close(&server, server.connections[0]);
+    for (int i = 0; i < AT_SERVER_MAX_JOBS; i++)
+    {
+        if (server.jobs[i])
+            job_release(&server, server.jobs[i]);
+    }
+    if (server.result)
+        server_result_release(&server, server.result);
+    if (server.spare)
+        server_result_destroy(server.spare);
+    AT_model_cache_destroy(server.models);
+    close(server.wake_fds[0]);
+    close(server.wake_fds[1]);
+    pthread_mutex_destroy(&server.connection_lock);
+    pthread_mutex_destroy(&server.job_lock);
+    pthread_mutex_destroy(&server.result_lock);
+    close(server_fd);
+    return AT_OK;
+}
+
+void AT_raytracer()
+{
+    AT_ServerConfig config = {.port = 8080};
+    AT_Result res = AT_raytracer_serve(&config);
+    AT_handle_result(res, "Error starting server\n");
 }
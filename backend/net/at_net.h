@@ -7,6 +7,15 @@
 #include <stdint.h>
 #include <stddef.h>
 
+typedef struct AT_FrameIndex AT_FrameIndex;
+typedef struct AT_BinaryOptions AT_BinaryOptions;
+typedef struct AT_FrameFilter AT_FrameFilter;
+typedef struct AT_FrameQuery AT_FrameQuery;
+typedef struct AT_FramePyramid AT_FramePyramid;
+
+// sink for the streaming exporters, called with consecutive chunks of the output
+typedef AT_Result (*AT_WriteFunc)(void *user_data, const void *data, size_t size);
+
 typedef struct
 {
     const char *url;
@@ -14,22 +23,110 @@ typedef struct
     int *http_status_out;
 } AT_NetworkConfig;
 
+// JSON text of the result, see AT_simulation_write_json, *out_json is NUL terminated
 AT_Result AT_simulation_to_json(
-        cJSON **out_json,
-        AT_Simulation *simulation
+        char **out_json,
+        size_t *out_size,
+        AT_Simulation *simulation,
+        const AT_FrameFilter *filter // NULL exports every voxel with energy > 0
 );
 
 AT_Result AT_simulation_to_binary(
         uint8_t **out_buf,
         size_t *out_size,
-        AT_Simulation *simulation
+        AT_Simulation *simulation,
+        const AT_BinaryOptions *options, // NULL writes ATRB v1
+        const AT_FrameFilter *filter     // NULL exports every voxel with energy > 0
+);
+
+// ATRB of a frame range / voxel box / downsampled grid of a finished result, see
+// AT_frame_index_query, works on a result store view as well as a live simulation
+AT_Result AT_simulation_query_binary(
+        uint8_t **out_buf,
+        size_t *out_size,
+        AT_Simulation *simulation,
+        const AT_FrameIndex *index, // index of simulation kept between queries, NULL builds one
+        const AT_FrameQuery *query,
+        const AT_BinaryOptions *options // NULL writes ATRB v1
+);
+
+// ATRP stream of the result, see AT_pyramid_encoder_create: every mip level from a
+// single cell up to the simulated grid, coarsest first, for progressive viewing
+AT_Result AT_simulation_to_pyramid(
+        uint8_t **out_buf,
+        size_t *out_size,
+        AT_Simulation *simulation,
+        const AT_BinaryOptions *options, // NULL writes ATRB v1 levels
+        const AT_FrameFilter *filter     // NULL exports every voxel with energy > 0
+);
+
+// ATRB v2 with temporal frames, see AT_ATRB_FLAG_TEMPORAL: playback bandwidth
+// follows what changes between frames instead of how many voxels are active
+AT_Result AT_simulation_to_binary_temporal(
+        uint8_t **out_buf,
+        size_t *out_size,
+        AT_Simulation *simulation,
+        uint32_t keyframe_interval,
+        float delta_threshold
 );
 
+// AT_WriteFunc sinks, user_data is an int * file descriptor / a FILE *
+AT_Result AT_write_to_fd(void *user_data, const void *data, size_t size);
+AT_Result AT_write_to_file(void *user_data, const void *data, size_t size);
+
 AT_Result AT_send_json_to_url(
     cJSON *json,
     const AT_NetworkConfig *config
 );
 
+typedef struct
+{
+    uint16_t port;
+    uint32_t num_workers;    // simulations run at once, 0 for one per online CPU
+    uint32_t queue_capacity; // accepted requests waiting for a worker before the rest get a 503, 0 for the default
+} AT_ServerConfig;
+
+// HTTP endpoint: one acceptor thread reads requests and answers preflights,
+// /run and /query are handed to a bounded worker pool, only returns on setup failure
+//
+// connections are kept alive between requests (HTTP/1.1 unless "Connection: close")
+// and closed after 30 s idle, pipelined requests on one are answered in order
+//
+// POST /jobs queues a run and answers 202 {"id"} right away, GET /jobs/{id} reports
+// its state and AT_SimulationProgress counters, GET /jobs/{id}/result streams the
+// finished result encoded as the job's body asked, 409 while it is still running,
+// DELETE /jobs/{id} cancels it, as does a later POST /jobs with "replaces": id
+//
+// a job posted with "batchRays" traces that many rays at a time, GET /jobs/{id}/result
+// answers with the normalised result of the batches so far while it runs, and with
+// "targetError" it stops once the estimated relative error falls below it, measured
+// within "errorRegion" {"min","max"} when given, GET /jobs/{id}/errors then has the
+// estimated relative error of every voxel as float32
+//
+// "numRays" is capped at 2^20 per source
+//
+// /run and /jobs bodies may list up to 16 "sources" [{"position","direction","gain"}]
+// instead of one "selectedSource", every source then deposits into its own channel,
+// a later run with the same room and settings reuses the simulation, re-tracing only
+// the sources that moved and re-mixing the rest with the new gains
+//
+// a job posted with up to 256 "receivers" [{"position","radius"}] records an
+// energy-time curve at each, GET /jobs/{id}/receivers answers {"receivers":
+// [{"rt60","edt","c80"}], "binWidth", "numBins"} with a value per octave band, null
+// where one can't be measured, GET /jobs/{id}/receivers/{n} receiver n's curve as
+// float32, X-AT-Bins * 8 band energies then X-AT-Bins * 3 arrival directions, with
+// "imageSourceOrder" the curves hold exact specular reflections up to that order from
+// image sources until "crossoverTime" seconds and the rays' reverberation after it
+//
+// a /run whose client hangs up is cancelled, a "timeLimit" in seconds stops a run
+// or job that takes longer with 504, either way the worker is free within a few ms
+//
+// POST /models takes a raw GLB body and answers {"modelId","cached"}, /run and /jobs
+// bodies name it with "modelId" instead of a "fileName" under ../assets/glb, the same
+// bytes uploaded again reuse the parsed model
+AT_Result AT_raytracer_serve(const AT_ServerConfig *config);
+
+// AT_raytracer_serve on 127.0.0.1:8080 with the defaults
 void AT_raytracer();
 
 #endif // AT_NET_N
@@ -0,0 +1,118 @@
+#include "at_pool.h"
+#include "acoustic/at.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+struct AT_WorkerPool
+{
+    AT_TaskFunc run;
+    pthread_t *threads;
+    uint32_t num_threads;
+
+    // ring buffer of waiting tasks
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    void **tasks;
+    uint32_t capacity;
+    uint32_t head;
+    uint32_t count;
+    bool stopping;
+};
+
+static void *worker_main(void *arg)
+{
+    AT_WorkerPool *pool = arg;
+    for (;;)
+    {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->count == 0 && !pool->stopping)
+            pthread_cond_wait(&pool->not_empty, &pool->lock);
+        if (pool->count == 0)
+        {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        void *task = pool->tasks[pool->head];
+        pool->head = (pool->head + 1) % pool->capacity;
+        pool->count--;
+        pthread_mutex_unlock(&pool->lock);
+
+        pool->run(task);
+    }
+}
+
+AT_Result AT_worker_pool_create(AT_WorkerPool **out_pool, uint32_t num_workers, uint32_t queue_capacity,
+                                AT_TaskFunc run)
+{
+    if (!out_pool || *out_pool || num_workers == 0 || queue_capacity == 0 || !run)
+        return AT_ERR_INVALID_ARGUMENT;
+
+    AT_WorkerPool *pool = calloc(1, sizeof(AT_WorkerPool));
+    if (!pool)
+        return AT_ERR_ALLOC_ERROR;
+
+    pool->run = run;
+    pool->capacity = queue_capacity;
+    pool->tasks = malloc(sizeof(void *) * queue_capacity);
+    pool->threads = malloc(sizeof(pthread_t) * num_workers);
+    if (!pool->tasks || !pool->threads)
+    {
+        free(pool->tasks);
+        free(pool->threads);
+        free(pool);
+        return AT_ERR_ALLOC_ERROR;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->not_empty, NULL);
+
+    for (uint32_t i = 0; i < num_workers; i++)
+    {
+        if (pthread_create(&pool->threads[i], NULL, worker_main, pool) != 0)
+        {
+            // the ones already running exit once they see the empty, stopping queue
+            AT_worker_pool_destroy(pool);
+            return AT_ERR_ALLOC_ERROR;
+        }
+        pool->num_threads++;
+    }
+
+    *out_pool = pool;
+    return AT_OK;
+}
+
+bool AT_worker_pool_submit(AT_WorkerPool *pool, void *task)
+{
+    pthread_mutex_lock(&pool->lock);
+    const bool accepted = pool->count < pool->capacity && !pool->stopping;
+    if (accepted)
+    {
+        pool->tasks[(pool->head + pool->count) % pool->capacity] = task;
+        pool->count++;
+        pthread_cond_signal(&pool->not_empty);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return accepted;
+}
+
+void AT_worker_pool_destroy(AT_WorkerPool *pool)
+{
+    if (!pool)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->not_empty);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (uint32_t i = 0; i < pool->num_threads; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    pthread_cond_destroy(&pool->not_empty);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->tasks);
+    free(pool->threads);
+    free(pool);
+}
@@ -0,0 +1,29 @@
+#ifndef AT_POOL_H
+#define AT_POOL_H
+
+#include "../../core/include/acoustic/at.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// runs one submitted task on a worker thread, owns the task from then on
+typedef void (*AT_TaskFunc)(void *task);
+
+// fixed set of worker threads fed from a bounded FIFO, submit never blocks:
+// a full queue is reported back so the caller can shed the load
+typedef struct AT_WorkerPool AT_WorkerPool;
+
+AT_Result AT_worker_pool_create(
+        AT_WorkerPool **out_pool,
+        uint32_t num_workers,
+        uint32_t queue_capacity,
+        AT_TaskFunc run
+);
+
+// false when queue_capacity tasks are already waiting, the task is not taken then
+bool AT_worker_pool_submit(AT_WorkerPool *pool, void *task);
+
+// runs what is still queued, then joins the workers
+void AT_worker_pool_destroy(AT_WorkerPool *pool);
+
+#endif // AT_POOL_H
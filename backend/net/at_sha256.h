@@ -0,0 +1,13 @@
+#ifndef AT_SHA256_H
+#define AT_SHA256_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define AT_SHA256_SIZE 32
+
+// FIPS 180-4 SHA-256 of size bytes in one call, for content addressing uploads
+// where a client must not be able to make two files collide
+void AT_sha256(const void *data, size_t size, uint8_t out_digest[AT_SHA256_SIZE]);
+
+#endif // AT_SHA256_H
@@ -0,0 +1,89 @@
+#ifndef AT_STREAM_H
+#define AT_STREAM_H
+
+#include "../../core/include/acoustic/at.h"
+#include "at_net.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define AT_STREAM_CHUNK_SIZE (64 * 1024)
+
+// coalesces the many small exporter writes into AT_STREAM_CHUNK_SIZE calls to an AT_WriteFunc sink
+typedef struct
+{
+    AT_WriteFunc write;
+    void *user_data;
+    size_t len;
+    uint8_t buf[AT_STREAM_CHUNK_SIZE];
+} AT_StreamWriter;
+
+static inline AT_StreamWriter *AT_stream_create(AT_WriteFunc write, void *user_data)
+{
+    AT_StreamWriter *w = malloc(sizeof(AT_StreamWriter));
+    if (!w)
+        return NULL;
+    w->write = write;
+    w->user_data = user_data;
+    w->len = 0;
+    return w;
+}
+
+static inline AT_Result AT_stream_flush(AT_StreamWriter *w)
+{
+    if (w->len == 0)
+        return AT_OK;
+    AT_Result res = w->write(w->user_data, w->buf, w->len);
+    w->len = 0;
+    return res;
+}
+
+static inline AT_Result AT_stream_put(AT_StreamWriter *w, const void *data, size_t size)
+{
+    const uint8_t *src = data;
+    while (size > 0)
+    {
+        if (w->len == AT_STREAM_CHUNK_SIZE)
+        {
+            AT_Result res = AT_stream_flush(w);
+            if (res != AT_OK)
+                return res;
+        }
+        size_t n = AT_STREAM_CHUNK_SIZE - w->len;
+        if (n > size)
+            n = size;
+        memcpy(w->buf + w->len, src, n);
+        w->len += n;
+        src += n;
+        size -= n;
+    }
+    return AT_OK;
+}
+
+static inline AT_Result AT_stream_put_u32(AT_StreamWriter *w, uint32_t v)
+{
+    return AT_stream_put(w, &v, 4);
+}
+
+// room for size contiguous bytes (size <= AT_STREAM_CHUNK_SIZE) to format into,
+// the bytes actually used are committed with AT_stream_commit
+static inline AT_Result AT_stream_reserve(AT_StreamWriter *w, size_t size, char **out)
+{
+    if (AT_STREAM_CHUNK_SIZE - w->len < size)
+    {
+        AT_Result res = AT_stream_flush(w);
+        if (res != AT_OK)
+            return res;
+    }
+    *out = (char *)w->buf + w->len;
+    return AT_OK;
+}
+
+static inline void AT_stream_commit(AT_StreamWriter *w, size_t size)
+{
+    w->len += size;
+}
+
+#endif // AT_STREAM_H
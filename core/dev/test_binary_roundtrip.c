@@ -0,0 +1,470 @@
+#include "acoustic/at.h"
+#include "../src/at_internal.h"
+#include "../src/at_frame_index.h"
+#include "../../backend/net/at_binary.h"
+#include "../../backend/net/at_lz4.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Round trip check for the ATRB encodings.
+// Simulates a box room, encodes its result as ATRB v1, v2, v2 + LZ4, quantized and
+// temporal, decodes every document the way web/src/features/simulation/api/
+// parse-result-binary.ts does and compares each frame's voxels and energies with
+// the frame index they were encoded from. Frames capped to a couple of voxels are
+// too small for LZ4 to shrink, so they take the raw block path (size == raw size),
+// and the compressor is fed incompressible and long repetitive buffers on its own.
+// Needs no assets, prints every case and exits non zero if one fails.
+
+#define NUM_RAYS 20000
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+} Buffer;
+
+typedef struct {
+    uint32_t count;
+    uint32_t *indices;
+    float *energies;
+} Frame;
+
+static AT_Result buffer_write(void *user_data, const void *data, size_t size)
+{
+    Buffer *buffer = user_data;
+    if (buffer->size + size > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+        while (capacity < buffer->size + size) capacity *= 2;
+        uint8_t *grown = realloc(buffer->data, capacity);
+        if (!grown) return AT_ERR_ALLOC_ERROR;
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->size, data, size);
+    buffer->size += size;
+    return AT_OK;
+}
+
+static uint32_t read_u32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+// LZ4 block decoder, bounds checked, false unless it fills dst exactly
+static bool lz4_decompress(const uint8_t *src, size_t size, uint8_t *dst, size_t raw_size)
+{
+    size_t ip = 0, op = 0;
+    while (ip < size) {
+        const uint8_t token = src[ip++];
+        size_t literals = token >> 4;
+        if (literals == 15) {
+            uint8_t byte;
+            do {
+                if (ip >= size) return false;
+                byte = src[ip++];
+                literals += byte;
+            } while (byte == 255);
+        }
+        if (literals > size - ip || literals > raw_size - op) return false;
+        memcpy(dst + op, src + ip, literals);
+        ip += literals;
+        op += literals;
+
+        // the last sequence carries literals only
+        if (ip >= size) break;
+
+        if (size - ip < 2) return false;
+        const size_t offset = src[ip] | (size_t)src[ip + 1] << 8;
+        ip += 2;
+        size_t match = (token & 0x0f) + 4;
+        if ((token & 0x0f) == 15) {
+            uint8_t byte;
+            do {
+                if (ip >= size) return false;
+                byte = src[ip++];
+                match += byte;
+            } while (byte == 255);
+        }
+        if (offset == 0 || offset > op || match > raw_size - op) return false;
+        for (size_t i = 0; i < match; i++, op++) dst[op] = dst[op - offset];
+    }
+    return op == raw_size;
+}
+
+static bool read_varint(const uint8_t *block, size_t size, size_t *pos, uint32_t *out)
+{
+    uint32_t value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (*pos >= size) return false;
+        const uint8_t byte = block[(*pos)++];
+        value |= (uint32_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *out = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool read_indices(const uint8_t *block, size_t size, size_t *pos, uint32_t count, uint32_t *out)
+{
+    uint32_t prev = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t delta;
+        if (!read_varint(block, size, pos, &delta)) return false;
+        prev += delta;
+        out[i] = prev;
+    }
+    return true;
+}
+
+static void frames_free(Frame *frames, uint32_t num_frames)
+{
+    if (!frames) return;
+    for (uint32_t f = 0; f < num_frames; f++) {
+        free(frames[f].indices);
+        free(frames[f].energies);
+    }
+    free(frames);
+}
+
+// keyframe minus removed voxels with updates applied, all three lists ascending
+static bool apply_delta(const Frame *key, const uint32_t *removed, uint32_t num_removed, Frame *frame)
+{
+    uint32_t *indices = malloc(sizeof(uint32_t) * (key->count + frame->count + 1));
+    float *energies = malloc(sizeof(float) * (key->count + frame->count + 1));
+    if (!indices || !energies) {
+        free(indices);
+        free(energies);
+        return false;
+    }
+
+    uint32_t k = 0, u = 0, r = 0, n = 0;
+    while (k < key->count || u < frame->count) {
+        const uint64_t key_voxel = k < key->count ? key->indices[k] : UINT64_MAX;
+        const uint64_t update_voxel = u < frame->count ? frame->indices[u] : UINT64_MAX;
+        if (update_voxel <= key_voxel) {
+            indices[n] = frame->indices[u];
+            energies[n++] = frame->energies[u++];
+            if (update_voxel == key_voxel) k++;
+            continue;
+        }
+        while (r < num_removed && removed[r] < key_voxel) r++;
+        if (r < num_removed && removed[r] == key_voxel) {
+            k++;
+            continue;
+        }
+        indices[n] = key->indices[k];
+        energies[n++] = key->energies[k++];
+    }
+
+    free(frame->indices);
+    free(frame->energies);
+    *frame = (Frame){.count = n, .indices = indices, .energies = energies};
+    return true;
+}
+
+// decodes a whole ATRB document, *out_raw_blocks counts LZ4 frames stored uncompressed
+static Frame *decode(const uint8_t *doc, size_t doc_size, uint32_t *out_num_frames, uint32_t *out_raw_blocks)
+{
+    if (doc_size < 16 || memcmp(doc, "ATRB", 4) != 0) return NULL;
+    const uint32_t num_frames = read_u32(doc + 4);
+    const uint16_t version = (uint16_t)read_u32(doc + 12);
+    const uint16_t flags = (uint16_t)(read_u32(doc + 12) >> 16);
+    const bool v2 = version == AT_ATRB_VERSION_2;
+    const bool temporal = v2 && (flags & AT_ATRB_FLAG_TEMPORAL);
+
+    float log_min = 0.0f, log_max = 0.0f;
+    uint32_t keyframe_interval = 1;
+    if (v2) {
+        if (doc_size < 24 + (temporal ? 4 : 0)) return NULL;
+        memcpy(&log_min, doc + 16, 4);
+        memcpy(&log_max, doc + 20, 4);
+        if (temporal) keyframe_interval = read_u32(doc + 24);
+        if (keyframe_interval == 0) return NULL;
+    }
+    const size_t table = v2 ? (temporal ? 28 : 24) : 16;
+    const size_t entry_size = v2 ? 16 : 8;
+    if ((doc_size - table) / entry_size < num_frames) return NULL;
+
+    Frame *frames = calloc(num_frames ? num_frames : 1, sizeof(Frame));
+    if (!frames) return NULL;
+    *out_raw_blocks = 0;
+    for (uint32_t f = 0; f < num_frames; f++) {
+        const uint8_t *entry = doc + table + (size_t)f * entry_size;
+        const uint32_t offset = read_u32(entry);
+        const uint32_t count = read_u32(entry + 4);
+        const uint32_t size = v2 ? read_u32(entry + 8) : count * 8;
+        const uint32_t raw_size = v2 ? read_u32(entry + 12) : size;
+        Frame *frame = &frames[f];
+        frame->count = count;
+        frame->indices = malloc(sizeof(uint32_t) * (count ? count : 1));
+        frame->energies = malloc(sizeof(float) * (count ? count : 1));
+        if (!frame->indices || !frame->energies || offset > doc_size || size > doc_size - offset) {
+            frames_free(frames, num_frames);
+            return NULL;
+        }
+
+        if (!v2) {
+            if (size / 8 < count) {
+                frames_free(frames, num_frames);
+                return NULL;
+            }
+            memcpy(frame->indices, doc + offset, (size_t)count * 4);
+            memcpy(frame->energies, doc + offset + (size_t)count * 4, (size_t)count * 4);
+            continue;
+        }
+
+        const uint8_t *block = doc + offset;
+        uint8_t *raw = NULL;
+        if ((flags & AT_ATRB_FLAG_LZ4) && size != raw_size) {
+            raw = malloc(raw_size ? raw_size : 1);
+            if (!raw || !lz4_decompress(block, size, raw, raw_size)) {
+                free(raw);
+                frames_free(frames, num_frames);
+                return NULL;
+            }
+            block = raw;
+        } else if (flags & AT_ATRB_FLAG_LZ4) {
+            (*out_raw_blocks)++;
+        }
+
+        size_t pos = 0;
+        uint32_t num_removed = 0;
+        uint32_t *removed = NULL;
+        bool ok = true;
+        if (temporal) {
+            ok = read_varint(block, raw_size, &pos, &num_removed);
+            removed = malloc(sizeof(uint32_t) * (ok && num_removed ? num_removed : 1));
+            ok = ok && removed && read_indices(block, raw_size, &pos, num_removed, removed);
+        }
+        ok = ok && read_indices(block, raw_size, &pos, count, frame->indices);
+
+        const size_t energy_size = flags & AT_ATRB_FLAG_QUANTIZED ? 2 : 4;
+        ok = ok && (raw_size - pos) / energy_size >= count;
+        for (uint32_t i = 0; ok && i < count; i++) {
+            if (flags & AT_ATRB_FLAG_QUANTIZED) {
+                uint16_t q;
+                memcpy(&q, block + pos + (size_t)i * 2, 2);
+                frame->energies[i] = exp2f(log_min + q * ((log_max - log_min) / 65535.0f));
+            } else {
+                memcpy(&frame->energies[i], block + pos + (size_t)i * 4, 4);
+            }
+        }
+
+        if (ok && temporal && f % keyframe_interval != 0) {
+            ok = apply_delta(&frames[f - f % keyframe_interval], removed, num_removed, frame);
+        }
+        free(removed);
+        free(raw);
+        if (!ok) {
+            frames_free(frames, num_frames);
+            return NULL;
+        }
+    }
+
+    *out_num_frames = num_frames;
+    return frames;
+}
+
+// encodes index with options, decodes it again and compares every frame with the index
+static bool check_encoding(const char *name, AT_Simulation *simulation, const AT_FrameIndex *index,
+                           const AT_BinaryOptions *options, bool expect_raw_blocks)
+{
+    AT_BinaryEncoder *encoder = NULL;
+    Buffer doc = {0};
+    AT_Result res = AT_binary_encoder_create(&encoder, simulation, index, options);
+    if (res == AT_OK) res = AT_binary_encoder_write(encoder, buffer_write, &doc);
+    const size_t expected_size = encoder ? AT_binary_encoder_size(encoder) : 0;
+    AT_binary_encoder_destroy(encoder);
+    if (res != AT_OK || doc.size != expected_size) {
+        printf("FAIL %-24s encode res %d size %zu expected %zu\n", name, res, doc.size, expected_size);
+        free(doc.data);
+        return false;
+    }
+
+    uint32_t num_frames = 0, raw_blocks = 0;
+    Frame *frames = decode(doc.data, doc.size, &num_frames, &raw_blocks);
+    if (!frames || num_frames != index->num_frames) {
+        printf("FAIL %-24s decode\n", name);
+        frames_free(frames, num_frames);
+        free(doc.data);
+        return false;
+    }
+
+    //quantization is off by at most half a step in log2, temporal frames keep the
+    //keyframe's energy while theirs is within delta_threshold of it, both relative
+    //to the energy decoded
+    float log_min = 0.0f, log_max = 0.0f;
+    if (options->version == AT_ATRB_VERSION_2) {
+        memcpy(&log_min, doc.data + 16, 4);
+        memcpy(&log_max, doc.data + 20, 4);
+    }
+    const double quantized_error = options->quantize_energies ?
+        exp2((log_max - log_min) / 65535.0 * 0.5) - 1.0 + 1e-5 : 0.0;
+    const double temporal_error = options->keyframe_interval > 0 ? options->delta_threshold + 1e-6 : 0.0;
+
+    bool ok = true;
+    double max_error = 0.0;
+    uint32_t entries = 0;
+    for (uint32_t f = 0; f < num_frames && ok; f++) {
+        const uint32_t count = AT_frame_index_count(index, f);
+        const uint32_t *voxels = AT_frame_index_voxels(index, f);
+        if (frames[f].count != count) {
+            printf("FAIL %-24s frame %u has %u voxels, expected %u\n", name, f, frames[f].count, count);
+            ok = false;
+            break;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+            const float expected = AT_frame_index_energy(index, simulation, f, i);
+            const float decoded = frames[f].energies[i];
+            const double error = fabs((double)decoded - expected) / decoded;
+            max_error = fmax(max_error, error);
+            const double allowed = quantized_error + temporal_error * (1.0 + quantized_error);
+            if (frames[f].indices[i] != voxels[i] || !(error <= allowed)) {
+                printf("FAIL %-24s frame %u entry %u voxel %u / %u energy %g / %g\n", name, f, i,
+                       frames[f].indices[i], voxels[i], decoded, expected);
+                ok = false;
+                break;
+            }
+        }
+        entries += count;
+    }
+    if (ok && expect_raw_blocks && raw_blocks == 0) {
+        printf("FAIL %-24s no frame took the raw block path\n", name);
+        ok = false;
+    }
+
+    if (ok) {
+        printf("ok   %-24s %8zu bytes %7u entries %4u raw blocks max rel error %.2e\n", name, doc.size, entries,
+               raw_blocks, max_error);
+    }
+    frames_free(frames, num_frames);
+    free(doc.data);
+    return ok;
+}
+
+// the compressor on its own, incompressible input must not grow past the bound
+// and long runs need extended literal / match lengths and far offsets
+static bool check_lz4(void)
+{
+    const size_t sizes[] = {1, 4, 12, 13, 64, 300, 4096, 70000, 200000};
+    bool ok = true;
+    srand(3);
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]) && ok; s++) {
+        const size_t size = sizes[s];
+        uint8_t *src = malloc(size);
+        uint8_t *packed = malloc(AT_lz4_compress_bound(size));
+        uint8_t *out = malloc(size);
+        for (int pattern = 0; pattern < 3 && ok; pattern++) {
+            for (size_t i = 0; i < size; i++) {
+                //random, one long run, and a random 1 kB block repeated past the 64 kB window
+                src[i] = pattern == 0 ? (uint8_t)rand() : pattern == 1 ? 7 :
+                         (uint8_t)((i % 1024) * 2654435761u >> 13 ^ (i / 65536));
+            }
+            const size_t packed_size = AT_lz4_compress(src, size, packed);
+            ok = packed_size <= AT_lz4_compress_bound(size) &&
+                 lz4_decompress(packed, packed_size, out, size) && memcmp(src, out, size) == 0;
+            if (!ok) printf("FAIL lz4 size %zu pattern %d packed %zu\n", size, pattern, packed_size);
+        }
+        free(src);
+        free(packed);
+        free(out);
+    }
+    if (ok) printf("ok   lz4 random / runs / far repeats\n");
+    return ok;
+}
+
+static AT_Model *make_box(float sx, float sy, float sz)
+{
+    static const float corners[8][3] = {{0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0},
+                                        {0, 0, 1}, {1, 0, 1}, {1, 1, 1}, {0, 1, 1}};
+    static const uint32_t faces[6][4] = {{0, 1, 2, 3}, {4, 5, 6, 7}, {0, 1, 5, 4},
+                                         {3, 2, 6, 7}, {0, 3, 7, 4}, {1, 2, 6, 5}};
+    AT_Model *model = calloc(1, sizeof(AT_Model));
+    model->vertex_count = 8;
+    model->index_count = 36;
+    model->vertices = malloc(sizeof(AT_Vec3) * 8);
+    model->normals = calloc(8, sizeof(AT_Vec3));
+    model->indices = malloc(sizeof(uint32_t) * 36);
+    model->triangle_materials = malloc(12);
+    memset(model->triangle_materials, AT_MATERIAL_UNASSIGNED, 12);
+    for (int i = 0; i < 8; i++) {
+        model->vertices[i] = AT_vec3(corners[i][0] * sx, corners[i][1] * sy, corners[i][2] * sz);
+    }
+    for (int f = 0; f < 6; f++) {
+        uint32_t *out = &model->indices[f * 6];
+        out[0] = faces[f][0], out[1] = faces[f][1], out[2] = faces[f][2];
+        out[3] = faces[f][0], out[4] = faces[f][2], out[5] = faces[f][3];
+    }
+    return model;
+}
+
+int main()
+{
+    srand(1);
+    AT_Model *model = make_box(10.0f, 4.0f, 6.0f);
+    AT_Source source = {.position = {{5.0f, 2.0f, 3.0f}}, .direction = {{1.0f, 0.2f, 0.1f}}, .intensity = 1.0f};
+    AT_SceneConfig scene_config = {.sources = &source, .num_sources = 1, .material = AT_MATERIAL_CONCRETE,
+                                   .environment = model};
+    AT_Settings settings = {.voxel_size = 0.25f, .num_rays = NUM_RAYS, .fps = 60};
+
+    AT_Scene *scene = NULL;
+    AT_Simulation *simulation = NULL;
+    AT_FrameIndex *index = NULL, *sparse = NULL;
+    const AT_FrameFilter two_voxels = {.max_voxels = 2};
+    if (AT_scene_create(&scene, &scene_config) != AT_OK ||
+        AT_simulation_create(&simulation, scene, &settings) != AT_OK ||
+        AT_simulation_run(simulation) != AT_OK ||
+        AT_frame_index_create(&index, simulation, NULL) != AT_OK ||
+        AT_frame_index_create(&sparse, simulation, &two_voxels) != AT_OK) {
+        fprintf(stderr, "Error simulating the box room\n");
+        return 1;
+    }
+    printf("box room %u frames %u entries\n", index->num_frames, index->num_entries);
+
+    const struct {
+        const char *name;
+        const AT_FrameIndex *index;
+        AT_BinaryOptions options;
+        bool expect_raw_blocks;
+    } cases[] = {
+        {"v1", index, {.version = AT_ATRB_VERSION_1}, false},
+        {"v2", index, {.version = AT_ATRB_VERSION_2}, false},
+        {"v2 lz4", index, {.version = AT_ATRB_VERSION_2, .compress_frames = true}, false},
+        {"v2 quantized", index, {.version = AT_ATRB_VERSION_2, .quantize_energies = true}, false},
+        {"v2 quantized lz4", index, {.version = AT_ATRB_VERSION_2, .quantize_energies = true, .compress_frames = true},
+         false},
+        {"v2 lz4 incompressible", sparse, {.version = AT_ATRB_VERSION_2, .compress_frames = true}, true},
+        {"temporal exact", index, {.version = AT_ATRB_VERSION_2, .keyframe_interval = 4}, false},
+        {"temporal 5%", index, {.version = AT_ATRB_VERSION_2, .keyframe_interval = 8, .delta_threshold = 0.05f},
+         false},
+        {"temporal 5% quantized lz4", index,
+         {.version = AT_ATRB_VERSION_2, .quantize_energies = true, .compress_frames = true, .keyframe_interval = 8,
+          .delta_threshold = 0.05f}, false},
+        {"temporal lz4 sparse", sparse,
+         {.version = AT_ATRB_VERSION_2, .compress_frames = true, .keyframe_interval = 4}, true},
+    };
+
+    int failures = check_lz4() ? 0 : 1;
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        if (!check_encoding(cases[c].name, simulation, cases[c].index, &cases[c].options, cases[c].expect_raw_blocks)) {
+            failures++;
+        }
+    }
+    printf("%d failures\n", failures);
+
+    AT_frame_index_destroy(sparse);
+    AT_frame_index_destroy(index);
+    AT_simulation_destroy(simulation);
+    AT_scene_destroy(scene);
+    AT_model_destroy(model);
+    return failures > 0;
+}
@@ -0,0 +1,264 @@
+#include "acoustic/at.h"
+#include "../../backend/net/at_net.h"
+
+#include <arpa/inet.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+// Throughput benchmark for the HTTP endpoint.
+// Starts AT_raytracer_serve on a spare port, keeps every worker busy with long
+// /run simulations and meanwhile hammers it with CORS preflights from several
+// client threads, reporting requests/second and latency. A second burst of /run
+// requests larger than workers + queue shows the 503 backpressure. The last phase
+// replays a UI tweaking query parameters, preflight + /query pairs, once on a new
+// connection per request and once on a single kept alive connection.
+// Run from build/ like test_net.c, the runs load ../assets/glb/L_room.glb.
+
+#define PORT 8091
+#define NUM_WORKERS 2
+#define QUEUE_CAPACITY 4
+#define NUM_CLIENTS 8
+#define REQUESTS_PER_CLIENT 500
+#define NUM_BURST 16
+#define NUM_TWEAKS 200
+
+static const char *RUN_BODY =
+    "{\"fileName\":\"L_room.glb\",\"voxelSize\":0.25,\"numRays\":20000,\"fps\":60,"
+    "\"selectedSource\":{\"position\":{\"x\":1,\"y\":1,\"z\":1},\"direction\":{\"x\":1,\"y\":0,\"z\":0}}}";
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void *serve(void *arg)
+{
+    (void)arg;
+    AT_ServerConfig config = {.port = PORT, .num_workers = NUM_WORKERS, .queue_capacity = QUEUE_CAPACITY};
+    if (AT_raytracer_serve(&config) != AT_OK) fprintf(stderr, "Error starting server\n");
+    return NULL;
+}
+
+static int connect_server(void)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = inet_addr("127.0.0.1"),
+        .sin_port = htons(PORT)};
+    if (fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// reads one response up to the end of its Content-Length body, returns the HTTP
+// status or -1, the connection stays usable for the next request (requests are
+// never pipelined here, so nothing past the body can arrive)
+static int read_response(int fd)
+{
+    char buf[4096];
+    size_t len = 0;
+    char *end = NULL;
+    while (!end) {
+        ssize_t n = read(fd, buf + len, sizeof(buf) - 1 - len);
+        if (n <= 0) return -1;
+        len += (size_t)n;
+        buf[len] = '\0';
+        end = strstr(buf, "\r\n\r\n");
+        if (!end && len == sizeof(buf) - 1) return -1;
+    }
+
+    int status = -1;
+    size_t content_length = 0;
+    sscanf(buf, "HTTP/1.1 %d", &status);
+    char *cl = strstr(buf, "Content-Length: ");
+    if (cl && cl < end) content_length = strtoul(cl + 16, NULL, 10);
+
+    size_t received = len - (size_t)(end + 4 - buf);
+    while (received < content_length) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n <= 0) return -1;
+        received += (size_t)n;
+    }
+    return status;
+}
+
+// request on a connection of its own, returns the HTTP status or -1
+static int http_request(const char *request)
+{
+    int fd = connect_server();
+    if (fd < 0) return -1;
+    write(fd, request, strlen(request));
+    int status = read_response(fd);
+    close(fd);
+    return status;
+}
+
+static int run_request(void)
+{
+    char request[1024];
+    snprintf(request, sizeof(request),
+             "POST /run HTTP/1.1\r\nHost: localhost\r\nContent-Type: application/json\r\n"
+             "Content-Length: %zu\r\n\r\n%s", strlen(RUN_BODY), RUN_BODY);
+    return http_request(request);
+}
+
+typedef struct {
+    double *latencies;
+    int failures;
+} ClientStats;
+
+static void *preflight_client(void *arg)
+{
+    ClientStats *stats = arg;
+    const char *request = "OPTIONS /run HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    for (int i = 0; i < REQUESTS_PER_CLIENT; i++) {
+        double start = now_seconds();
+        if (http_request(request) != 204) stats->failures++;
+        stats->latencies[i] = now_seconds() - start;
+    }
+    return NULL;
+}
+
+typedef struct {
+    int status;
+    double seconds;
+} RunOutcome;
+
+static void *run_client(void *arg)
+{
+    RunOutcome *outcome = arg;
+    double start = now_seconds();
+    outcome->status = run_request();
+    outcome->seconds = now_seconds() - start;
+    return NULL;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// NUM_TWEAKS preflight + /query pairs with a moving frame window, latencies of the
+// pairs go to latencies, fd < 0 opens a connection per request
+static int tweak_queries(int fd, double *latencies)
+{
+    int failures = 0;
+    for (int i = 0; i < NUM_TWEAKS; i++) {
+        char body[128], query[512];
+        snprintf(body, sizeof(body), "{\"frameStart\":%d,\"frameEnd\":%d,\"downsample\":2}", i % 8, i % 8 + 4);
+        snprintf(query, sizeof(query),
+                 "POST /query HTTP/1.1\r\nHost: localhost\r\nContent-Type: application/json\r\n"
+                 "Content-Length: %zu\r\n\r\n%s", strlen(body), body);
+        const char *preflight = "OPTIONS /query HTTP/1.1\r\nHost: localhost\r\n\r\n";
+
+        double start = now_seconds();
+        if (fd < 0) {
+            if (http_request(preflight) != 204) failures++;
+            if (http_request(query) != 200) failures++;
+        } else {
+            write(fd, preflight, strlen(preflight));
+            if (read_response(fd) != 204) failures++;
+            write(fd, query, strlen(query));
+            if (read_response(fd) != 200) failures++;
+        }
+        latencies[i] = now_seconds() - start;
+    }
+    qsort(latencies, NUM_TWEAKS, sizeof(double), compare_double);
+    return failures;
+}
+
+int main()
+{
+    printf("HTTP Server Benchmark\n");
+
+    pthread_t server;
+    pthread_create(&server, NULL, serve, NULL);
+    pthread_detach(server);
+    //wait for the listener
+    for (int i = 0; i < 100 && http_request("OPTIONS /run HTTP/1.1\r\n\r\n") != 204; i++) usleep(10000);
+
+    //phase 1: preflights while every worker runs a simulation
+    pthread_t runners[NUM_WORKERS];
+    RunOutcome run_outcomes[NUM_WORKERS];
+    for (int i = 0; i < NUM_WORKERS; i++) pthread_create(&runners[i], NULL, run_client, &run_outcomes[i]);
+    usleep(50000);
+
+    pthread_t clients[NUM_CLIENTS];
+    ClientStats stats[NUM_CLIENTS];
+    double *latencies = malloc(sizeof(double) * NUM_CLIENTS * REQUESTS_PER_CLIENT);
+    if (!latencies) {
+        fprintf(stderr, "Error allocating benchmark data\n");
+        return 1;
+    }
+
+    double start = now_seconds();
+    for (int c = 0; c < NUM_CLIENTS; c++) {
+        stats[c] = (ClientStats){.latencies = latencies + c * REQUESTS_PER_CLIENT};
+        pthread_create(&clients[c], NULL, preflight_client, &stats[c]);
+    }
+    int failures = 0;
+    for (int c = 0; c < NUM_CLIENTS; c++) {
+        pthread_join(clients[c], NULL);
+        failures += stats[c].failures;
+    }
+    double elapsed = now_seconds() - start;
+
+    const int num_requests = NUM_CLIENTS * REQUESTS_PER_CLIENT;
+    qsort(latencies, num_requests, sizeof(double), compare_double);
+    printf("preflights  %d clients  %d requests  %8.0f req/s  p50 %.3f ms  p99 %.3f ms  failed %d\n",
+           NUM_CLIENTS, num_requests, num_requests / elapsed,
+           latencies[num_requests / 2] * 1e3, latencies[num_requests * 99 / 100] * 1e3, failures);
+
+    for (int i = 0; i < NUM_WORKERS; i++) {
+        pthread_join(runners[i], NULL);
+        printf("run %d       status %d  %.3f s\n", i, run_outcomes[i].status, run_outcomes[i].seconds);
+    }
+
+    //phase 2: more runs than workers + queue at once
+    pthread_t burst[NUM_BURST];
+    RunOutcome burst_outcomes[NUM_BURST];
+    start = now_seconds();
+    for (int i = 0; i < NUM_BURST; i++) pthread_create(&burst[i], NULL, run_client, &burst_outcomes[i]);
+    int num_ok = 0, num_busy = 0;
+    double busy_latency = 0.0;
+    for (int i = 0; i < NUM_BURST; i++) {
+        pthread_join(burst[i], NULL);
+        if (burst_outcomes[i].status == 200) num_ok++;
+        if (burst_outcomes[i].status == 503) {
+            num_busy++;
+            busy_latency = fmax(busy_latency, burst_outcomes[i].seconds);
+        }
+    }
+    printf("burst       %d runs  %d x 200  %d x 503 (slowest 503 after %.3f ms)  %.3f s total\n",
+           NUM_BURST, num_ok, num_busy, busy_latency * 1e3, now_seconds() - start);
+
+    //phase 3: parameter tweaks against the last result, /query answers from it
+    const char *labels[2] = {"new conn", "keep-alive"};
+    for (int keep_alive = 0; keep_alive < 2; keep_alive++) {
+        int fd = keep_alive ? connect_server() : -1;
+        start = now_seconds();
+        int tweak_failures = tweak_queries(fd, latencies);
+        double tweak_elapsed = now_seconds() - start;
+        if (fd >= 0) close(fd);
+        printf("tweaks      %-10s  %d pairs  %8.0f pairs/s  p50 %.3f ms  p99 %.3f ms  failed %d\n",
+               labels[keep_alive], NUM_TWEAKS, NUM_TWEAKS / tweak_elapsed,
+               latencies[NUM_TWEAKS / 2] * 1e3, latencies[NUM_TWEAKS * 99 / 100] * 1e3, tweak_failures);
+    }
+
+    free(latencies);
+    return 0;
+}
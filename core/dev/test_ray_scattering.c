@@ -16,7 +16,7 @@ static float AT_voxel_get_energy_sum(AT_Voxel *voxel, uint32_t index)
     float sum = 0.0f;
     for (size_t i = 0; i <= index; i++) {
         if (i >= voxel->count) break;
-        sum += voxel->items[i];
+        sum += AT_bands_sum(voxel->items[i]);
     }
     return sum;
 }
@@ -24,7 +24,7 @@ static float AT_voxel_get_energy_sum(AT_Voxel *voxel, uint32_t index)
 static float AT_voxel_get_energy_curr(AT_Voxel *voxel, uint32_t index)
 {
     if (index >= voxel->count) return 0.0f;
-    return voxel->items[index];
+    return AT_bands_sum(voxel->items[index]);
 }
 
 int main()
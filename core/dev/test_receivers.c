@@ -0,0 +1,198 @@
+#include "acoustic/at.h"
+#include "../src/at_internal.h"
+#include "../src/at_receiver.h"
+#include "../src/at_utils.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Receiver and room acoustics check.
+// Simulates a box room with a receiver 3 m in front of the source and compares the
+// direct sound it heard, traced and from the image sources, with the analytic
+// cos / (pi r^2) of the source's cosine lobe, then runs again to see the image source
+// bins come out the same. A synthetic exponential decay with a known RT60 per band,
+// silent before its onset, goes through AT_etc_room_acoustics and its RT60, EDT and C80
+// are compared with the closed form of the curve.
+// Needs no assets, prints every check and exits non zero if one fails.
+
+#define NUM_RAYS 20000
+#define RAY_DIRECT_TOLERANCE 0.15  // relative, about 200 rays cross the receiver
+#define ISM_DIRECT_TOLERANCE 1e-3  // relative
+#define DECAY_TOLERANCE 0.01       // relative
+#define C80_TOLERANCE 0.05         // dB
+
+static AT_Model *make_box(float sx, float sy, float sz)
+{
+    static const float corners[8][3] = {{0, 0, 0}, {1, 0, 0}, {1, 1, 0}, {0, 1, 0},
+                                        {0, 0, 1}, {1, 0, 1}, {1, 1, 1}, {0, 1, 1}};
+    static const uint32_t faces[6][4] = {{0, 1, 2, 3}, {4, 5, 6, 7}, {0, 1, 5, 4},
+                                         {3, 2, 6, 7}, {0, 3, 7, 4}, {1, 2, 6, 5}};
+    AT_Model *model = calloc(1, sizeof(AT_Model));
+    model->vertex_count = 8;
+    model->index_count = 36;
+    model->vertices = malloc(sizeof(AT_Vec3) * 8);
+    model->normals = calloc(8, sizeof(AT_Vec3));
+    model->indices = malloc(sizeof(uint32_t) * 36);
+    model->triangle_materials = malloc(12);
+    memset(model->triangle_materials, AT_MATERIAL_UNASSIGNED, 12);
+    for (int i = 0; i < 8; i++) {
+        model->vertices[i] = AT_vec3(corners[i][0] * sx, corners[i][1] * sy, corners[i][2] * sz);
+    }
+    for (int f = 0; f < 6; f++) {
+        uint32_t *out = &model->indices[f * 6];
+        out[0] = faces[f][0], out[1] = faces[f][1], out[2] = faces[f][2];
+        out[3] = faces[f][0], out[4] = faces[f][2], out[5] = faces[f][3];
+    }
+    return model;
+}
+
+static bool check(const char *name, double value, double expected, double tolerance, bool relative)
+{
+    const double error = relative ? fabs(value - expected) / fabs(expected) : fabs(value - expected);
+    const bool ok = error <= tolerance;
+    printf("%-32s %12.6g expected %12.6g error %.2e %s\n", name, value, expected, error, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+// energy of a band summed over the bins sound can reach before the distance
+static double etc_energy_before(const AT_EnergyTimeCurve *etc, int band, float distance, float speed_of_sound)
+{
+    const uint32_t last = (uint32_t)(distance / speed_of_sound / etc->bin_width);
+    double energy = 0.0;
+    for (uint32_t i = 0; i <= last && i < etc->num_bins; i++) energy += etc->energy[(size_t)i * AT_NUM_BANDS + band];
+    return energy;
+}
+
+static int check_direct_sound(void)
+{
+    AT_Model *model = make_box(10.0f, 4.0f, 6.0f);
+    const AT_Source source = {.position = {{5.0f, 2.0f, 3.0f}}, .direction = {{1.0f, 0.2f, 0.1f}},
+                              .intensity = 1.0f};
+    const AT_Receiver receiver = {.position = {{8.0f, 2.0f, 3.0f}}, .radius = 0.3f};
+    AT_SceneConfig scene_config = {.sources = &source, .num_sources = 1, .material = AT_MATERIAL_CONCRETE,
+                                   .environment = model};
+    const AT_Settings traced_settings = {.voxel_size = 0.25f, .num_rays = NUM_RAYS, .fps = 60,
+                                         .receivers = &receiver, .num_receivers = 1};
+    AT_Settings image_settings = traced_settings;
+    image_settings.image_source_order = 2;
+
+    AT_Scene *scene = NULL;
+    AT_Simulation *traced = NULL, *images = NULL;
+    AT_EnergyTimeCurve traced_etc, image_etc;
+    if (AT_scene_create(&scene, &scene_config) != AT_OK ||
+        AT_simulation_create(&traced, scene, &traced_settings) != AT_OK ||
+        AT_simulation_create(&images, scene, &image_settings) != AT_OK ||
+        AT_simulation_run(traced) != AT_OK || AT_simulation_run(images) != AT_OK ||
+        AT_simulation_receiver_etc(traced, 0, &traced_etc) != AT_OK ||
+        AT_simulation_receiver_etc(images, 0, &image_etc) != AT_OK) {
+        fprintf(stderr, "Error simulating the box room\n");
+        return 1;
+    }
+
+    //the floor reflection, 5 m, is the first to arrive after the sphere's far side at 3.3 m
+    const AT_Vec3 to_receiver = AT_vec3_sub(receiver.position, source.position);
+    const float distance = AT_vec3_length(to_receiver);
+    const float cosine = AT_vec3_dot(AT_vec3_normalize(source.direction), AT_vec3_scale(to_receiver, 1.0f / distance));
+    const float reach = distance + receiver.radius;
+    const float speed_of_sound = traced->speed_of_sound;
+
+    int failures = 0;
+    char name[64];
+    for (int band = 0; band < AT_NUM_BANDS; band++) {
+        //each band carries 1 / AT_NUM_BANDS of the source's energy
+        const double expected = source.intensity / AT_NUM_BANDS * cosine / (AT_PI * distance * distance) *
+                                exp(-traced->air_coefficient[band] * distance);
+        snprintf(name, sizeof(name), "direct traced band %d", band);
+        if (!check(name, etc_energy_before(&traced_etc, band, reach, speed_of_sound), expected,
+                   RAY_DIRECT_TOLERANCE, true)) {
+            failures++;
+        }
+        snprintf(name, sizeof(name), "direct image source band %d", band);
+        if (!check(name, etc_energy_before(&image_etc, band, reach, speed_of_sound), expected, ISM_DIRECT_TOLERANCE,
+                   true)) {
+            failures++;
+        }
+    }
+
+    //the image source bins are exact, another run with other rays leaves them as they were
+    const uint32_t image_bins = images->receivers->first_traced_bin;
+    float *first_run = malloc((size_t)image_bins * AT_NUM_BANDS * sizeof(float));
+    memcpy(first_run, image_etc.energy, (size_t)image_bins * AT_NUM_BANDS * sizeof(float));
+    srand(7);
+    if (AT_simulation_run(images) != AT_OK || AT_simulation_receiver_etc(images, 0, &image_etc) != AT_OK) {
+        fprintf(stderr, "Error running the image sources again\n");
+        return failures + 1;
+    }
+    const bool same = memcmp(first_run, image_etc.energy, (size_t)image_bins * AT_NUM_BANDS * sizeof(float)) == 0;
+    printf("%-32s %u bins %s\n", "image sources repeat", image_bins, same && image_bins > 0 ? "ok" : "FAILED");
+    if (!same || image_bins == 0) failures++;
+
+    free(first_run);
+    AT_simulation_destroy(images);
+    AT_simulation_destroy(traced);
+    AT_scene_destroy(scene);
+    AT_model_destroy(model);
+    return failures;
+}
+
+static int check_synthetic_decay(void)
+{
+    const float bin_width = 0.001f;
+    const uint32_t onset = 10;
+    float rt60[AT_NUM_BANDS];
+    float longest = 0.0f;
+    for (int band = 0; band < AT_NUM_BANDS; band++) {
+        rt60[band] = 0.4f + 0.2f * (float)band;
+        longest = fmaxf(longest, rt60[band]);
+    }
+
+    //long enough that the truncated tail does not bend the fitted part of the decay
+    const uint32_t num_bins = onset + (uint32_t)(3.0f * longest / bin_width);
+    float *energy = calloc((size_t)num_bins * AT_NUM_BANDS, sizeof(float));
+    for (uint32_t i = onset; i < num_bins; i++) {
+        for (int band = 0; band < AT_NUM_BANDS; band++) {
+            energy[(size_t)i * AT_NUM_BANDS + band] = (float)pow(10.0, -6.0 * (i - onset) * bin_width / rt60[band]);
+        }
+    }
+    const AT_EnergyTimeCurve etc = {.energy = energy, .num_bins = num_bins, .bin_width = bin_width};
+
+    AT_RoomAcoustics acoustics;
+    if (AT_etc_room_acoustics(&etc, &acoustics) != AT_OK) {
+        fprintf(stderr, "Error measuring the synthetic decay\n");
+        free(energy);
+        return 1;
+    }
+
+    int failures = 0;
+    char name[64];
+    for (int band = 0; band < AT_NUM_BANDS; band++) {
+        //a pure exponential falls 60 dB in rt60 along all of its Schroeder curve, EDT included
+        snprintf(name, sizeof(name), "synthetic rt60 band %d", band);
+        if (!check(name, acoustics.rt60[band], rt60[band], DECAY_TOLERANCE, true)) failures++;
+        snprintf(name, sizeof(name), "synthetic edt band %d", band);
+        if (!check(name, acoustics.edt[band], rt60[band], DECAY_TOLERANCE, true)) failures++;
+
+        //C80 of the geometric series q^i, 80 bins of it over the rest
+        const double q = pow(10.0, -6.0 * bin_width / rt60[band]);
+        const uint32_t early_bins = 80;
+        const double early = 1.0 - pow(q, early_bins);
+        const double late = pow(q, early_bins) - pow(q, num_bins - onset);
+        snprintf(name, sizeof(name), "synthetic c80 band %d", band);
+        if (!check(name, acoustics.c80[band], 10.0 * log10(early / late), C80_TOLERANCE, false)) failures++;
+    }
+
+    free(energy);
+    return failures;
+}
+
+int main()
+{
+    srand(1);
+    const int failures = check_direct_sound() + check_synthetic_decay();
+    printf("%d failures\n", failures);
+    return failures == 0 ? 0 : 1;
+}
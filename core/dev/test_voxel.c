@@ -7,16 +7,18 @@ int main()
 
     AT_Voxel vs = {0};
     AT_voxel_init(&vs);
-    AT_voxel_bin_append(&vs, 5.0f);
-    AT_voxel_bin_append(&vs, 10.0f);
-    AT_voxel_bin_append(&vs, 15.0f);
+    const AT_Bands first[3] = {AT_bands_splat(5.0f), AT_bands_splat(10.0f), AT_bands_splat(15.0f)};
+    for (int i = 0; i < 3; i++) {
+        AT_voxel_bin_append(&vs, &first[i]);
+    }
 
     for (uint32_t i = 0; i < 300; i++) {
-        AT_voxel_bin_append(&vs, (float)i*10);
+        const AT_Bands bin = AT_bands_splat((float)i*10);
+        AT_voxel_bin_append(&vs, &bin);
     }
 
     for (size_t i = 0; i < vs.count; i++) {
-        printf("Voxel %zu: %f\n", i, vs.items[i]);
+        printf("Voxel %zu: %f\n", i, AT_bands_sum(vs.items[i]));
     }
 
     AT_voxel_cleanup(&vs);
@@ -0,0 +1,211 @@
+#include "acoustic/at.h"
+#include "acoustic/at_math.h"
+#include "../src/at_internal.h"
+#include "../src/at_voxel.h"
+#include "../src/at_ray.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Microbenchmark for the DDA marching kernel.
+// Builds a synthetic voxel grid (no model / scene needed), fires random ray
+// segments through it and reports voxels/second for the current
+// AT_voxel_ray_step against the original per-voxel expf/divide kernel below,
+// in both deposition modes.
+
+#define GRID_SIZE 64
+#define VOXEL_SIZE 0.1f
+#define NUM_SEGMENTS 200000
+#define FPS 60
+
+// original kernel, kept here as the baseline to measure against
+static uint32_t reference_ray_step(AT_Simulation *simulation, const AT_Ray *ray, AT_Vec3 ray_end)
+{
+    float world_ray_length = AT_vec3_distance(ray->origin, ray_end);
+    if (world_ray_length <= 0.0f) return 0;
+
+    AT_Vec3 p0 = AT_vec3_scale(AT_vec3_sub(ray->origin, simulation->origin), 1.0f / simulation->voxel_size);
+    AT_Vec3 p1 = AT_vec3_scale(AT_vec3_sub(ray_end, simulation->origin), 1.0f / simulation->voxel_size);
+
+    const int grid_x = simulation->grid_dimensions.x;
+    const int grid_y = simulation->grid_dimensions.y;
+    const int grid_z = simulation->grid_dimensions.z;
+
+    if (p0.x < 0.0f || p0.y < 0.0f || p0.z < 0.0f ||
+        p0.x >= grid_x || p0.y >= grid_y || p0.z >= grid_z) return 0;
+
+    const AT_Vec3 step = (AT_Vec3) {{
+        signbit(ray->direction.x) ? -1 : 1,
+        signbit(ray->direction.y) ? -1 : 1,
+        signbit(ray->direction.z) ? -1 : 1
+    }};
+    const AT_Vec3 delta = AT_vec3_delta(ray->direction);
+
+    AT_Vec3i pos = (AT_Vec3i){
+        AT_clamp((int)floorf(p0.x), 0, grid_x - 1),
+        AT_clamp((int)floorf(p0.y), 0, grid_y - 1),
+        AT_clamp((int)floorf(p0.z), 0, grid_z - 1)
+    };
+
+    AT_Vec3 t_max;
+    t_max.x = (step.x > 0) ? ((pos.x + 1.0f) - p0.x) * delta.x : (p0.x - pos.x) * delta.x;
+    t_max.y = (step.y > 0) ? ((pos.y + 1.0f) - p0.y) * delta.y : (p0.y - pos.y) * delta.y;
+    t_max.z = (step.z > 0) ? ((pos.z + 1.0f) - p0.z) * delta.z : (p0.z - pos.z) * delta.z;
+
+    float t = 0.0f;
+    const float t_end = AT_vec3_length(AT_vec3_sub(p1, p0));
+    float t_prev = 0.0f;
+    uint32_t num_visited = 0;
+
+    while (t < t_end) {
+        if (pos.x < 0 || pos.x >= grid_x ||
+            pos.y < 0 || pos.y >= grid_y ||
+            pos.z < 0 || pos.z >= grid_z) break;
+
+        const uint32_t voxel_idx = (uint32_t)pos.z * grid_y * grid_x + (uint32_t)pos.y * grid_x + (uint32_t)pos.x;
+
+        float t_current = fminf(t_max.x, fminf(t_max.y, t_max.z));
+        if (t_current > t_end) break;
+
+        float t_segment = t_current - t_prev;
+        if (t_segment > EPSILON) {
+            float world_segment = t_segment * simulation->voxel_size;
+            float t_midpoint = t_prev + t_segment * 0.5f;
+            float total_world_dist = ray->total_distance + (t_midpoint * simulation->voxel_size);
+            float dist_from_source = fmaxf(total_world_dist, 0.1f);
+            float intensity_factor = 1.0f / (1.0f + dist_from_source * 0.01f);
+            float air_absorbtion = expf(-0.01f * total_world_dist);
+            AT_Bands energy_deposit = ray->energy * (world_segment / world_ray_length) * intensity_factor * air_absorbtion;
+            float curr_time = total_world_dist / 50.0f;
+            size_t bin_index = (size_t)(curr_time / simulation->bin_width);
+
+            AT_Voxel *voxel = &simulation->voxel_grid[voxel_idx];
+            const AT_Bands empty = AT_bands_splat(0.0f);
+            while (voxel->count <= bin_index) {
+                AT_voxel_bin_append(voxel, &empty);
+            }
+            AT_voxel_add_energy(voxel, &energy_deposit, bin_index);
+            num_visited++;
+        }
+
+        t_prev = t_current;
+        t = t_current;
+
+        if (t_max.x < t_max.y && t_max.x < t_max.z) {
+            pos.x += step.x;
+            t_max.x += delta.x;
+        } else if (t_max.y < t_max.z) {
+            pos.y += step.y;
+            t_max.y += delta.y;
+        } else {
+            pos.z += step.z;
+            t_max.z += delta.z;
+        }
+    }
+    return num_visited;
+}
+
+typedef uint32_t (*AT_RayStepFunc)(AT_Simulation *, const AT_Ray *, AT_Vec3);
+
+// the current kernel depositing into the simulation's own grid
+static uint32_t grid_ray_step(AT_Simulation *simulation, const AT_Ray *ray, AT_Vec3 ray_end)
+{
+    return AT_voxel_ray_step(simulation, simulation->voxel_grid, ray, ray_end);
+}
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double grid_energy(const AT_Simulation *sim)
+{
+    double sum = 0.0;
+    for (uint32_t i = 0; i < sim->num_voxels; i++) {
+        for (size_t b = 0; b < sim->voxel_grid[i].count; b++) {
+            sum += AT_bands_sum(sim->voxel_grid[i].items[b]);
+        }
+    }
+    return sum;
+}
+
+static void grid_reset(AT_Simulation *sim)
+{
+    for (uint32_t i = 0; i < sim->num_voxels; i++) {
+        AT_voxel_cleanup(&sim->voxel_grid[i]);
+    }
+}
+
+static void run(const char *name, AT_RayStepFunc step_func, AT_Simulation *sim,
+                const AT_Ray *rays, const AT_Vec3 *ends)
+{
+    // warm pass so both kernels are timed with the bin memory already reserved
+    for (uint32_t i = 0; i < NUM_SEGMENTS; i++) step_func(sim, &rays[i], ends[i]);
+    for (uint32_t i = 0; i < sim->num_voxels; i++) AT_da_clear(&sim->voxel_grid[i]);
+
+    uint64_t num_visited = 0;
+    double start = now_seconds();
+    for (uint32_t i = 0; i < NUM_SEGMENTS; i++) {
+        num_visited += step_func(sim, &rays[i], ends[i]);
+    }
+    double elapsed = now_seconds() - start;
+
+    printf("%-10s %10.3f ms  %12llu voxels  %8.2f Mvoxels/s  energy %.6f\n",
+           name, elapsed * 1e3, (unsigned long long)num_visited,
+           num_visited / elapsed * 1e-6, grid_energy(sim));
+    grid_reset(sim);
+}
+
+int main()
+{
+    printf("Voxel Ray Step Benchmark\n");
+    srand(42);
+
+    AT_Simulation sim = {
+        .origin = AT_vec3_zero(),
+        .grid_dimensions = {{GRID_SIZE, GRID_SIZE, GRID_SIZE}},
+        .voxel_size = VOXEL_SIZE,
+        .bin_width = 1.0f / FPS,
+        .inv_bin_width = (float)FPS,
+        // the reference kernel hardcodes the legacy model at 50 m/s
+        .speed_of_sound = 50.0f,
+        .air_coefficient = {0.01f, 0.01f, 0.01f, 0.01f, 0.01f, 0.01f, 0.01f, 0.01f},
+        .attenuation = AT_ATTENUATION_LEGACY,
+        .num_voxels = GRID_SIZE * GRID_SIZE * GRID_SIZE,
+        .fps = FPS,
+    };
+    sim.voxel_grid = calloc(sim.num_voxels, sizeof(AT_Voxel));
+    AT_Ray *rays = malloc(sizeof(AT_Ray) * NUM_SEGMENTS);
+    AT_Vec3 *ends = malloc(sizeof(AT_Vec3) * NUM_SEGMENTS);
+    if (!sim.voxel_grid || !rays || !ends) {
+        fprintf(stderr, "Error allocating benchmark data\n");
+        return 1;
+    }
+
+    const float extent = GRID_SIZE * VOXEL_SIZE;
+    for (uint32_t i = 0; i < NUM_SEGMENTS; i++) {
+        AT_Vec3 origin = AT_vec3(AT_get_random_float() * extent,
+                                 AT_get_random_float() * extent,
+                                 AT_get_random_float() * extent);
+        AT_Vec3 direction = AT_vec3(AT_get_random_float() - 0.5f,
+                                    AT_get_random_float() - 0.5f,
+                                    AT_get_random_float() - 0.5f);
+        rays[i] = AT_ray_init(origin, direction, AT_get_random_float() * 10.0f, 1.0f / NUM_SEGMENTS, i);
+        ends[i] = AT_ray_at(&rays[i], AT_get_random_float() * extent);
+    }
+
+    printf("grid %d^3, %d segments\n", GRID_SIZE, NUM_SEGMENTS);
+    run("reference", reference_ray_step, &sim, rays, ends);
+    run("dda", grid_ray_step, &sim, rays, ends);
+    sim.deposition = AT_DEPOSITION_ACCURATE;
+    run("accurate", grid_ray_step, &sim, rays, ends);
+
+    free(sim.voxel_grid);
+    free(rays);
+    free(ends);
+    return 0;
+}
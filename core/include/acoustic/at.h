@@ -6,9 +6,18 @@
 #define AT_H
 
 #include "acoustic/at_math.h"
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 
+/** \brief Number of octave bands energy is tracked in, centred from 63Hz to 8kHz.
+    \ingroup sim
+
+    Sources emit their energy split equally among the bands, so the bands
+    of a voxel or receiver bin sum to its broadband energy.
+ */
+#define AT_NUM_BANDS 8
+
 /** \addtogroup mat Material Effects
     \ingroup scene
  */
@@ -16,6 +25,8 @@
 typedef struct AT_Model AT_Model;
 typedef struct AT_Scene AT_Scene;
 typedef struct AT_Simulation AT_Simulation;
+typedef struct AT_ResultStore AT_ResultStore;
+typedef struct AT_CancelToken AT_CancelToken;
 
 /** \enum AT_Result
     \brief Defines possible result types.
@@ -26,7 +37,9 @@ typedef enum {
     AT_ERR_INVALID_ARGUMENT, /**< Incorrect arguments were given to the function.
                               */
     AT_ERR_ALLOC_ERROR,      /**< Memory allocation failed. */
-    AT_ERR_NETWORK_FAILURE   /**< Network failure.  */
+    AT_ERR_NETWORK_FAILURE,  /**< Network failure.  */
+    AT_ERR_IO_FAILURE,       /**< Reading, writing or mapping a file failed. */
+    AT_ERR_CANCELLED         /**< The run was cancelled or went past its time limit. */
 } AT_Result;
 
 /** \enum AT_MaterialType
@@ -41,12 +54,57 @@ typedef enum {
     AT_MATERIAL_COUNT,
 } AT_MaterialType;
 
-/** \brief Holds the material absorption and scattering coefficients.
+/** \brief Marks a triangle whose glTF material did not map onto an AT_MaterialType.
+    \ingroup mat
+ */
+#define AT_MATERIAL_UNASSIGNED 0xFF
+
+/** \brief Maps a glTF material name onto an AT_MaterialType.
+    \ingroup mat
+ */
+typedef struct {
+    const char *name;         /**< glTF material name, matched case-insensitively. */
+    AT_MaterialType material; /**< Material used for primitives with that name. */
+} AT_MaterialMapping;
+
+/** \enum AT_DepositionMode
+    \brief Defines how ray energy is deposited into a voxel's time bins.
+    \ingroup sim
+ */
+typedef enum {
+    AT_DEPOSITION_MIDPOINT, /**< All of a voxel's energy goes into the bin at the voxel midpoint time. */
+    AT_DEPOSITION_ACCURATE, /**< Energy is split across every bin the segment overlaps in time. */
+} AT_DepositionMode;
+
+/** \enum AT_AttenuationModel
+    \brief Defines how ray energy is lost while travelling through air.
+    \ingroup sim
+ */
+typedef enum {
+    AT_ATTENUATION_AIR,       /**< ISO 9613-1 air absorption per band only, spreading comes from the ray density. */
+    AT_ATTENUATION_SPREADING, /**< ISO 9613-1 air absorption plus explicit inverse square spreading. */
+    AT_ATTENUATION_LEGACY,    /**< The original heuristic, `1 / (1 + 0.01d)` falloff and `exp(-0.01d)` air loss. */
+    AT_ATTENUATION_NONE,      /**< No propagation loss, energy is only lost at surfaces. */
+    AT_ATTENUATION_COUNT,
+} AT_AttenuationModel;
+
+/** \brief Physical constants of the medium and the attenuation model applied to rays.
+    \ingroup sim
+ */
+typedef struct {
+    AT_AttenuationModel model; /**< Which propagation loss is applied. */
+    float speed_of_sound;      /**< Speed of sound in m/s, converts distance to time bins. */
+    float temperature;         /**< Air temperature in degrees Celsius. */
+    float humidity;            /**< Relative humidity in percent. */
+    float pressure;            /**< Atmospheric pressure in kPa. */
+} AT_Attenuation;
+
+/** \brief Holds the per octave band material absorption and scattering coefficients.
     \ingroup mat sim
  */
 typedef struct {
-    float absorption; /**< Factor at which energy is lost when the material is hit. */
-    float scattering; /**< Factor at which a ray is deflected when the material is hit. */
+    float absorption[AT_NUM_BANDS]; /**< Factor at which energy is lost when the material is hit. */
+    float scattering[AT_NUM_BANDS]; /**< Factor at which a ray is deflected when the material is hit. */
 } AT_Material;
 
 /** \brief Groups the information required for the sound source.
@@ -65,12 +123,20 @@ typedef struct {
 typedef struct {
     const AT_Source *sources; /**< Dynamic array of AT_Source types. */
     uint32_t num_sources;     /**< Number of sources in the scene. */
-    AT_MaterialType material; /**< Material of the room. */
+    AT_MaterialType material; /**< Material of triangles the model did not assign one to. */
 
     // Borrowed: must remain valid for the entire lifetime of the scene
     const AT_Model *environment; /**< Pointer to the room object. */
 } AT_SceneConfig;
 
+/** \brief A listening position, a sphere that collects the sound of every ray crossing it.
+    \ingroup receiver
+ */
+typedef struct {
+    AT_Vec3 position; /**< Centre of the sphere in world coordinates. */
+    float radius;     /**< Radius in metres, larger ones catch more rays but blur where they listen. */
+} AT_Receiver;
+
 /** \brief The simulation's settings.
     \ingroup sim
  */
@@ -78,14 +144,145 @@ typedef struct {
     float voxel_size;  /**< Renderer's heatmap resolution. */
     uint32_t num_rays; /**< Number of simulated rays. */
     uint8_t fps;       /**< How smooth the final render is. */
+    AT_DepositionMode deposition; /**< How energy is binned in time, defaults to midpoint. */
+    const AT_Attenuation *attenuation; /**< Optional, NULL uses AT_attenuation_default(). */
+    const char *result_path; /**< Optional, bins are deposited straight into this memory mapped result file. */
+    AT_CancelToken *cancel; /**< Optional, cancelling it stops a run in progress from any thread. */
+    float time_limit;       /**< Optional wall-clock seconds a run may take, 0 for no limit. */
+    uint32_t batch_rays;    /**< Optional rays per source traced and deposited per batch, 0 traces all at once. */
+    float target_error;     /**< Optional relative error a batched run stops at before num_rays, 0 runs every ray. */
+    const AT_AABB *error_region; /**< Optional world box target_error is measured over, NULL for the whole grid. */
+    bool source_channels;   /**< Optional, keeps every source's energy apart so AT_simulation_mix_sources()
+                                 can re-weight them without tracing again, one extra grid of bins per source. */
+    const AT_Receiver *receivers; /**< Optional spheres each run records an energy-time curve at, copied. */
+    uint32_t num_receivers;       /**< Number of receivers. */
+    float receiver_bin_width;     /**< Optional seconds per energy-time curve bin, 0 for 1 ms. */
+    uint32_t image_source_order;  /**< Optional, receivers hear specular reflections up to this order from
+                                       image sources before crossover_time and the rays only after it, 0 for rays only,
+                                       at most 8 and 2^18 images of a source. */
+    float crossover_time;         /**< Optional seconds the receivers switch from image sources to rays at,
+                                       0 for image_source_order mean free paths. */
 } AT_Settings;
 
+/** \brief Energy arriving at a receiver over time, see AT_simulation_receiver_etc().
+    \ingroup receiver
+ */
+typedef struct {
+    const float *energy;    /**< num_bins * AT_NUM_BANDS energies per square metre, bin major, from emission on. */
+    const float *direction; /**< num_bins * 3, sum of the directions sound arrived from weighted by its
+                                 broadband energy, each points from the receiver back along the ray. */
+    uint32_t num_bins;      /**< Bins in the curve. */
+    float bin_width;        /**< Length of a bin in seconds. */
+} AT_EnergyTimeCurve;
+
+/** \brief Room acoustic parameters of an energy-time curve per octave band, NaN where the
+           curve is empty or does not decay far enough to measure one.
+    \ingroup receiver
+ */
+typedef struct {
+    float rt60[AT_NUM_BANDS]; /**< Reverberation time in seconds, extrapolated from the -5 to -35 dB decay,
+                                   or -5 to -25 dB when the curve ends before -35 dB. */
+    float edt[AT_NUM_BANDS];  /**< Early decay time in seconds, extrapolated from the 0 to -10 dB decay. */
+    float c80[AT_NUM_BANDS];  /**< Clarity in dB, energy of the first 80 ms after the direct sound over the rest. */
+} AT_RoomAcoustics;
+
+/** \brief Describes the grid and timeline held by an AT_ResultStore.
+    \ingroup store
+ */
+typedef struct {
+    uint32_t num_frames;      /**< Time bins per voxel. */
+    uint32_t num_voxels;      /**< Voxels in the grid, x fastest then y then z. */
+    uint32_t grid[3];         /**< Voxels along x, y and z. */
+    AT_Vec3 origin;           /**< World position of the grid's min corner. */
+    float voxel_size;         /**< Edge length of a voxel in metres. */
+    float bin_width;          /**< Length of a frame in seconds. */
+} AT_ResultInfo;
+
+/** \brief A block of frames over a box of voxels, read with AT_result_store_read().
+    \ingroup store
+ */
+typedef struct {
+    uint32_t frame_start; /**< First frame. */
+    uint32_t frame_end;   /**< One past the last frame. */
+    uint32_t min[3];      /**< Inclusive min voxel coordinate. */
+    uint32_t max[3];      /**< Exclusive max voxel coordinate. */
+} AT_ResultSlice;
+
+/** \enum AT_SimulationPhase
+    \brief Stage AT_simulation_run() is in, reported by AT_simulation_progress().
+    \ingroup sim
+ */
+typedef enum {
+    AT_PHASE_IDLE,       /**< Created, AT_simulation_run() has not started. */
+    AT_PHASE_TRACING,    /**< Following rays through the scene and spawning their reflections. */
+    AT_PHASE_DEPOSITING, /**< Walking the traced paths through the voxel grid. */
+    AT_PHASE_DONE,       /**< AT_simulation_run() returned successfully. */
+    AT_PHASE_CANCELLED,  /**< AT_simulation_run() stopped early with AT_ERR_CANCELLED. */
+} AT_SimulationPhase;
+
+/** \brief Snapshot of a running simulation's counters.
+    \ingroup sim
+ */
+typedef struct {
+    AT_SimulationPhase phase; /**< Current stage of the run. */
+    uint32_t rays_total;      /**< Primary rays of the run, num_sources * num_rays. */
+    uint32_t rays_traced;     /**< Primary rays whose reflection path is complete. */
+    uint32_t rays_deposited;  /**< Primary rays whose path has been deposited into the grid,
+                                   the share of deposited segments for a progressive run. */
+    uint64_t bounces;         /**< Reflections spawned so far across all traced rays. */
+} AT_SimulationProgress;
+
+/** \brief Called by AT_simulation_run_progressive() whenever more frames are final.
+    \ingroup sim
+
+    Frames [0, num_final_frames) hold their final energy and may be read from the
+    voxel bins, the last call covers every frame. Anything but AT_OK stops the run,
+    which then returns that result.
+ */
+typedef AT_Result (*AT_FramesReadyFunc)(void *user_data, uint32_t num_final_frames);
+
+/** \brief State of a batched run after one of its batches, see AT_simulation_run_batched().
+    \ingroup sim
+ */
+typedef struct {
+    uint32_t rays_done;   /**< Rays per source traced and deposited so far. */
+    uint32_t num_rays;    /**< Rays per source the simulation was created with. */
+    float scale;          /**< num_rays / rays_done, bins times this are the normalised estimate so far. */
+    float relative_error; /**< Estimated relative RMS error of the voxel energies in the error region,
+                               negative after the first batch. */
+} AT_BatchProgress;
+
+/** \brief Called by AT_simulation_run_batched() after every batch of rays.
+    \ingroup sim
+
+    The voxel bins hold every batch so far and may be read until it returns,
+    scaled by batch->scale. Anything but AT_OK stops the run, which then
+    returns that result.
+ */
+typedef AT_Result (*AT_BatchReadyFunc)(void *user_data, const AT_BatchProgress *batch);
+
 // Model
 AT_Result AT_model_create(
     AT_Model **out_model,
     const char *filepath
 );
 
+AT_Result AT_model_create_with_materials(
+    AT_Model **out_model,
+    const char *filepath,
+    const AT_MaterialMapping *mappings,
+    uint32_t num_mappings
+);
+
+// glb bytes in memory, e.g. an upload, parsed in place without touching disk
+AT_Result AT_model_create_from_memory(
+    AT_Model **out_model,
+    const void *glb,
+    size_t size,
+    const AT_MaterialMapping *mappings,
+    uint32_t num_mappings
+);
+
 void AT_model_destroy(
     AT_Model *model
 );
@@ -106,6 +303,9 @@ void AT_scene_destroy(
 );
 
 // Simulation
+// 20 degrees, 50% humidity, sea level air with the AT_ATTENUATION_AIR model
+AT_Attenuation AT_attenuation_default(void);
+
 // Creates the simulation "object" and allocates voxel memory
 AT_Result AT_simulation_create(
     AT_Simulation **out_simulation,
@@ -118,8 +318,115 @@ AT_Result AT_simulation_run(
     AT_Simulation *simulation
 );
 
+// Deposits in time order, handing each frame to on_frames as soon as no later
+// segment can reach it, bins may differ from AT_simulation_run in the last bits
+AT_Result AT_simulation_run_progressive(
+    AT_Simulation *simulation,
+    AT_FramesReadyFunc on_frames, // NULL is AT_simulation_run
+    void *user_data
+);
+
+// Traces and deposits AT_Settings.batch_rays at a time, handing each snapshot to
+// on_batch, stops early once AT_Settings.target_error is reached
+AT_Result AT_simulation_run_batched(
+    AT_Simulation *simulation,
+    AT_BatchReadyFunc on_batch, // NULL only stops early
+    void *user_data
+);
+
+// Moves a source for the next run, which only re-traces the rays of moved sources
+AT_Result AT_simulation_set_source(
+    AT_Simulation *simulation,
+    uint32_t index,
+    const AT_Source *source
+);
+
+// Swaps AT_Settings.cancel of a simulation that is run again, NULL for none
+void AT_simulation_set_cancel(
+    AT_Simulation *simulation,
+    AT_CancelToken *cancel
+);
+
+// Re-sums the per source channels into the bins with new energy gains, no re-trace
+AT_Result AT_simulation_mix_sources(
+    AT_Simulation *simulation,
+    const float *gains // num_sources
+);
+
+// Relative standard error of every voxel's energy after a batched run, -1 where unknown
+AT_Result AT_simulation_voxel_errors(
+    const AT_Simulation *simulation,
+    float *out_errors // num_voxels
+);
+
 void AT_simulation_destroy(
     AT_Simulation *simulation
 );
 
+// Receivers
+// Energy-time curve one of AT_Settings.receivers recorded in the last run,
+// valid until the next run or mix
+AT_Result AT_simulation_receiver_etc(
+    const AT_Simulation *simulation,
+    uint32_t receiver,
+    AT_EnergyTimeCurve *out_etc
+);
+
+// RT60, EDT and C80 from the Schroeder decay of an energy-time curve
+AT_Result AT_etc_room_acoustics(
+    const AT_EnergyTimeCurve *etc,
+    AT_RoomAcoustics *out_acoustics
+);
+
+// Cancellation, a token may be shared by several runs and outlives them
+AT_Result AT_cancel_token_create(
+    AT_CancelToken **out_token
+);
+
+// Safe to call from any thread, runs using the token stop at their next check
+void AT_cancel_token_cancel(
+    AT_CancelToken *token
+);
+
+bool AT_cancel_token_is_cancelled(
+    const AT_CancelToken *token
+);
+
+void AT_cancel_token_destroy(
+    AT_CancelToken *token
+);
+
+// Safe to call from another thread while AT_simulation_run is in progress
+AT_SimulationProgress AT_simulation_progress(
+    const AT_Simulation *simulation
+);
+
+// Result store
+// Opens a result file written by a simulation with AT_Settings.result_path
+AT_Result AT_result_store_open(
+    AT_ResultStore **out_store,
+    const char *path
+);
+
+void AT_result_store_close(
+    AT_ResultStore *store
+);
+
+AT_ResultInfo AT_result_store_info(
+    const AT_ResultStore *store
+);
+
+// Zero copy num_frames * AT_NUM_BANDS energies of one voxel
+const float *AT_result_store_voxel(
+    const AT_ResultStore *store,
+    uint32_t voxel
+);
+
+// Broadband energies of a slice, out_energy[((f * nz + z) * ny + y) * nx + x] relative to the slice
+AT_Result AT_result_store_read(
+    const AT_ResultStore *store,
+    const AT_ResultSlice *slice,
+    float *out_energy
+);
+
 #endif // AT_H
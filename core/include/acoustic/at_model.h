@@ -27,6 +27,49 @@ typedef struct AT_Model AT_Model;
 */
 AT_Result AT_model_create(AT_Model **out_model, const char *filepath);
 
+/** \brief AT_Model constructor that maps glTF material names through a user table.
+    \relatesalso AT_Model
+    \ingroup model
+
+    Each primitive's material name is first looked up in \a mappings, then
+    matched against the AT_MaterialType names (e.g. "Oak_Wood" -> wood).
+    Triangles that match neither are AT_MATERIAL_UNASSIGNED and take the
+    scene's material.
+
+    \param out_model Pointer to an empty initialised AT_Model.
+    \param filepath String showing the location of the file.
+    \param mappings Array of name -> material mappings, may be NULL.
+    \param num_mappings Number of entries in \a mappings.
+
+    \retval AT_Result Saves the created model at the location of the pointer, returning a result enum value.
+*/
+AT_Result AT_model_create_with_materials(AT_Model **out_model,
+                                         const char *filepath,
+                                         const AT_MaterialMapping *mappings,
+                                         uint32_t num_mappings);
+
+/** \brief AT_Model constructor for a `glb` already in memory, e.g. an upload.
+    \relatesalso AT_Model
+    \ingroup model
+
+    The bytes are parsed in place and never written to disk. Only the GLB's
+    own binary chunk and `data:` URIs can back its buffers, external files are
+    not resolved. Materials map as in AT_model_create_with_materials().
+
+    \param out_model Pointer to an empty initialised AT_Model.
+    \param glb The `glb` file contents, only read during the call.
+    \param size Size of \a glb in bytes.
+    \param mappings Array of name -> material mappings, may be NULL.
+    \param num_mappings Number of entries in \a mappings.
+
+    \retval AT_Result Saves the created model at the location of the pointer, returning a result enum value.
+*/
+AT_Result AT_model_create_from_memory(AT_Model **out_model,
+                                      const void *glb,
+                                      size_t size,
+                                      const AT_MaterialMapping *mappings,
+                                      uint32_t num_mappings);
+
 /** \brief Calculates the min and max of a model for AABB collision.
     \relatesalso AT_AABB
     \ingroup model
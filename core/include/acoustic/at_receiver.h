@@ -0,0 +1,60 @@
+/** \file
+    \brief Receivers and room acoustic parameters
+    \ingroup receiver
+*/
+
+#ifndef AT_RECEIVER_H
+#define AT_RECEIVER_H
+
+#include "at.h"
+
+/** \defgroup receiver Receivers */
+
+/** \brief Energy-time curve a receiver recorded in the last run.
+    \relatesalso AT_Simulation
+    \ingroup receiver
+
+    Every run collects the energy of each ray segment that crosses one of
+    AT_Settings.receivers into bins of AT_Settings.receiver_bin_width by
+    the time it arrives, weighted by the length of its chord through the
+    sphere over the sphere's volume. Spreading shows in how densely rays
+    cross the sphere, so of the attenuation model only its air absorption
+    is applied. The curve is the impulse response of
+    the room between the sources and the receiver in energy per square
+    metre, with the direction the sound arrived from in every bin. With
+    AT_Settings.source_channels it follows AT_simulation_mix_sources().
+
+    With AT_Settings.image_source_order the bins before
+    AT_Settings.crossover_time hold the specular reflections of the image
+    sources instead, every path checked against the scene, exact and the
+    same every run, and the rays only add the later ones.
+
+    \param simulation Pointer to a simulation created with receivers.
+    \param receiver Index into AT_Settings.receivers.
+    \param out_etc Set to the curve, whose arrays are owned by the simulation
+    and valid until it is run, mixed or destroyed. num_bins is 0 before the
+    first run.
+
+    \retval AT_Result AT_ERR_INVALID_ARGUMENT when the receiver does not exist.
+*/
+AT_Result AT_simulation_receiver_etc(const AT_Simulation *simulation, uint32_t receiver,
+                                     AT_EnergyTimeCurve *out_etc);
+
+/** \brief RT60, EDT and C80 of an energy-time curve.
+    \ingroup receiver
+
+    Each band's decay is the Schroeder backward integral of the curve from
+    the first bin sound arrived in. RT60 and EDT are extrapolated to 60 dB
+    from least squares fits over part of it, C80 compares the energy of the
+    first 80 ms with the rest. The curve ends where the tracer stops following
+    rays, and few rays leave its late bins sparse, both shorten the measured
+    decay of a reverberant room.
+
+    \param etc Curve from AT_simulation_receiver_etc() or any other source.
+    \param out_acoustics Set per band, NaN where a parameter can not be measured.
+
+    \retval AT_Result AT_ERR_ALLOC_ERROR when the decay can not be allocated.
+*/
+AT_Result AT_etc_room_acoustics(const AT_EnergyTimeCurve *etc, AT_RoomAcoustics *out_acoustics);
+
+#endif // AT_RECEIVER_H
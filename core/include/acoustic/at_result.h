@@ -44,6 +44,16 @@ static inline void AT_handle_result(const AT_Result res, const char *err_msg, ..
             vfprintf(stderr, err_msg, args);
             fprintf(stderr, "NETWORK_FAILURE\n");
             break;
+
+        case AT_ERR_IO_FAILURE:
+            vfprintf(stderr, err_msg, args);
+            fprintf(stderr, "IO FAILURE\n");
+            break;
+
+        case AT_ERR_CANCELLED:
+            vfprintf(stderr, err_msg, args);
+            fprintf(stderr, "CANCELLED\n");
+            break;
     }
     va_end(args);
 }
@@ -40,8 +40,195 @@ void AT_simulation_destroy(AT_Simulation *simulation);
     \relatesalso AT_Simulation
     \ingroup sim
 
+    A run whose settings carry a cancel token or a time limit checks both every
+    few dozen rays while tracing and every few thousand segments while depositing,
+    and returns AT_ERR_CANCELLED as soon as either fired. The bins then hold an
+    incomplete result that should only be destroyed.
+
     \param simulation Pointer to the simulation.
 
-    \retval AT_Result A result enum value which must be checked for errors.
+    With AT_Settings.batch_rays set this is AT_simulation_run_batched() without
+    a callback.
+
+    A simulation may be run again, e.g. after AT_simulation_set_source(). The
+    bins are emptied in place, keeping their memory, and only the sources that
+    moved since the last complete run are emitted and traced again, the paths
+    of the others are deposited as they are.
+
+    \retval AT_Result A result enum value which must be checked for errors,
+    AT_ERR_CANCELLED when the run was stopped early.
 */
 AT_Result AT_simulation_run(AT_Simulation *simulation);
+
+/** \brief Runs the simulation, streaming frames out as they become final.
+    \relatesalso AT_Simulation
+    \ingroup sim
+
+    Tracing is the same as AT_simulation_run(). Deposition then walks the ray
+    segments in order of their start time instead of ray by ray: a segment only
+    deposits energy at or after the time it starts, so once every segment that
+    starts within frame b has been deposited, frames 0 to b are final. on_frames
+    is called each time that boundary moves, from the calling thread, so the
+    first frames can be sent while later ones are still being deposited.
+
+    Bins hold the same contributions as with AT_simulation_run(), summed in a
+    different order, so they can differ in the last bits.
+
+    \param simulation Pointer to the simulation.
+    \param on_frames Called with the number of leading frames that are final, NULL
+    deposits ray by ray exactly like AT_simulation_run().
+    \param user_data Passed through to on_frames.
+
+    \retval AT_Result A result enum value which must be checked for errors, or
+    whatever on_frames returned if it stopped the run. AT_ERR_INVALID_ARGUMENT
+    for a batched simulation, its frames are never final before the last batch.
+*/
+AT_Result AT_simulation_run_progressive(AT_Simulation *simulation,
+                                        AT_FramesReadyFunc on_frames,
+                                        void *user_data);
+
+/** \brief Runs the simulation in batches of rays, refining the result as it goes.
+    \relatesalso AT_Simulation
+    \ingroup sim
+
+    Traces and deposits AT_Settings.batch_rays rays per source at a time and
+    calls on_batch after each batch, so a viewer can show a noisy result after
+    the first percent of the rays and watch it converge. Rays keep their
+    1 / num_rays share of the source energy, a snapshot is normalised by
+    multiplying the bins with AT_BatchProgress.scale.
+
+    Every batch is an independent estimate of each voxel's energy, the spread
+    between batches gives the relative error of the running estimate. Once it
+    falls below AT_Settings.target_error, after at least four batches, the run
+    stops early and rescales the bins itself, so the result reads like that of
+    a full run with fewer rays. num_rays is then the budget rather than the ray
+    count, and an AT_Settings.error_region around e.g. the seats measures the
+    error only where it matters, so noise elsewhere does not keep the run going.
+    The per voxel statistics stay with the simulation, see
+    AT_simulation_voxel_errors().
+
+    With every ray traced the bins hold what AT_simulation_run() deposits, for
+    a single source in the same order and so bit for bit. A result file
+    (AT_Settings.result_path) is only written once the last batch is in.
+
+    \param simulation Pointer to the simulation.
+    \param on_batch Called after every batch, NULL only checks the error target.
+    \param user_data Passed through to on_batch.
+
+    \retval AT_Result A result enum value which must be checked for errors, or
+    whatever on_batch returned if it stopped the run.
+*/
+AT_Result AT_simulation_run_batched(AT_Simulation *simulation,
+                                    AT_BatchReadyFunc on_batch,
+                                    void *user_data);
+
+/** \brief Moves a source of the simulation without rebuilding anything.
+    \relatesalso AT_Simulation
+    \ingroup sim
+
+    The simulation keeps its own copy of the scene's sources, so the scene, its
+    BVH and the simulation's voxel and ray memory all stay as they are. The next
+    run re-traces the rays of this source only, which makes dragging a source
+    around interactive. A batched run always re-traces every source.
+
+    \param simulation Pointer to a simulation that is not running.
+    \param index Source of the scene config the simulation was created from.
+    \param source New position and direction, the direction is normalised.
+
+    \retval AT_Result AT_ERR_INVALID_ARGUMENT for an index past the scene's sources.
+*/
+AT_Result AT_simulation_set_source(AT_Simulation *simulation, uint32_t index, const AT_Source *source);
+
+/** \brief Replaces the cancel token of a simulation before running it again.
+    \relatesalso AT_Simulation
+    \ingroup sim
+
+    A token is never reset, so a simulation that is kept and run again needs the
+    token of the new run. NULL makes the run uncancellable.
+*/
+void AT_simulation_set_cancel(AT_Simulation *simulation, AT_CancelToken *cancel);
+
+/** \brief Re-weights the sources of a simulation without tracing them again.
+    \relatesalso AT_Simulation
+    \ingroup sim
+
+    Energy adds up linearly, so with AT_Settings.source_channels the bins are the
+    sum of one channel per source times its gain, and changing a gain only sums
+    the channels again, e.g. while adjusting speaker levels. A gain of 0 mutes a
+    source, gains of 1 for one source and 0 for the rest solo it. The gains stay
+    for later runs, before the first run this only sets them. Frame indices built
+    before the mix hold the old energies and need building again. The energy-time
+    curves of AT_Settings.receivers are mixed along with the bins.
+
+    With channels a run after AT_simulation_set_source() also only deposits the
+    moved sources again, the other channels keep their bins.
+
+    \param simulation Pointer to a simulation created with source_channels, not running.
+    \param gains One energy gain per source of the scene, 1 is the level it was traced at.
+
+    \retval AT_Result AT_ERR_INVALID_ARGUMENT without channels or for a negative gain.
+*/
+AT_Result AT_simulation_mix_sources(AT_Simulation *simulation, const float *gains);
+
+/** \brief Reads the estimated error of every voxel after a batched run.
+    \relatesalso AT_Simulation
+    \ingroup sim
+
+    The error is the standard error of the voxel's energy summed over its whole
+    timeline relative to that energy, from the spread between the batches. It
+    is only kept per voxel rather than per bin, which would double the memory
+    of the result.
+
+    \param simulation Pointer to a simulation run with AT_simulation_run_batched().
+    \param out_errors num_voxels floats, x fastest then y then z, -1 for voxels no
+    ray reached and for runs of a single batch.
+
+    \retval AT_Result AT_ERR_INVALID_ARGUMENT before a batched run.
+*/
+AT_Result AT_simulation_voxel_errors(const AT_Simulation *simulation, float *out_errors);
+
+/** \brief Creates a token that stops the runs it is passed to.
+    \relatesalso AT_CancelToken
+    \ingroup sim
+
+    Set AT_Settings.cancel to the token before creating a simulation, then
+    AT_cancel_token_cancel() from any thread stops its run at the next check.
+    A token is never reset, cancelled runs need a fresh one to run again.
+
+    \param out_token Pointer to an empty AT_CancelToken pointer.
+
+    \retval AT_Result A result enum value which must be checked for errors.
+*/
+AT_Result AT_cancel_token_create(AT_CancelToken **out_token);
+
+/** \brief Cancels every run using the token, safe to call from any thread.
+    \relatesalso AT_CancelToken
+    \ingroup sim
+*/
+void AT_cancel_token_cancel(AT_CancelToken *token);
+
+/** \brief Whether AT_cancel_token_cancel() was called, false for a NULL token.
+    \relatesalso AT_CancelToken
+    \ingroup sim
+*/
+bool AT_cancel_token_is_cancelled(const AT_CancelToken *token);
+
+/** \brief Destroys a token, no simulation may still be using it.
+    \relatesalso AT_CancelToken
+    \ingroup sim
+*/
+void AT_cancel_token_destroy(AT_CancelToken *token);
+
+/** \brief Reads the progress counters of a simulation.
+    \relatesalso AT_Simulation
+    \ingroup sim
+
+    The counters are published by AT_simulation_run() as it goes, so another
+    thread may poll them while the run is in progress, e.g. to report progress
+    of a long job. Counts within one snapshot may be a ray apart.
+
+    \param simulation Pointer to the simulation.
+
+    \retval AT_SimulationProgress Phase and counters at the time of the call.
+*/
+AT_SimulationProgress AT_simulation_progress(const AT_Simulation *simulation);
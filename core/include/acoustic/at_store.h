@@ -0,0 +1,84 @@
+/** \file
+    \brief AT_ResultStore and related functions
+    \ingroup store
+*/
+
+#ifndef AT_STORE_H
+#define AT_STORE_H
+
+#include "at.h"
+
+/** \defgroup store Result Store */
+
+/** \struct AT_ResultStore
+    \brief A simulation result persisted to a memory mapped file.
+    \ingroup store
+
+    Setting AT_Settings.result_path makes AT_simulation_run() deposit energy
+    straight into a page aligned, voxel major file instead of heap bins.
+    The file is sized to the whole timeline but only the pages a ray touched
+    are ever written, so it stays sparse on disk and the OS can page bins
+    out to it when a run is larger than memory.
+ */
+typedef struct AT_ResultStore AT_ResultStore;
+
+/** \brief Opens a result file read only.
+    \relatesalso AT_ResultStore
+    \ingroup store
+
+    \param out_store Pointer to an empty initialised AT_ResultStore.
+    \param path Location of a file written through AT_Settings.result_path.
+
+    \retval AT_Result AT_ERR_IO_FAILURE when the file can not be mapped or is
+    not a result file.
+*/
+AT_Result AT_result_store_open(AT_ResultStore **out_store, const char *path);
+
+/** \brief Unmaps and closes a result store.
+    \relatesalso AT_ResultStore
+    \ingroup store
+
+    \param store Pointer to the store, may be NULL.
+*/
+void AT_result_store_close(AT_ResultStore *store);
+
+/** \brief Grid and timeline of the stored result.
+    \relatesalso AT_ResultStore
+    \ingroup store
+
+    \param store Pointer to the store.
+
+    \retval AT_ResultInfo Copy of the stored dimensions.
+*/
+AT_ResultInfo AT_result_store_info(const AT_ResultStore *store);
+
+/** \brief Zero copy access to every bin of one voxel.
+    \relatesalso AT_ResultStore
+    \ingroup store
+
+    \param store Pointer to the store.
+    \param voxel Voxel index, x fastest then y then z.
+
+    \retval const float* num_frames * AT_NUM_BANDS energies, frame major,
+    valid until the store is closed. NULL when \a voxel is out of range.
+*/
+const float *AT_result_store_voxel(const AT_ResultStore *store, uint32_t voxel);
+
+/** \brief Reads the broadband energy of a frame range over a box of voxels.
+    \relatesalso AT_ResultStore
+    \ingroup store
+
+    Only the pages backing the requested voxels are touched.
+
+    \param store Pointer to the store.
+    \param slice Frames and voxel box to read, must lie within the store.
+    \param out_energy Receives (frame_end - frame_start) * nx * ny * nz floats,
+    indexed ((f * nz + z) * ny + y) * nx + x relative to the slice.
+
+    \retval AT_Result AT_ERR_INVALID_ARGUMENT when the slice is empty or out of range.
+*/
+AT_Result AT_result_store_read(const AT_ResultStore *store,
+                               const AT_ResultSlice *slice,
+                               float *out_energy);
+
+#endif // AT_STORE_H
@@ -0,0 +1,62 @@
+#include "at_attenuation.h"
+#include "acoustic/at.h"
+
+#include <math.h>
+#include <stdbool.h>
+
+#define AT_KELVIN_OFFSET 273.15
+#define AT_REFERENCE_TEMPERATURE 293.15  // K, ISO 9613-1 reference air temperature
+#define AT_TRIPLE_POINT_TEMPERATURE 273.16 // K, triple point of water
+
+AT_Attenuation AT_attenuation_default(void)
+{
+    return (AT_Attenuation){
+        .model = AT_ATTENUATION_AIR,
+        .speed_of_sound = AT_SPEED_OF_SOUND,
+        .temperature = 20.0f,
+        .humidity = 50.0f,
+        .pressure = AT_REFERENCE_PRESSURE,
+    };
+}
+
+bool AT_attenuation_is_valid(const AT_Attenuation *attenuation)
+{
+    if (!attenuation) return false;
+    if (attenuation->model >= AT_ATTENUATION_COUNT) return false;
+    if (attenuation->speed_of_sound <= 0.0f) return false;
+    if (attenuation->temperature <= -AT_KELVIN_OFFSET) return false;
+    if (attenuation->humidity < 0.0f || attenuation->humidity > 100.0f) return false;
+    if (attenuation->pressure <= 0.0f) return false;
+    return true;
+}
+
+// ISO 9613-1:1993 equations (3) - (5), computed in double since the
+// relaxation terms span many orders of magnitude
+float AT_attenuation_air_coefficient(float frequency, float temperature, float humidity, float pressure)
+{
+    const double f2 = (double)frequency * frequency;
+    const double t = temperature + AT_KELVIN_OFFSET;
+    const double t_rel = t / AT_REFERENCE_TEMPERATURE;
+    const double p_rel = pressure / AT_REFERENCE_PRESSURE;
+
+    //molar concentration of water vapour in percent (annex B)
+    const double c = -6.8346 * pow(AT_TRIPLE_POINT_TEMPERATURE / t, 1.261) + 4.6151;
+    const double h = humidity * pow(10.0, c) / p_rel;
+
+    //relaxation frequencies of oxygen and nitrogen
+    const double fr_o = p_rel * (24.0 + 4.04e4 * h * (0.02 + h) / (0.391 + h));
+    const double fr_n = p_rel * pow(t_rel, -0.5) *
+        (9.0 + 280.0 * h * exp(-4.170 * (pow(t_rel, -1.0 / 3.0) - 1.0)));
+
+    //pure tone attenuation in dB/m
+    const double alpha = 8.686 * f2 * (
+        1.84e-11 / p_rel * sqrt(t_rel) +
+        pow(t_rel, -2.5) * (
+            0.01275 * exp(-2239.1 / t) / (fr_o + f2 / fr_o) +
+            0.1068 * exp(-3352.0 / t) / (fr_n + f2 / fr_n)
+        )
+    );
+
+    //dB -> energy decay exponent, 10 * log10(e)
+    return (float)(alpha / 4.342944819);
+}
@@ -0,0 +1,28 @@
+#ifndef AT_ATTENUATION_H
+#define AT_ATTENUATION_H
+
+#include "acoustic/at.h"
+
+#include <stdbool.h>
+
+#define AT_SPEED_OF_SOUND 343.0f
+#define AT_REFERENCE_PRESSURE 101.325f // kPa
+
+// coefficient the legacy model always used, in 1/m
+#define AT_LEGACY_AIR_COEFFICIENT 0.01f
+
+/** \brief Checks an AT_Attenuation holds physically meaningful values. */
+bool AT_attenuation_is_valid(const AT_Attenuation *attenuation);
+
+/** \brief ISO 9613-1 atmospheric absorption for a pure tone.
+
+    \param frequency Frequency in Hz.
+    \param temperature Air temperature in degrees Celsius.
+    \param humidity Relative humidity in percent.
+    \param pressure Atmospheric pressure in kPa.
+
+    \retval float Energy attenuation coefficient m in 1/m, energy decays as `exp(-m * d)`.
+ */
+float AT_attenuation_air_coefficient(float frequency, float temperature, float humidity, float pressure);
+
+#endif // AT_ATTENUATION_H
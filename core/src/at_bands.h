@@ -0,0 +1,78 @@
+#ifndef AT_BANDS_H
+#define AT_BANDS_H
+
+#include "acoustic/at.h"
+
+#include <math.h>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+// per octave band energy, one lane per band
+// GCC vector extension so band arithmetic compiles to packed SIMD ops,
+// alignment is lowered to 16 so it can live in malloc'd / realloc'd memory
+typedef float AT_Bands __attribute__((vector_size(AT_NUM_BANDS * sizeof(float)), aligned(16)));
+
+// octave band centre frequencies in Hz
+static const float AT_BAND_FREQUENCIES[AT_NUM_BANDS] = {
+    63.0f, 125.0f, 250.0f, 500.0f, 1000.0f, 2000.0f, 4000.0f, 8000.0f
+};
+
+// the helpers are macros, without AVX a function passing or returning the 32 byte
+// vector by value gets a -Wpsabi warning in every file it is used in
+
+#define AT_bands_splat(_v) ((AT_Bands){0} + (float)(_v))
+
+#define AT_bands_from_array(_arr) \
+    ({ \
+        const float *_from = (_arr); \
+        AT_Bands _out; \
+        for (int _b = 0; _b < AT_NUM_BANDS; _b++) _out[_b] = _from[_b]; \
+        _out; \
+    })
+
+#define AT_bands_sum(_v) \
+    ({ \
+        const AT_Bands _in = (_v); \
+        float _sum = 0.0f; \
+        for (int _b = 0; _b < AT_NUM_BANDS; _b++) _sum += _in[_b]; \
+        _sum; \
+    })
+
+#define AT_bands_max(_v) \
+    ({ \
+        const AT_Bands _in = (_v); \
+        float _max = _in[0]; \
+        for (int _b = 1; _b < AT_NUM_BANDS; _b++) _max = fmaxf(_max, _in[_b]); \
+        _max; \
+    })
+
+#define AT_bands_exp(_v) \
+    ({ \
+        AT_Bands _out = (_v); \
+        for (int _b = 0; _b < AT_NUM_BANDS; _b++) _out[_b] = expf(_out[_b]); \
+        _out; \
+    })
+
+#if defined(__SSE__)
+// sqrtf keeps errno semantics so the plain loop never vectorises
+#define AT_bands_sqrt(_v) \
+    ({ \
+        const AT_Bands _in = (_v); \
+        AT_Bands _out; \
+        for (int _b = 0; _b < AT_NUM_BANDS; _b += 4) { \
+            _mm_storeu_ps((float *)&_out + _b, _mm_sqrt_ps(_mm_loadu_ps((const float *)&_in + _b))); \
+        } \
+        _out; \
+    })
+#else
+#define AT_bands_sqrt(_v) \
+    ({ \
+        AT_Bands _out = (_v); \
+        for (int _b = 0; _b < AT_NUM_BANDS; _b++) _out[_b] = sqrtf(_out[_b]); \
+        _out; \
+    })
+#endif
+
+#endif // AT_BANDS_H
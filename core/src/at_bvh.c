@@ -490,7 +490,7 @@ void check_triangles(AT_MiniTreeNode *node, AT_Ray *in_ray, AT_IntersectContext
         AT_Triangle *triangle = &AT_get_triangle(node, 3, tri_idx);
         if (AT_ray_triangle_intersect(in_ray, triangle, &ctx->out_ray, &ctx->out_normal)) {
             ctx->intersects = true;
-            ctx->triangle_index = node->triangle_arrs->arrs[3][tri_idx];
+            ctx->triangle_index = node->triangle_arrs->arrs[3][node->start + tri_idx];
         }
     }
 }
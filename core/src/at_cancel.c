@@ -0,0 +1,39 @@
+#include "acoustic/at.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+struct AT_CancelToken {
+    atomic_bool cancelled;
+};
+
+AT_Result AT_cancel_token_create(AT_CancelToken **out_token)
+{
+    if (!out_token || *out_token) return AT_ERR_INVALID_ARGUMENT;
+
+    AT_CancelToken *token = malloc(sizeof(AT_CancelToken));
+    if (!token) return AT_ERR_ALLOC_ERROR;
+    atomic_init(&token->cancelled, false);
+
+    *out_token = token;
+    return AT_OK;
+}
+
+void AT_cancel_token_cancel(AT_CancelToken *token)
+{
+    if (!token) return;
+    atomic_store_explicit(&token->cancelled, true, memory_order_relaxed);
+}
+
+bool AT_cancel_token_is_cancelled(const AT_CancelToken *token)
+{
+    if (!token) return false;
+    //atomics are not const in C11, loading one does not modify the token
+    return atomic_load_explicit(&((AT_CancelToken *)token)->cancelled, memory_order_relaxed);
+}
+
+void AT_cancel_token_destroy(AT_CancelToken *token)
+{
+    free(token);
+}
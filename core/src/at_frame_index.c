@@ -0,0 +1,442 @@
+#include "at_frame_index.h"
+#include "at_internal.h"
+#include "at_bands.h"
+#include "acoustic/at.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+static inline void swap_float(float *a, float *b)
+{
+    float t = *a;
+    *a = *b;
+    *b = t;
+}
+
+// k-th largest (0 based) of values[0 .. count), reorders values
+static float select_kth_largest(float *values, uint32_t count, uint32_t k)
+{
+    uint32_t lo = 0, hi = count - 1;
+    while (lo < hi) {
+        //median of three keeps the partition balanced on the decaying energy runs
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (values[mid] > values[lo]) swap_float(&values[mid], &values[lo]);
+        if (values[hi] > values[lo]) swap_float(&values[hi], &values[lo]);
+        if (values[mid] > values[hi]) swap_float(&values[mid], &values[hi]);
+        const float pivot = values[hi];
+
+        uint32_t store = lo;
+        for (uint32_t i = lo; i < hi; i++) {
+            if (values[i] > pivot) swap_float(&values[i], &values[store++]);
+        }
+        swap_float(&values[store], &values[hi]);
+
+        if (store == k) return values[k];
+        if (store < k) lo = store + 1;
+        else hi = store - 1;
+    }
+    return values[k];
+}
+
+// applies the relative threshold and the per frame cap to one frame, in place,
+// keeping voxel order, returns the number of voxels kept
+static uint32_t filter_frame(const AT_Simulation *simulation, const AT_FrameFilter *filter,
+                             uint32_t *voxels, uint32_t count, uint32_t frame,
+                             float peak, float *scratch)
+{
+    const float energy_floor = filter->relative_threshold * peak;
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        float e = AT_bands_sum(simulation->voxel_grid[voxels[i]].items[frame]);
+        if (e < energy_floor) continue;
+        scratch[kept] = e;
+        voxels[kept++] = voxels[i];
+    }
+
+    if (filter->max_voxels == 0 || kept <= filter->max_voxels) return kept;
+
+    //scratch still lines up with voxels, keep whatever beats the k-th largest,
+    //ties at the cut are taken in voxel order until the cap is met
+    float *values = scratch + kept;
+    for (uint32_t i = 0; i < kept; i++) values[i] = scratch[i];
+    const float cut = select_kth_largest(values, kept, filter->max_voxels - 1);
+
+    uint32_t num_above = 0;
+    for (uint32_t i = 0; i < kept; i++) num_above += scratch[i] > cut;
+    uint32_t ties_left = filter->max_voxels - num_above;
+
+    uint32_t capped = 0;
+    for (uint32_t i = 0; i < kept; i++) {
+        if (scratch[i] > cut || (scratch[i] == cut && ties_left-- > 0)) voxels[capped++] = voxels[i];
+    }
+    return capped;
+}
+
+// frames [frame_start, frame_end) of the grid, trim drops the trailing silent ones
+static AT_Result frame_index_build(AT_FrameIndex **out_index, const AT_Simulation *simulation,
+                                   const AT_FrameFilter *filter, uint32_t frame_start, uint32_t frame_end,
+                                   bool trim)
+{
+    if (filter && !(filter->min_energy >= 0.0f && filter->relative_threshold >= 0.0f)) {
+        return AT_ERR_INVALID_ARGUMENT;
+    }
+
+    const AT_Voxel *voxels = simulation->voxel_grid;
+    const uint32_t num_voxels = simulation->num_voxels;
+    const float min_energy = filter ? filter->min_energy : 0.0f;
+    const bool per_frame = filter && (filter->relative_threshold > 0.0f || filter->max_voxels > 0);
+
+    uint32_t num_frames = frame_end - frame_start;
+
+    AT_FrameIndex *index = calloc(1, sizeof(AT_FrameIndex));
+    if (!index) return AT_ERR_ALLOC_ERROR;
+
+    index->num_frames = num_frames;
+    index->num_voxels = num_voxels;
+    index->frame_start = frame_start;
+    for (int a = 0; a < 3; a++) index->grid[a] = (uint32_t)simulation->grid_dimensions.arr[a];
+    index->offsets = calloc((size_t)num_frames + 1, sizeof(uint32_t));
+    float *peaks = per_frame ? calloc(num_frames > 0 ? num_frames : 1, sizeof(float)) : NULL;
+    if (!index->offsets || (per_frame && !peaks)) {
+        free(peaks);
+        AT_frame_index_destroy(index);
+        return AT_ERR_ALLOC_ERROR;
+    }
+
+    //pass 1: count active voxels per frame, offsets[f + 1] holds frame f's count
+    uint32_t num_active_frames = 0;
+    for (uint32_t v = 0; v < num_voxels; v++) {
+        const size_t count = voxels[v].count < frame_end ? voxels[v].count : frame_end;
+        for (size_t f = 0; f + frame_start < count; f++) {
+            float e = AT_bands_sum(voxels[v].items[frame_start + f]);
+            if (e <= 0.0f) continue;
+            if (f >= num_active_frames) num_active_frames = (uint32_t)f + 1;
+            if (e < min_energy) continue;
+            index->offsets[f + 1]++;
+            if (peaks) peaks[f] = fmaxf(peaks[f], e);
+        }
+    }
+
+    //trailing silent frames are dropped, voxels in a result store all span the padded timeline
+    if (trim) {
+        num_frames = num_active_frames;
+        index->num_frames = num_frames;
+    }
+
+    //prefix sum -> frame start offsets
+    uint32_t max_count = 0;
+    for (uint32_t f = 0; f < num_frames; f++) {
+        if (index->offsets[f + 1] > max_count) max_count = index->offsets[f + 1];
+        index->offsets[f + 1] += index->offsets[f];
+    }
+    index->num_entries = index->offsets[num_frames];
+
+    index->voxels = malloc(sizeof(uint32_t) * (index->num_entries > 0 ? index->num_entries : 1));
+    uint32_t *cursor = malloc(sizeof(uint32_t) * (num_frames > 0 ? num_frames : 1));
+    if (!index->voxels || !cursor) {
+        free(cursor);
+        free(peaks);
+        AT_frame_index_destroy(index);
+        return AT_ERR_ALLOC_ERROR;
+    }
+
+    //pass 2: scatter voxel ids into their frames, walking voxels in order keeps each frame sorted
+    for (uint32_t f = 0; f < num_frames; f++) cursor[f] = index->offsets[f];
+    for (uint32_t v = 0; v < num_voxels; v++) {
+        const size_t count = voxels[v].count < frame_end ? voxels[v].count : frame_end;
+        for (size_t f = 0; f + frame_start < count; f++) {
+            float e = AT_bands_sum(voxels[v].items[frame_start + f]);
+            if (e > 0.0f && e >= min_energy) index->voxels[cursor[f]++] = v;
+        }
+    }
+    free(cursor);
+
+    if (per_frame) {
+        //compact frame by frame, the kept entries only ever move towards the front
+        float *scratch = malloc(sizeof(float) * 2 * (max_count > 0 ? max_count : 1));
+        if (!scratch) {
+            free(peaks);
+            AT_frame_index_destroy(index);
+            return AT_ERR_ALLOC_ERROR;
+        }
+
+        uint32_t write = 0;
+        for (uint32_t f = 0; f < num_frames; f++) {
+            uint32_t start = index->offsets[f];
+            uint32_t count = index->offsets[f + 1] - start;
+            uint32_t kept = filter_frame(simulation, filter, index->voxels + start, count, frame_start + f,
+                                         peaks[f], scratch);
+            for (uint32_t i = 0; i < kept; i++) index->voxels[write + i] = index->voxels[start + i];
+            index->offsets[f] = write;
+            write += kept;
+        }
+        index->offsets[num_frames] = write;
+        index->num_entries = write;
+        free(scratch);
+
+        uint32_t *shrunk = realloc(index->voxels, sizeof(uint32_t) * (write > 0 ? write : 1));
+        if (shrunk) index->voxels = shrunk;
+    }
+    free(peaks);
+
+    //AT_frame_index_energy reads the grid at the index's own frame numbers,
+    //an index that does not start at frame 0 carries its energies instead
+    if (frame_start > 0) {
+        index->energies = malloc(sizeof(float) * (index->num_entries > 0 ? index->num_entries : 1));
+        if (!index->energies) {
+            AT_frame_index_destroy(index);
+            return AT_ERR_ALLOC_ERROR;
+        }
+        for (uint32_t f = 0; f < num_frames; f++) {
+            for (uint32_t i = index->offsets[f]; i < index->offsets[f + 1]; i++) {
+                index->energies[i] = AT_bands_sum(voxels[index->voxels[i]].items[frame_start + f]);
+            }
+        }
+    }
+
+    *out_index = index;
+    return AT_OK;
+}
+
+AT_Result AT_frame_index_create(AT_FrameIndex **out_index, const AT_Simulation *simulation,
+                                const AT_FrameFilter *filter)
+{
+    if (!out_index || *out_index || !simulation) return AT_ERR_INVALID_ARGUMENT;
+
+    //only touches the voxel headers, not their bins
+    uint32_t num_frames = 0;
+    for (uint32_t v = 0; v < simulation->num_voxels; v++) {
+        if (simulation->voxel_grid[v].count > num_frames) num_frames = (uint32_t)simulation->voxel_grid[v].count;
+    }
+    return frame_index_build(out_index, simulation, filter, 0, num_frames, true);
+}
+
+AT_Result AT_frame_index_create_range(AT_FrameIndex **out_index, const AT_Simulation *simulation,
+                                      const AT_FrameFilter *filter, uint32_t frame_start, uint32_t frame_end)
+{
+    if (!out_index || *out_index || !simulation || frame_end < frame_start) return AT_ERR_INVALID_ARGUMENT;
+    return frame_index_build(out_index, simulation, filter, frame_start, frame_end, false);
+}
+
+// first position in voxels[lo .. hi) holding an id >= voxel
+static uint32_t lower_bound(const uint32_t *voxels, uint32_t lo, uint32_t hi, uint32_t voxel)
+{
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (voxels[mid] < voxel) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static int compare_u32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// cursor over the box entries of one frame, either row by row with a binary search
+// for each row start, or a linear scan when the box has more rows than the frame has entries
+typedef struct {
+    const AT_FrameIndex *index;
+    uint32_t frame;
+    uint32_t dims[3], min[3], max[3];
+    bool by_row;
+    uint32_t pos, end, row_end;
+    uint32_t y, z;
+} AT_BoxCursor;
+
+static void box_cursor_init(AT_BoxCursor *c, const AT_FrameIndex *index, uint32_t frame,
+                            const uint32_t dims[3], const uint32_t min[3], const uint32_t max[3])
+{
+    c->index = index;
+    c->frame = frame;
+    for (int a = 0; a < 3; a++) {
+        c->dims[a] = dims[a];
+        c->min[a] = min[a];
+        c->max[a] = max[a];
+    }
+    c->pos = index->offsets[frame];
+    c->end = index->offsets[frame + 1];
+    if (min[0] == max[0] || min[1] == max[1] || min[2] == max[2]) c->end = c->pos;
+
+    const uint32_t count = c->end - c->pos;
+    const uint64_t num_rows = (uint64_t)(max[1] - min[1]) * (max[2] - min[2]);
+    //a row costs about log2(count) probes, 32 is a safe upper bound on that
+    c->by_row = num_rows * 32 < count;
+    c->y = min[1];
+    c->z = min[2];
+    c->row_end = c->pos;
+}
+
+// position of the next entry inside the box, false once the frame is done
+static bool box_cursor_next(AT_BoxCursor *c, uint32_t *out_pos)
+{
+    const uint32_t *voxels = c->index->voxels;
+    const uint32_t row = c->dims[0], slice = c->dims[0] * c->dims[1];
+
+    if (!c->by_row) {
+        while (c->pos < c->end) {
+            uint32_t p = c->pos++;
+            uint32_t v = voxels[p];
+            uint32_t x = v % row, y = v / row % c->dims[1], z = v / slice;
+            if (x >= c->min[0] && x < c->max[0] &&
+                y >= c->min[1] && y < c->max[1] &&
+                z >= c->min[2] && z < c->max[2]) {
+                *out_pos = p;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    while (c->pos >= c->row_end) {
+        if (c->z >= c->max[2] || c->pos >= c->end) return false;
+        //rows ascend in id order, so each search starts where the last row ended
+        const uint32_t first = c->z * slice + c->y * row;
+        c->pos = lower_bound(voxels, c->pos, c->end, first + c->min[0]);
+        c->row_end = lower_bound(voxels, c->pos, c->end, first + c->max[0]);
+        if (++c->y == c->max[1]) {
+            c->y = c->min[1];
+            c->z++;
+        }
+    }
+    *out_pos = c->pos++;
+    return true;
+}
+
+AT_Result AT_frame_index_query(AT_FrameIndex **out_index, const AT_FrameIndex *index,
+                               const AT_Simulation *simulation, const AT_FrameQuery *query)
+{
+    if (!out_index || *out_index || !index || !simulation || !query) return AT_ERR_INVALID_ARGUMENT;
+
+    const uint32_t n = query->downsample > 1 ? query->downsample : 1;
+    if (n != 1 && n != 2 && n != 4) return AT_ERR_INVALID_ARGUMENT;
+
+    const uint32_t *dims = index->grid;
+    uint32_t min[3], max[3], grid[3];
+    const bool whole_grid = query->max[0] == 0 && query->max[1] == 0 && query->max[2] == 0;
+    for (int a = 0; a < 3; a++) {
+        min[a] = whole_grid ? 0 : query->min[a];
+        max[a] = whole_grid ? dims[a] : (query->max[a] < dims[a] ? query->max[a] : dims[a]);
+        if (min[a] > max[a]) return AT_ERR_INVALID_ARGUMENT;
+        grid[a] = (dims[a] + n - 1) / n;
+    }
+
+    const uint32_t frame_end = query->frame_end == 0 || query->frame_end > index->num_frames ?
+        index->num_frames : query->frame_end;
+    if (query->frame_start > frame_end) return AT_ERR_INVALID_ARGUMENT;
+    const uint32_t num_frames = frame_end - query->frame_start;
+
+    //every entry of the frame range is an upper bound on what the query keeps
+    const uint32_t max_entries = index->offsets[frame_end] - index->offsets[query->frame_start];
+
+    AT_FrameIndex *result = calloc(1, sizeof(AT_FrameIndex));
+    if (!result) return AT_ERR_ALLOC_ERROR;
+    result->num_frames = num_frames;
+    for (int a = 0; a < 3; a++) result->grid[a] = grid[a];
+    result->num_voxels = grid[0] * grid[1] * grid[2];
+    result->frame_start = index->frame_start + query->frame_start;
+    result->offsets = malloc(sizeof(uint32_t) * ((size_t)num_frames + 1));
+    result->voxels = malloc(sizeof(uint32_t) * (max_entries > 0 ? max_entries : 1));
+    result->energies = malloc(sizeof(float) * (max_entries > 0 ? max_entries : 1));
+
+    //downsampling accumulates into a dense grid of cells, only touched cells are reset
+    float *cells = n > 1 ? calloc(result->num_voxels > 0 ? result->num_voxels : 1, sizeof(float)) : NULL;
+    if (!result->offsets || !result->voxels || !result->energies || (n > 1 && !cells)) {
+        free(cells);
+        AT_frame_index_destroy(result);
+        return AT_ERR_ALLOC_ERROR;
+    }
+
+    uint32_t write = 0;
+    for (uint32_t f = 0; f < num_frames; f++) {
+        const uint32_t frame = query->frame_start + f;
+        const uint32_t frame_offset = index->offsets[frame];
+        result->offsets[f] = write;
+
+        AT_BoxCursor cursor;
+        box_cursor_init(&cursor, index, frame, dims, min, max);
+        uint32_t pos;
+
+        if (n == 1) {
+            while (box_cursor_next(&cursor, &pos)) {
+                result->voxels[write] = index->voxels[pos];
+                result->energies[write++] = AT_frame_index_energy(index, simulation, frame, pos - frame_offset);
+            }
+            continue;
+        }
+
+        uint32_t *touched = result->voxels + write;
+        uint32_t num_touched = 0;
+        while (box_cursor_next(&cursor, &pos)) {
+            const uint32_t v = index->voxels[pos];
+            const uint32_t x = v % dims[0], y = v / dims[0] % dims[1], z = v / (dims[0] * dims[1]);
+            const uint32_t cell = (z / n * grid[1] + y / n) * grid[0] + x / n;
+            //index entries are all > 0, so an empty cell has not been seen this frame
+            if (cells[cell] == 0.0f) touched[num_touched++] = cell;
+            cells[cell] += AT_frame_index_energy(index, simulation, frame, pos - frame_offset);
+        }
+
+        qsort(touched, num_touched, sizeof(uint32_t), compare_u32);
+        for (uint32_t i = 0; i < num_touched; i++) {
+            result->energies[write + i] = cells[touched[i]];
+            cells[touched[i]] = 0.0f;
+        }
+        write += num_touched;
+    }
+    result->offsets[num_frames] = write;
+    result->num_entries = write;
+    free(cells);
+
+    uint32_t *voxels = realloc(result->voxels, sizeof(uint32_t) * (write > 0 ? write : 1));
+    if (voxels) result->voxels = voxels;
+    float *energies = realloc(result->energies, sizeof(float) * (write > 0 ? write : 1));
+    if (energies) result->energies = energies;
+
+    *out_index = result;
+    return AT_OK;
+}
+
+AT_Result AT_frame_pyramid_create(AT_FramePyramid **out_pyramid, const AT_FrameIndex *index,
+                                  const AT_Simulation *simulation, uint32_t max_levels)
+{
+    if (!out_pyramid || *out_pyramid || !index || !simulation) return AT_ERR_INVALID_ARGUMENT;
+    if (max_levels == 0 || max_levels > AT_FRAME_PYRAMID_MAX_LEVELS) max_levels = AT_FRAME_PYRAMID_MAX_LEVELS;
+
+    AT_FramePyramid *pyramid = calloc(1, sizeof(AT_FramePyramid));
+    if (!pyramid) return AT_ERR_ALLOC_ERROR;
+
+    const AT_FrameQuery halve = {.downsample = 2};
+    const AT_FrameIndex *below = index;
+    while (pyramid->num_levels < max_levels && below->num_voxels > 1) {
+        AT_FrameIndex **level = &pyramid->levels[pyramid->num_levels];
+        AT_Result res = AT_frame_index_query(level, below, simulation, &halve);
+        if (res != AT_OK) {
+            AT_frame_pyramid_destroy(pyramid);
+            return res;
+        }
+        below = *level;
+        pyramid->num_levels++;
+    }
+
+    *out_pyramid = pyramid;
+    return AT_OK;
+}
+
+void AT_frame_pyramid_destroy(AT_FramePyramid *pyramid)
+{
+    if (!pyramid) return;
+    for (uint32_t i = 0; i < pyramid->num_levels; i++) AT_frame_index_destroy(pyramid->levels[i]);
+    free(pyramid);
+}
+
+void AT_frame_index_destroy(AT_FrameIndex *index)
+{
+    if (!index) return;
+    free(index->offsets);
+    free(index->voxels);
+    free(index->energies);
+    free(index);
+}
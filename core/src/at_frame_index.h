@@ -0,0 +1,131 @@
+#ifndef AT_FRAME_INDEX_H
+#define AT_FRAME_INDEX_H
+
+#include "acoustic/at.h"
+#include "at_internal.h"
+#include "at_bands.h"
+
+#include <stdint.h>
+
+// frame-major view over the voxel grid, built once per export
+// the grid stores bins voxel-major (voxel -> frames), exporters want
+// frame -> active voxels, so this is the transpose in CSR form:
+// the active voxels of frame f are voxels[offsets[f] .. offsets[f + 1])
+// in ascending voxel order, energies stay in the grid and are read on demand
+// query results (AT_frame_index_query) carry their own energies instead, their
+// voxel ids may address a downsampled grid and frame 0 is frame_start
+typedef struct AT_FrameIndex AT_FrameIndex;
+
+struct AT_FrameIndex {
+    uint32_t num_frames;
+    uint32_t num_entries; // total active (voxel, frame) pairs
+    uint32_t grid[3];     // cells per axis of the grid the voxel ids address
+    uint32_t num_voxels;  // grid[0] * grid[1] * grid[2]
+    uint32_t frame_start; // timeline frame of frame 0
+    uint32_t *offsets;    // num_frames + 1
+    uint32_t *voxels;     // num_entries
+    float *energies;      // num_entries broadband energies, NULL when read from the grid
+};
+
+typedef struct AT_FrameFilter AT_FrameFilter;
+
+// which voxels make it into the index, a zeroed filter keeps every voxel with energy > 0
+struct AT_FrameFilter {
+    float min_energy;         // absolute floor on the broadband energy
+    float relative_threshold; // fraction of the frame's peak energy a voxel must reach
+    uint32_t max_voxels;      // per frame cap, keeps the loudest voxels, 0 for no cap
+};
+
+/** \brief Builds the frame-major index of the voxel bins that pass filter.
+
+    Two passes over the bins (count, then fill), independent of how many
+    frames there are, instead of a full grid scan per frame. Relative
+    thresholds and the per frame cap then compact each frame in place, the
+    cap with a partial selection rather than a sort.
+
+    \param filter NULL keeps every voxel with energy > 0.
+ */
+AT_Result AT_frame_index_create(AT_FrameIndex **out_index, const AT_Simulation *simulation,
+                                const AT_FrameFilter *filter);
+
+/** \brief Builds the index of frames [frame_start, frame_end) of the grid only.
+
+    Reads just those bins, so a progressive run can index the frames that just
+    became final without rescanning the earlier ones. Unlike a whole grid index
+    trailing silent frames are kept, and one that does not start at frame 0
+    carries its energies like a query result.
+ */
+AT_Result AT_frame_index_create_range(AT_FrameIndex **out_index, const AT_Simulation *simulation,
+                                      const AT_FrameFilter *filter, uint32_t frame_start, uint32_t frame_end);
+
+typedef struct AT_FrameQuery AT_FrameQuery;
+
+// a window onto an index, a zeroed query selects everything
+struct AT_FrameQuery {
+    uint32_t frame_start; // first frame
+    uint32_t frame_end;   // one past the last frame, 0 for the end of the index
+    uint32_t min[3];      // box [min, max) per axis in the index's grid,
+    uint32_t max[3];      // max all zero for the whole grid
+    uint32_t downsample;  // 0 / 1 full resolution, 2 or 4 sums cells of n^3 voxels
+};
+
+/** \brief Builds the part of index selected by query, energies included.
+
+    Frame ranges are a slice of the offsets and box queries binary search each
+    voxel row of the box within a frame, so both cost what they return rather
+    than what the index holds. Downsampling sums every voxel of a cell, so its
+    total energy is preserved, the result addresses a grid of
+    ceil(index->grid / downsample) cells.
+
+    \param index Index of simulation, from AT_frame_index_create().
+ */
+AT_Result AT_frame_index_query(AT_FrameIndex **out_index, const AT_FrameIndex *index,
+                               const AT_Simulation *simulation, const AT_FrameQuery *query);
+
+// 2^8 = 256 times coarser than the simulated grid per axis
+#define AT_FRAME_PYRAMID_MAX_LEVELS 8
+
+typedef struct AT_FramePyramid AT_FramePyramid;
+
+// per frame mip pyramid over an index, levels[i] halves the grid of the level
+// below it (levels[0] halves the index), every cell holds the summed energy of
+// the cells it covers so each level carries the same energy per frame
+struct AT_FramePyramid {
+    uint32_t num_levels;
+    AT_FrameIndex *levels[AT_FRAME_PYRAMID_MAX_LEVELS];
+};
+
+/** \brief Builds the mip levels of index in one bottom-up pass.
+
+    Each level is summed from the one below it rather than from the index, so
+    the whole pyramid costs about 1/7 of the index on top of what it reads once.
+
+    \param max_levels Upper bound on the levels, 0 stops once the grid is a single cell.
+ */
+AT_Result AT_frame_pyramid_create(AT_FramePyramid **out_pyramid, const AT_FrameIndex *index,
+                                  const AT_Simulation *simulation, uint32_t max_levels);
+
+void AT_frame_pyramid_destroy(AT_FramePyramid *pyramid);
+
+void AT_frame_index_destroy(AT_FrameIndex *index);
+
+static inline uint32_t AT_frame_index_count(const AT_FrameIndex *index, uint32_t frame)
+{
+    return index->offsets[frame + 1] - index->offsets[frame];
+}
+
+static inline const uint32_t *AT_frame_index_voxels(const AT_FrameIndex *index, uint32_t frame)
+{
+    return index->voxels + index->offsets[frame];
+}
+
+// broadband energy of the i'th voxel of a frame
+static inline float AT_frame_index_energy(const AT_FrameIndex *index, const AT_Simulation *simulation,
+                                          uint32_t frame, uint32_t i)
+{
+    const uint32_t entry = index->offsets[frame] + i;
+    if (index->energies) return index->energies[entry];
+    return AT_bands_sum(simulation->voxel_grid[index->voxels[entry]].items[frame]);
+}
+
+#endif // AT_FRAME_INDEX_H
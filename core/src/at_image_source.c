@@ -0,0 +1,274 @@
+#include "at_image_source.h"
+#include "at_internal.h"
+#include "at_bands.h"
+#include "at_bvh.h"
+#include "at_ray.h"
+#include "at_receiver.h"
+#include "acoustic/at.h"
+#include "acoustic/at_math.h"
+#include "../src/at_utils.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// paths start this far off a surface so the BVH doesn't hit the surface they left
+#define IMAGE_SOURCE_EPSILON 0.001f
+// triangles whose planes round to the same normal and distance at these scales share a plane
+#define IMAGE_SOURCE_NORMAL_QUANTUM 1e4f
+#define IMAGE_SOURCE_DISTANCE_QUANTUM 1e3f
+
+typedef struct {
+    int32_t key[4];
+    uint32_t triangle;
+} AT_PlaneKey;
+
+static int plane_key_compare(const void *a, const void *b)
+{
+    const AT_PlaneKey *ka = a, *kb = b;
+    for (int i = 0; i < 4; i++) {
+        if (ka->key[i] != kb->key[i]) return ka->key[i] < kb->key[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+// plane of a triangle with its normal's largest component positive, so both windings agree
+static bool triangle_plane(const AT_Model *model, uint32_t t, AT_ImagePlane *out_plane)
+{
+    const AT_Vec3 v1 = model->vertices[model->indices[t * 3]];
+    const AT_Vec3 v2 = model->vertices[model->indices[t * 3 + 1]];
+    const AT_Vec3 v3 = model->vertices[model->indices[t * 3 + 2]];
+    const AT_Vec3 cross = AT_vec3_cross(AT_vec3_sub(v2, v1), AT_vec3_sub(v3, v1));
+    const float length = AT_vec3_length(cross);
+    if (!(length > EPSILON)) return false;
+
+    AT_Vec3 normal = AT_vec3_scale(cross, 1.0f / length);
+    int axis = 0;
+    for (int a = 1; a < 3; a++) {
+        if (fabsf(normal.arr[a]) > fabsf(normal.arr[axis])) axis = a;
+    }
+    if (normal.arr[axis] < 0.0f) normal = AT_vec3_scale(normal, -1.0f);
+    *out_plane = (AT_ImagePlane){.normal = normal, .distance = AT_vec3_dot(normal, v1)};
+    return true;
+}
+
+AT_Result AT_image_sources_create(AT_ImageSources **out_images, const AT_Scene *scene, uint32_t order)
+{
+    if (!out_images || *out_images || !scene || order == 0 || order > AT_IMAGE_SOURCE_MAX_ORDER) {
+        return AT_ERR_INVALID_ARGUMENT;
+    }
+
+    const AT_Model *model = scene->environment;
+    const uint32_t num_triangles = (uint32_t)(model->index_count / 3);
+    AT_ImageSources *images = AT_CALLOC(1, sizeof(AT_ImageSources));
+    AT_PlaneKey *keys = AT_MALLOC(AT_max(num_triangles, 1u) * sizeof(AT_PlaneKey));
+    if (images) {
+        images->planes = AT_MALLOC(AT_max(num_triangles, 1u) * sizeof(AT_ImagePlane));
+        images->triangle_planes = AT_MALLOC(AT_max(num_triangles, 1u) * sizeof(uint32_t));
+    }
+    if (!images || !keys || !images->planes || !images->triangle_planes) {
+        AT_FREE(keys);
+        AT_image_sources_destroy(images);
+        return AT_ERR_ALLOC_ERROR;
+    }
+    images->order = order;
+
+    //sorting the triangles by their rounded plane brings coplanar ones together
+    uint32_t num_keys = 0;
+    for (uint32_t t = 0; t < num_triangles; t++) {
+        AT_ImagePlane plane;
+        images->triangle_planes[t] = UINT32_MAX;
+        if (!triangle_plane(model, t, &plane)) continue;
+        keys[num_keys++] = (AT_PlaneKey){
+            .key = {
+                (int32_t)lroundf(plane.normal.x * IMAGE_SOURCE_NORMAL_QUANTUM),
+                (int32_t)lroundf(plane.normal.y * IMAGE_SOURCE_NORMAL_QUANTUM),
+                (int32_t)lroundf(plane.normal.z * IMAGE_SOURCE_NORMAL_QUANTUM),
+                (int32_t)lroundf(plane.distance * IMAGE_SOURCE_DISTANCE_QUANTUM),
+            },
+            .triangle = t,
+        };
+    }
+    qsort(keys, num_keys, sizeof(AT_PlaneKey), plane_key_compare);
+    for (uint32_t k = 0; k < num_keys; k++) {
+        if (k == 0 || plane_key_compare(&keys[k - 1], &keys[k]) != 0) {
+            triangle_plane(model, keys[k].triangle, &images->planes[images->num_planes++]);
+        }
+        images->triangle_planes[keys[k].triangle] = images->num_planes - 1;
+    }
+    AT_FREE(keys);
+
+    //1 + P + P(P - 1) + ... images, every order mirrors each image over all planes but its own
+    uint64_t capacity = 1, level = 1;
+    for (uint32_t o = 1; o <= order; o++) {
+        level *= o == 1 ? images->num_planes : AT_max(images->num_planes, 1u) - 1;
+        capacity += level;
+        if (capacity > AT_IMAGE_SOURCE_MAX_IMAGES) {
+            AT_image_sources_destroy(images);
+            return AT_ERR_INVALID_ARGUMENT;
+        }
+    }
+    images->capacity = (uint32_t)capacity;
+    images->positions = AT_MALLOC(capacity * sizeof(AT_Vec3));
+    images->image_planes = AT_MALLOC(capacity * sizeof(uint32_t));
+    images->parents = AT_MALLOC(capacity * sizeof(uint32_t));
+    if (!images->positions || !images->image_planes || !images->parents) {
+        AT_image_sources_destroy(images);
+        return AT_ERR_ALLOC_ERROR;
+    }
+
+    *out_images = images;
+    return AT_OK;
+}
+
+// mirrors the source over the planes order by order, breadth first
+static void image_sources_build(AT_ImageSources *images, AT_Vec3 source)
+{
+    images->positions[0] = source;
+    images->image_planes[0] = UINT32_MAX;
+    images->parents[0] = UINT32_MAX;
+    images->num_images = 1;
+
+    uint32_t level_start = 0;
+    for (uint32_t o = 1; o <= images->order; o++) {
+        const uint32_t level_end = images->num_images;
+        for (uint32_t i = level_start; i < level_end; i++) {
+            for (uint32_t p = 0; p < images->num_planes; p++) {
+                if (p == images->image_planes[i]) continue;
+                const AT_ImagePlane *plane = &images->planes[p];
+                const float offset = AT_vec3_dot(plane->normal, images->positions[i]) - plane->distance;
+                //an image on the plane mirrors onto itself
+                if (fabsf(offset) < EPSILON) continue;
+
+                const uint32_t image = images->num_images++;
+                images->positions[image] = AT_vec3_sub(images->positions[i],
+                                                       AT_vec3_scale(plane->normal, 2.0f * offset));
+                images->image_planes[image] = p;
+                images->parents[image] = i;
+            }
+        }
+        level_start = level_end;
+    }
+}
+
+// first surface the segment [from, to] hits, false when it reaches to unobstructed
+static bool image_sources_cast(const AT_Simulation *simulation, AT_Vec3 from, AT_Vec3 to,
+                               AT_IntersectContext *out_ctx)
+{
+    const float length = AT_vec3_distance(from, to);
+    if (length <= IMAGE_SOURCE_EPSILON) return false;
+    const AT_Vec3 direction = AT_vec3_scale(AT_vec3_sub(to, from), 1.0f / length);
+
+    AT_Ray ray = AT_ray_init(AT_vec3_add(from, AT_vec3_scale(direction, IMAGE_SOURCE_EPSILON)), direction, 0.0f, 0.0f, 0);
+    *out_ctx = AT_IntersectContext_init();
+    AT_MiniTree_intersect(out_ctx, simulation->scene->mini_trees, simulation->scene->num_trees, &ray);
+    return out_ctx->intersects &&
+           AT_vec3_distance(from, out_ctx->out_ray.origin) < length - IMAGE_SOURCE_EPSILON;
+}
+
+// walks image back to the source through its reflection points, true when the BVH
+// confirms every segment, with the energy left after the surfaces' absorption and the
+// directions the path leaves the source and arrives at the receiver from
+static bool image_sources_path(const AT_ImageSources *images, const AT_Simulation *simulation, uint32_t image,
+                               AT_Vec3 receiver, AT_Bands *out_reflection, AT_Vec3 *out_departure,
+                               AT_Vec3 *out_arrival)
+{
+    AT_Vec3 points[AT_IMAGE_SOURCE_MAX_ORDER + 2];
+    uint32_t planes[AT_IMAGE_SOURCE_MAX_ORDER + 2];
+    uint32_t num_points = 0;
+
+    //reflection points from the receiver backwards, each where the line towards the
+    //image crosses its plane, the segment has to cross it between the two
+    AT_Vec3 at = receiver;
+    points[num_points++] = receiver;
+    for (uint32_t i = image; images->image_planes[i] != UINT32_MAX; i = images->parents[i]) {
+        const AT_ImagePlane *plane = &images->planes[images->image_planes[i]];
+        const float at_offset = AT_vec3_dot(plane->normal, at) - plane->distance;
+        const float image_offset = AT_vec3_dot(plane->normal, images->positions[i]) - plane->distance;
+        if (at_offset * image_offset >= 0.0f) return false;
+
+        const float t = at_offset / (at_offset - image_offset);
+        at = AT_vec3_add(at, AT_vec3_scale(AT_vec3_sub(images->positions[i], at), t));
+        planes[num_points] = images->image_planes[i];
+        points[num_points++] = at;
+    }
+    points[num_points++] = images->positions[0];
+
+    //forwards from the source, every segment has to end on its reflection's plane and the last
+    //one reach the receiver unobstructed
+    AT_Bands reflection = AT_bands_splat(1.0f);
+    for (uint32_t p = num_points - 1; p > 0; p--) {
+        AT_IntersectContext ctx;
+        const bool hit = image_sources_cast(simulation, points[p], points[p - 1], &ctx);
+        if (p == 1) {
+            if (hit) return false;
+            break;
+        }
+        //the segment reaches the reflection point, the cast itself stops just short of it
+        const bool reaches = ctx.intersects &&
+                             AT_vec3_distance(ctx.out_ray.origin, points[p - 1]) < 2.0f * IMAGE_SOURCE_EPSILON;
+        if (!reaches || images->triangle_planes[ctx.triangle_index] != planes[p - 1]) return false;
+
+        const AT_Material *material = &AT_MATERIAL_TABLE[simulation->scene->triangle_materials[ctx.triangle_index]];
+        reflection *= 1.0f - AT_bands_from_array(material->absorption);
+    }
+
+    *out_reflection = reflection;
+    *out_departure = AT_vec3_normalize(AT_vec3_sub(points[num_points - 2], points[num_points - 1]));
+    *out_arrival = AT_vec3_normalize(AT_vec3_sub(points[1], receiver));
+    return true;
+}
+
+void AT_image_sources_collect(AT_ImageSources *images, AT_ReceiverSet *receivers, const AT_Simulation *simulation,
+                              uint32_t source, uint32_t layer, float energy)
+{
+    const AT_Source *emitter = &simulation->sources[source];
+    const AT_Vec3 facing = AT_vec3_normalize(emitter->direction);
+    image_sources_build(images, emitter->position);
+
+    const uint32_t num_bins = AT_min(receivers->first_traced_bin, receivers->num_bins);
+    for (uint32_t r = 0; r < receivers->num_receivers; r++) {
+        const AT_Receiver *receiver = &receivers->receivers[r];
+        float *bins = AT_receivers_bins(receivers, layer, r);
+
+        for (uint32_t i = 0; i < images->num_images; i++) {
+            //an image source is as far from the receiver as its path is long
+            const float distance = AT_vec3_distance(images->positions[i], receiver->position);
+            const uint32_t bin = (uint32_t)(distance / simulation->speed_of_sound / receivers->bin_width);
+            if (bin >= num_bins) continue;
+
+            AT_Bands reflection;
+            AT_Vec3 departure, arrival;
+            if (!image_sources_path(images, simulation, i, receiver->position, &reflection, &departure, &arrival)) {
+                continue;
+            }
+
+            //rays leave with a cosine distribution about the source's direction, cos / pi per steradian,
+            //and split their energy equally among the bands
+            const float cosine = AT_vec3_dot(facing, departure);
+            if (cosine <= 0.0f) continue;
+            const float spread = fmaxf(distance, receiver->radius);
+            const AT_Bands fluence = reflection * AT_bands_exp(-simulation->air_coefficient * distance) *
+                                     (energy / AT_NUM_BANDS * cosine / ((float)AT_PI * spread * spread));
+
+            float *energies = bins + (size_t)bin * AT_NUM_BANDS;
+            for (int band = 0; band < AT_NUM_BANDS; band++) energies[band] += fluence[band];
+
+            const float broadband = AT_bands_sum(fluence);
+            float *direction = bins + (size_t)receivers->num_bins * AT_NUM_BANDS + (size_t)bin * 3;
+            for (int a = 0; a < 3; a++) direction[a] += arrival.arr[a] * broadband;
+        }
+    }
+}
+
+void AT_image_sources_destroy(AT_ImageSources *images)
+{
+    if (!images) return;
+    AT_FREE(images->planes);
+    AT_FREE(images->triangle_planes);
+    AT_FREE(images->positions);
+    AT_FREE(images->image_planes);
+    AT_FREE(images->parents);
+    AT_FREE(images);
+}
@@ -0,0 +1,46 @@
+#ifndef AT_IMAGE_SOURCE_H
+#define AT_IMAGE_SOURCE_H
+
+#include "acoustic/at.h"
+#include "at_internal.h"
+#include "at_receiver.h"
+
+#include <stdint.h>
+
+// highest AT_Settings.image_source_order, a path is validated with one BVH query per segment
+#define AT_IMAGE_SOURCE_MAX_ORDER 8
+// images of one source, every plane mirrors every image of the order below but the one
+// it came from, so this bounds orders * planes
+#define AT_IMAGE_SOURCE_MAX_IMAGES (1u << 18)
+
+// a plane of the room, dot(normal, p) == distance, coplanar triangles share one
+typedef struct {
+    AT_Vec3 normal;
+    float distance;
+} AT_ImagePlane;
+
+// the image sources of a source up to order, mirrored over the room's planes, each a
+// candidate specular path the BVH confirms or rejects per receiver
+struct AT_ImageSources {
+    AT_ImagePlane *planes;
+    uint32_t num_planes;
+    uint32_t *triangle_planes; // plane of every triangle of the scene, UINT32_MAX for degenerate ones
+    uint32_t order;
+    // image tree of the source last built, image 0 is the source itself
+    AT_Vec3 *positions;
+    uint32_t *image_planes;    // plane an image was mirrored over, UINT32_MAX for the source
+    uint32_t *parents;         // image it was mirrored from
+    uint32_t num_images;
+    uint32_t capacity;
+};
+
+AT_Result AT_image_sources_create(AT_ImageSources **out_images, const AT_Scene *scene, uint32_t order);
+
+// adds every specular path of up to order reflections from source to each receiver to
+// layer, into the bins before receivers->first_traced_bin, energy is what the source emits
+void AT_image_sources_collect(AT_ImageSources *images, AT_ReceiverSet *receivers, const AT_Simulation *simulation,
+                              uint32_t source, uint32_t layer, float energy);
+
+void AT_image_sources_destroy(AT_ImageSources *images);
+
+#endif // AT_IMAGE_SOURCE_H
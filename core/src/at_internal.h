@@ -8,6 +8,8 @@
 
 #include "acoustic/at.h"
 #include "acoustic/at_math.h"
+#include "at_bands.h"
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -19,7 +21,7 @@ struct AT_Ray {
     AT_Vec3 origin;
     AT_Vec3 direction;
     AT_Vec3 hit_point;
-    float energy;
+    AT_Bands energy;
     float total_distance;
     uint32_t ray_id;
     uint32_t bounce_count;
@@ -31,7 +33,7 @@ struct AT_Ray {
 // to be universal, can use them with any types.
 // If we want, we can rewrite them to change items to bins to avoid confusion :|
 typedef struct {
-    float *items; //bins
+    AT_Bands *items; //bins, per band energy
     size_t count;
     size_t capacity;
 } AT_Voxel;
@@ -39,12 +41,15 @@ typedef struct {
 // API Type definitions (just struct definitions, theyre already typedefed when forward declaring)
 typedef struct AT_MiniTree AT_MiniTree;
 typedef struct AT_TriangleArrays AT_TriangleArrays;
+typedef struct AT_ReceiverSet AT_ReceiverSet;
+typedef struct AT_ImageSources AT_ImageSources;
 
 struct AT_Scene {
     AT_Source *sources;
     AT_AABB world_AABB;
     AT_TriangleArrays *triangle_arrs;
     AT_MiniTree **mini_trees;
+    uint8_t *triangle_materials; // AT_MaterialType per triangle, unassigned resolved to material
     uint32_t num_trees;
     uint32_t num_sources;
     AT_MaterialType material;
@@ -55,7 +60,7 @@ struct AT_Model {
     AT_Vec3 *vertices;
     AT_Vec3 *normals;
     uint32_t *indices;
-    uint32_t *triangle_materials;
+    uint8_t *triangle_materials; // AT_MaterialType or AT_MATERIAL_UNASSIGNED per triangle
     size_t vertex_count;
     size_t index_count;
 };
@@ -66,20 +71,64 @@ struct AT_Simulation {
     const AT_Scene *scene; //borrowed: must remain valid for the lifetime of AT_Simulation
     AT_Voxel *voxel_grid;
     AT_Ray *rays;
+    AT_Source *sources;  // own copy of the scene's, moved by AT_simulation_set_source
+    bool *source_traced; // per source, its rays' paths are current and a run only deposits them
+    // per source grids of num_voxels the rays deposit into, voxel_grid is their sum
+    // weighted by source_gains, NULL without AT_Settings.source_channels
+    AT_Voxel *channels;
+    float *source_gains;
     AT_Vec3 origin;
     AT_Vec3 dimensions;
     AT_Vec3 grid_dimensions;
     float voxel_size;
     float bin_width;
+    float inv_bin_width;
+    float speed_of_sound;
+    AT_Bands air_coefficient; // per band energy decay per metre, exp(-air_coefficient * d)
     uint32_t num_rays;
     uint32_t num_voxels;
     uint8_t fps;
+    AT_DepositionMode deposition;
+    AT_AttenuationModel attenuation;
+    char *result_path;     // owned copy of AT_Settings.result_path, NULL keeps bins on the heap
+    AT_ResultStore *store; // set while the voxels' bins live in the mapped result file
+    AT_ReceiverSet *receivers; // AT_Settings.receivers and their energy-time curves, NULL without
+    AT_ImageSources *image_sources; // early reflections at the receivers, NULL without AT_Settings.image_source_order
+    AT_CancelToken *cancel; // borrowed AT_Settings.cancel, NULL when the run can't be cancelled
+    float time_limit;       // seconds, 0 for none
+    double deadline;        // monotonic seconds the current run stops at, 0 for none
+    uint32_t batch_rays;    // rays per source per batch of AT_simulation_run_batched, 0 for one batch
+    float target_error;     // relative error a batched run stops at, 0 runs every ray
+    uint32_t error_min[3];  // voxel box [min, max) target_error is measured over
+    uint32_t error_max[3];
+    // per voxel statistics of the last batched run, NULL before one: the voxel's total
+    // energy and the sum over batches of (batch's share of it)^2 / batch rays
+    double *batch_totals;
+    double *batch_squares;
+    uint32_t rays_done;     // rays per source the last batched run traced
+    uint32_t num_batches;
+
+    // progress of AT_simulation_run, written once per ray and read from other threads
+    atomic_uint phase; // AT_SimulationPhase
+    atomic_uint rays_traced;
+    atomic_uint rays_deposited;
+    atomic_ullong bounces;
 };
 
+// octave bands 63Hz -> 8kHz, broadband averages match the old single coefficients
 static const AT_Material AT_MATERIAL_TABLE[AT_MATERIAL_COUNT] = {
-    [AT_MATERIAL_CONCRETE] = {.absorption = 0.02f, .scattering = 0.10f},
-    [AT_MATERIAL_PLASTIC] = {.absorption = 0.03f, .scattering = 0.05f},
-    [AT_MATERIAL_WOOD] = {.absorption = 0.10f, .scattering = 0.20f},
+    [AT_MATERIAL_CONCRETE] = {
+        .absorption = {0.01f, 0.01f, 0.01f, 0.02f, 0.02f, 0.02f, 0.03f, 0.04f},
+        .scattering = {0.05f, 0.05f, 0.06f, 0.08f, 0.10f, 0.12f, 0.16f, 0.18f},
+    },
+    [AT_MATERIAL_PLASTIC] = {
+        .absorption = {0.02f, 0.02f, 0.02f, 0.03f, 0.03f, 0.04f, 0.04f, 0.04f},
+        .scattering = {0.02f, 0.02f, 0.03f, 0.04f, 0.05f, 0.06f, 0.08f, 0.10f},
+    },
+    [AT_MATERIAL_WOOD] = {
+        .absorption = {0.15f, 0.15f, 0.11f, 0.10f, 0.07f, 0.06f, 0.07f, 0.09f},
+        .scattering = {0.10f, 0.10f, 0.12f, 0.15f, 0.20f, 0.25f, 0.32f, 0.36f},
+    },
 };
 
 #endif // AT_INTERAL_H
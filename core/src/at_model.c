@@ -6,14 +6,77 @@
 #include "acoustic/at_math.h"
 #include "cgltf.h"
 
+#include <ctype.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <strings.h>
 #include <float.h>
 
+/* Material names recognised without a user table, matched as substrings
+ * so e.g. "Floor_Wood.001" exported from Blender still maps */
+static const char *AT_MATERIAL_KEYWORDS[AT_MATERIAL_COUNT] = {
+    [AT_MATERIAL_CONCRETE] = "concrete",
+    [AT_MATERIAL_PLASTIC]  = "plastic",
+    [AT_MATERIAL_WOOD]     = "wood",
+};
+
+/* case-insensitive strstr, keyword must already be lower case */
+static bool contains_keyword(const char *name, const char *keyword)
+{
+    size_t keyword_len = strlen(keyword);
+    for (const char *c = name; *c; c++) {
+        size_t i = 0;
+        while (i < keyword_len && c[i] && tolower((unsigned char)c[i]) == keyword[i]) i++;
+        if (i == keyword_len) return true;
+    }
+    return false;
+}
+
+static uint8_t resolve_material(const cgltf_material *material,
+                                const AT_MaterialMapping *mappings,
+                                uint32_t num_mappings)
+{
+    if (!material || !material->name) return AT_MATERIAL_UNASSIGNED;
+
+    for (uint32_t i = 0; i < num_mappings; i++) {
+        if (mappings[i].name && strcasecmp(mappings[i].name, material->name) == 0) {
+            return (uint8_t)mappings[i].material;
+        }
+    }
+
+    for (uint32_t m = 0; m < AT_MATERIAL_COUNT; m++) {
+        if (contains_keyword(material->name, AT_MATERIAL_KEYWORDS[m])) return (uint8_t)m;
+    }
+
+    return AT_MATERIAL_UNASSIGNED;
+}
+
 AT_Result AT_model_create(AT_Model **out_model, const char *filepath)
+{
+    return AT_model_create_with_materials(out_model, filepath, NULL, 0);
+}
+
+static bool mappings_are_valid(const AT_MaterialMapping *mappings, uint32_t num_mappings)
+{
+    if (num_mappings > 0 && !mappings) return false;
+    for (uint32_t i = 0; i < num_mappings; i++) {
+        if (mappings[i].material >= AT_MATERIAL_COUNT) return false;
+    }
+    return true;
+}
+
+static AT_Result model_from_gltf(AT_Model **out_model, cgltf_data *data,
+                                 const AT_MaterialMapping *mappings, uint32_t num_mappings);
+
+AT_Result AT_model_create_with_materials(AT_Model **out_model,
+                                         const char *filepath,
+                                         const AT_MaterialMapping *mappings,
+                                         uint32_t num_mappings)
 {
     if (!out_model || *out_model || !filepath) return AT_ERR_INVALID_ARGUMENT;
+    if (!mappings_are_valid(mappings, num_mappings)) return AT_ERR_INVALID_ARGUMENT;
 
     cgltf_options options = {0};
     cgltf_data *data = NULL;
@@ -27,6 +90,39 @@ AT_Result AT_model_create(AT_Model **out_model, const char *filepath)
         return AT_ERR_INVALID_ARGUMENT;
     }
 
+    return model_from_gltf(out_model, data, mappings, num_mappings);
+}
+
+AT_Result AT_model_create_from_memory(AT_Model **out_model,
+                                      const void *glb,
+                                      size_t size,
+                                      const AT_MaterialMapping *mappings,
+                                      uint32_t num_mappings)
+{
+    if (!out_model || *out_model || !glb || size == 0) return AT_ERR_INVALID_ARGUMENT;
+    if (!mappings_are_valid(mappings, num_mappings)) return AT_ERR_INVALID_ARGUMENT;
+
+    cgltf_options options = {0};
+    cgltf_data *data = NULL;
+    //cgltf points into glb rather than copying it, the GLB binary chunk included
+    cgltf_result res = cgltf_parse(&options, glb, size, &data);
+
+    if (res != cgltf_result_success) return AT_ERR_INVALID_ARGUMENT;
+
+    //no path, so only the embedded binary chunk and data: URIs resolve, never the file system
+    res = cgltf_load_buffers(&options, data, NULL);
+    if (res != cgltf_result_success) {
+        cgltf_free(data);
+        return AT_ERR_INVALID_ARGUMENT;
+    }
+
+    return model_from_gltf(out_model, data, mappings, num_mappings);
+}
+
+// flattens every mesh node of data into one AT_Model, always frees data
+static AT_Result model_from_gltf(AT_Model **out_model, cgltf_data *data,
+                                 const AT_MaterialMapping *mappings, uint32_t num_mappings)
+{
     if (data->nodes_count == 0 && data->meshes_count == 0) {
         cgltf_free(data);
         return AT_ERR_INVALID_ARGUMENT;
@@ -91,7 +187,7 @@ AT_Result AT_model_create(AT_Model **out_model, const char *filepath)
     AT_Vec3   *vertices          = malloc(sizeof(AT_Vec3)        * total_vertices);
     uint32_t  *indices           = malloc(sizeof(uint32_t)       * total_indices);
     AT_Vec3   *normals           = malloc(sizeof(AT_Vec3)        * total_vertices);
-    uint32_t  *triangle_materials = malloc(sizeof(AT_MaterialType)      * (total_indices / 3));
+    uint8_t   *triangle_materials = malloc(sizeof(uint8_t)        * (total_indices / 3));
 
     if (!vertices || !indices || !normals || !triangle_materials) {
         free(vertices); free(indices); free(normals); free(triangle_materials);
@@ -200,6 +296,10 @@ AT_Result AT_model_create(AT_Model **out_model, const char *filepath)
             indices[index_cursor + ii] = idx + base_vertex;
         }
 
+        /* --- materials (one per primitive, resolved once and shared by its triangles) --- */
+        uint8_t material = resolve_material(prim->material, mappings, num_mappings);
+        memset(triangle_materials + index_cursor / 3, material, idx_count / 3);
+
         index_cursor += (uint32_t)idx_count;
     }
 
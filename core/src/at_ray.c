@@ -55,7 +55,7 @@ AT_Result AT_ray_child_create_and_init(AT_Ray *ray,
                                        uint32_t num_rays,
                                        AT_Vec3 out_normal,
                                        AT_MaterialType mat_type,
-                                       AT_Ray *out_child)
+                                       AT_Ray **out_child)
 {
     AT_Ray *child = (AT_Ray *)malloc(sizeof(AT_Ray));
     if (!child) return AT_ERR_ALLOC_ERROR;
@@ -68,14 +68,22 @@ AT_Result AT_ray_child_create_and_init(AT_Ray *ray,
     child->origin = AT_vec3_add(ray->hit_point, offset);
 
     child->total_distance = ray->total_distance + AT_vec3_distance(ray->origin, ray->hit_point);
-    child->energy = ray->energy * (1.0f - AT_MATERIAL_TABLE[mat_type].absorption);
+    const AT_Material *material = &AT_MATERIAL_TABLE[mat_type];
+    child->energy = ray->energy * (1.0f - AT_bands_from_array(material->absorption));
+
+    //a ray has one direction for all bands, so it scatters with the
+    // probability of the energy weighted scattering coefficient
+    const float ray_energy = AT_bands_sum(ray->energy);
+    const float scattering = ray_energy > 0.0f ?
+        AT_bands_sum(ray->energy * AT_bands_from_array(material->scattering)) / ray_energy :
+        0.0f;
 
     float rand = AT_get_random_float();
-    if (rand < AT_MATERIAL_TABLE[mat_type].scattering) {
+    if (rand < scattering) {
         child->direction = AT_sample_cosine_hemisphere(out_normal);
     }
 
-    *out_child = *child;
+    *out_child = child;
 
     return AT_OK;
 }
@@ -20,7 +20,8 @@ static inline AT_Ray AT_ray_init(const AT_Vec3 origin,
         .hit_point = {0},
         .has_died = false,
         //accoustic energy transported by ray (initially, overall sound energy didived equally among rays)
-        .energy = energy,
+        //split equally among the bands, so they still sum to the ray's share of the source
+        .energy = AT_bands_splat(energy / AT_NUM_BANDS),
         .total_distance = current_distance,
         .ray_id = ray_id,
         .bounce_count = 0,
@@ -64,7 +65,7 @@ AT_Result AT_ray_child_create_and_init(AT_Ray *ray,
                                        uint32_t num_rays,
                                        AT_Vec3 out_normal,
                                        AT_MaterialType mat_type,
-                                       AT_Ray *out_child);
+                                       AT_Ray **out_child);
 
 void AT_ray_destroy_children(AT_Ray *ray);
 
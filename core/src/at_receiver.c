@@ -0,0 +1,357 @@
+#include "at_receiver.h"
+#include "at_internal.h"
+#include "at_bands.h"
+#include "acoustic/at.h"
+#include "acoustic/at_math.h"
+#include "../src/at_utils.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RECEIVER_C80_TIME 0.08f // s
+
+static inline uint32_t receiver_cell_coord(const AT_ReceiverSet *set, float p, int axis)
+{
+    const float cell = floorf((p - set->min.arr[axis]) / set->cell_size.arr[axis]);
+    return (uint32_t)AT_clamp(0.0f, cell, (float)(set->dims[axis] - 1));
+}
+
+AT_Result AT_receivers_create(AT_ReceiverSet **out_set, const AT_Receiver *receivers, uint32_t num_receivers,
+                              float bin_width, uint32_t num_layers)
+{
+    if (!out_set || *out_set || !receivers || num_receivers == 0 || bin_width <= 0.0f || num_layers == 0) {
+        return AT_ERR_INVALID_ARGUMENT;
+    }
+
+    float max_radius = 0.0f;
+    AT_Vec3 min = AT_vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+    AT_Vec3 max = AT_vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (uint32_t r = 0; r < num_receivers; r++) {
+        const AT_Receiver *receiver = &receivers[r];
+        if (!(receiver->radius > 0.0f) || !isfinite(receiver->radius)) return AT_ERR_INVALID_ARGUMENT;
+        for (int a = 0; a < 3; a++) {
+            if (!isfinite(receiver->position.arr[a])) return AT_ERR_INVALID_ARGUMENT;
+            min.arr[a] = fminf(min.arr[a], receiver->position.arr[a] - receiver->radius);
+            max.arr[a] = fmaxf(max.arr[a], receiver->position.arr[a] + receiver->radius);
+        }
+        max_radius = fmaxf(max_radius, receiver->radius);
+    }
+
+    AT_ReceiverSet *set = AT_CALLOC(1, sizeof(AT_ReceiverSet));
+    if (!set) return AT_ERR_ALLOC_ERROR;
+    set->num_receivers = num_receivers;
+    set->min = min;
+    set->max = max;
+    set->bin_width = bin_width;
+    set->num_layers = num_layers;
+
+    //cells about one receiver each, but never smaller than a sphere so it covers few cells
+    const AT_Vec3 extent = AT_vec3_sub(max, min);
+    const float cell = fmaxf(2.0f * max_radius, cbrtf(extent.x * extent.y * extent.z / (float)num_receivers));
+    uint32_t num_cells = 1;
+    for (int a = 0; a < 3; a++) {
+        set->dims[a] = (uint32_t)AT_clamp(1.0f, ceilf(extent.arr[a] / cell), (float)AT_RECEIVER_MAX_CELLS);
+        set->cell_size.arr[a] = extent.arr[a] / (float)set->dims[a];
+        num_cells *= set->dims[a];
+    }
+
+    set->receivers = AT_MALLOC(num_receivers * sizeof(AT_Receiver));
+    set->stamps = AT_CALLOC(num_receivers, sizeof(uint32_t));
+    set->cell_starts = AT_CALLOC(num_cells + 1, sizeof(uint32_t));
+    if (!set->receivers || !set->stamps || !set->cell_starts) {
+        AT_receivers_destroy(set);
+        return AT_ERR_ALLOC_ERROR;
+    }
+    memcpy(set->receivers, receivers, num_receivers * sizeof(AT_Receiver));
+
+    //counting pass then filling pass, every receiver listed in each cell its sphere's box overlaps
+    for (int pass = 0; pass < 2; pass++) {
+        for (uint32_t r = 0; r < num_receivers; r++) {
+            const AT_Receiver *receiver = &receivers[r];
+            uint32_t lo[3], hi[3];
+            for (int a = 0; a < 3; a++) {
+                lo[a] = receiver_cell_coord(set, receiver->position.arr[a] - receiver->radius, a);
+                hi[a] = receiver_cell_coord(set, receiver->position.arr[a] + receiver->radius, a);
+            }
+            for (uint32_t z = lo[2]; z <= hi[2]; z++) {
+                for (uint32_t y = lo[1]; y <= hi[1]; y++) {
+                    for (uint32_t x = lo[0]; x <= hi[0]; x++) {
+                        const uint32_t c = (z * set->dims[1] + y) * set->dims[0] + x;
+                        if (pass == 0) set->cell_starts[c + 1]++;
+                        else set->cell_items[set->cell_starts[c]++] = r;
+                    }
+                }
+            }
+        }
+
+        if (pass == 0) {
+            for (uint32_t c = 0; c < num_cells; c++) set->cell_starts[c + 1] += set->cell_starts[c];
+            set->cell_items = AT_MALLOC(AT_max(set->cell_starts[num_cells], 1u) * sizeof(uint32_t));
+            if (!set->cell_items) {
+                AT_receivers_destroy(set);
+                return AT_ERR_ALLOC_ERROR;
+            }
+        } else {
+            //filling advanced every start to the next cell's, shift them back
+            memmove(set->cell_starts + 1, set->cell_starts, num_cells * sizeof(uint32_t));
+            set->cell_starts[0] = 0;
+        }
+    }
+
+    *out_set = set;
+    return AT_OK;
+}
+
+AT_Result AT_receivers_reset(AT_ReceiverSet *set, uint32_t num_bins)
+{
+    if (!set || num_bins == 0) return AT_ERR_INVALID_ARGUMENT;
+
+    const size_t count = (size_t)set->num_layers * set->num_receivers * num_bins * AT_RECEIVER_BIN_FLOATS;
+    if (num_bins != set->num_bins) {
+        float *bins = AT_REALLOC(set->bins, count * sizeof(float));
+        if (!bins) return AT_ERR_ALLOC_ERROR;
+        set->bins = bins;
+        set->num_bins = num_bins;
+    }
+    memset(set->bins, 0, count * sizeof(float));
+    return AT_OK;
+}
+
+// adds the part of the segment inside receiver r, t along the unit direction
+static inline void receiver_collect(AT_ReceiverSet *set, const AT_Simulation *simulation, uint32_t layer,
+                                    uint32_t r, const AT_Ray *ray, AT_Vec3 direction, float length)
+{
+    const AT_Receiver *receiver = &set->receivers[r];
+    const AT_Vec3 to_origin = AT_vec3_sub(ray->origin, receiver->position);
+    const float b = AT_vec3_dot(to_origin, direction);
+    const float c = AT_vec3_dot(to_origin, to_origin) - receiver->radius * receiver->radius;
+    const float discriminant = b * b - c;
+    if (discriminant <= 0.0f) return;
+
+    const float root = sqrtf(discriminant);
+    const float t_enter = fmaxf(-b - root, 0.0f);
+    const float t_exit = fminf(-b + root, length);
+    const float chord = t_exit - t_enter;
+    if (chord <= 0.0f) return;
+
+    const float distance = ray->total_distance + 0.5f * (t_enter + t_exit);
+    const uint32_t bin = (uint32_t)(distance / simulation->speed_of_sound / set->bin_width);
+    if (bin >= set->num_bins || bin < set->first_traced_bin) return;
+
+    //track length estimator: chord over volume is the fluence of one ray through the sphere
+    const float volume = (4.0f / 3.0f) * (float)AT_PI * receiver->radius * receiver->radius * receiver->radius;
+    const AT_Bands energy = ray->energy * AT_bands_exp(-simulation->air_coefficient * distance) * (chord / volume);
+
+    float *bins = AT_receivers_bins(set, layer, r);
+    float *energies = bins + (size_t)bin * AT_NUM_BANDS;
+    for (int band = 0; band < AT_NUM_BANDS; band++) energies[band] += energy[band];
+
+    //sound arrives from where the ray came from
+    const float broadband = AT_bands_sum(energy);
+    float *arrival = bins + (size_t)set->num_bins * AT_NUM_BANDS + (size_t)bin * 3;
+    for (int a = 0; a < 3; a++) arrival[a] -= direction.arr[a] * broadband;
+}
+
+void AT_receivers_ray_step(AT_ReceiverSet *set, const AT_Simulation *simulation, uint32_t layer, const AT_Ray *ray,
+                           AT_Vec3 ray_end)
+{
+    const float length = AT_vec3_distance(ray->origin, ray_end);
+    if (length <= 0.0f) return;
+    const AT_Vec3 direction = AT_vec3_scale(AT_vec3_sub(ray_end, ray->origin), 1.0f / length);
+
+    //clip the segment to the box around the receivers
+    float t_min = 0.0f;
+    float t_max = length;
+    for (int a = 0; a < 3; a++) {
+        const float o = ray->origin.arr[a];
+        const float d = direction.arr[a];
+        if (d == 0.0f) {
+            if (o < set->min.arr[a] || o > set->max.arr[a]) return;
+            continue;
+        }
+        float t0 = (set->min.arr[a] - o) / d;
+        float t1 = (set->max.arr[a] - o) / d;
+        if (t0 > t1) {
+            const float swap = t0;
+            t0 = t1;
+            t1 = swap;
+        }
+        t_min = fmaxf(t_min, t0);
+        t_max = fminf(t_max, t1);
+    }
+    if (t_min > t_max) return;
+
+    //a receiver spanning several cells is only tested once per segment
+    if (++set->segment == 0) {
+        memset(set->stamps, 0, set->num_receivers * sizeof(uint32_t));
+        set->segment = 1;
+    }
+
+    int pos[3], step[3];
+    float t_next[3], t_delta[3];
+    for (int a = 0; a < 3; a++) {
+        const float entry = ray->origin.arr[a] + direction.arr[a] * t_min;
+        pos[a] = (int)receiver_cell_coord(set, entry, a);
+        const float d = direction.arr[a];
+        if (d > 0.0f) {
+            step[a] = 1;
+            t_next[a] = (set->min.arr[a] + (float)(pos[a] + 1) * set->cell_size.arr[a] - ray->origin.arr[a]) / d;
+            t_delta[a] = set->cell_size.arr[a] / d;
+        } else if (d < 0.0f) {
+            step[a] = -1;
+            t_next[a] = (set->min.arr[a] + (float)pos[a] * set->cell_size.arr[a] - ray->origin.arr[a]) / d;
+            t_delta[a] = -set->cell_size.arr[a] / d;
+        } else {
+            step[a] = 0;
+            t_next[a] = INFINITY;
+            t_delta[a] = INFINITY;
+        }
+    }
+
+    for (;;) {
+        const uint32_t c = ((uint32_t)pos[2] * set->dims[1] + (uint32_t)pos[1]) * set->dims[0] + (uint32_t)pos[0];
+        for (uint32_t i = set->cell_starts[c]; i < set->cell_starts[c + 1]; i++) {
+            const uint32_t r = set->cell_items[i];
+            if (set->stamps[r] == set->segment) continue;
+            set->stamps[r] = set->segment;
+            receiver_collect(set, simulation, layer, r, ray, direction, length);
+        }
+
+        int axis = t_next[0] < t_next[1] ? 0 : 1;
+        if (t_next[2] < t_next[axis]) axis = 2;
+        if (t_next[axis] > t_max) break;
+        pos[axis] += step[axis];
+        if ((unsigned)pos[axis] >= set->dims[axis]) break;
+        t_next[axis] += t_delta[axis];
+    }
+}
+
+void AT_receivers_scale(AT_ReceiverSet *set, float scale)
+{
+    const size_t count = (size_t)set->num_layers * set->num_receivers * set->num_bins * AT_RECEIVER_BIN_FLOATS;
+    for (size_t i = 0; i < count; i++) set->bins[i] *= scale;
+}
+
+void AT_receivers_mix(AT_ReceiverSet *set, const float *gains)
+{
+    if (set->num_layers < 2) return;
+
+    const size_t layer_size = (size_t)set->num_receivers * set->num_bins * AT_RECEIVER_BIN_FLOATS;
+    float *mix = set->bins;
+    memset(mix, 0, layer_size * sizeof(float));
+    for (uint32_t s = 0; s + 1 < set->num_layers; s++) {
+        const float gain = gains[s];
+        if (gain == 0.0f) continue;
+        const float *channel = set->bins + (s + 1) * layer_size;
+        for (size_t i = 0; i < layer_size; i++) mix[i] += gain * channel[i];
+    }
+}
+
+void AT_receivers_destroy(AT_ReceiverSet *set)
+{
+    if (!set) return;
+    AT_FREE(set->receivers);
+    AT_FREE(set->cell_starts);
+    AT_FREE(set->cell_items);
+    AT_FREE(set->stamps);
+    AT_FREE(set->bins);
+    AT_FREE(set);
+}
+
+AT_Result AT_simulation_receiver_etc(const AT_Simulation *simulation, uint32_t receiver,
+                                     AT_EnergyTimeCurve *out_etc)
+{
+    if (!simulation || !out_etc || !simulation->receivers) return AT_ERR_INVALID_ARGUMENT;
+    const AT_ReceiverSet *set = simulation->receivers;
+    if (receiver >= set->num_receivers) return AT_ERR_INVALID_ARGUMENT;
+
+    *out_etc = (AT_EnergyTimeCurve){.bin_width = set->bin_width};
+    if (set->num_bins == 0) return AT_OK;
+
+    const float *bins = AT_receivers_bins(set, 0, receiver);
+    out_etc->energy = bins;
+    out_etc->direction = bins + (size_t)set->num_bins * AT_NUM_BANDS;
+    out_etc->num_bins = set->num_bins;
+    return AT_OK;
+}
+
+// seconds for level_db to fall 60 dB, extrapolated from a least squares line through
+// the bins between from_db and to_db, NaN when it never falls to to_db
+static float acoustics_decay_time(const double *level_db, uint32_t onset, uint32_t num_bins, float bin_width,
+                                  double from_db, double to_db)
+{
+    uint32_t first = onset;
+    while (first < num_bins && level_db[first] > from_db) first++;
+    uint32_t last = first;
+    while (last < num_bins && level_db[last] > to_db) last++;
+    if (last >= num_bins) return NAN;
+    //the decay may drop to silence, -inf, straight from above to_db
+    if (!isfinite(level_db[last])) last--;
+    if (last <= first) return NAN;
+
+    const double n = (double)(last - first + 1);
+    double sum_t = 0.0, sum_l = 0.0, sum_tt = 0.0, sum_tl = 0.0;
+    for (uint32_t i = first; i <= last; i++) {
+        const double t = (double)(i - first);
+        sum_t += t;
+        sum_l += level_db[i];
+        sum_tt += t * t;
+        sum_tl += t * level_db[i];
+    }
+    const double slope = (n * sum_tl - sum_t * sum_l) / (n * sum_tt - sum_t * sum_t); //dB per bin
+    if (!(slope < 0.0)) return NAN;
+    return (float)(-60.0 / slope * bin_width);
+}
+
+AT_Result AT_etc_room_acoustics(const AT_EnergyTimeCurve *etc, AT_RoomAcoustics *out_acoustics)
+{
+    if (!etc || !out_acoustics || (etc->num_bins > 0 && !etc->energy) || !(etc->bin_width > 0.0f)) {
+        return AT_ERR_INVALID_ARGUMENT;
+    }
+
+    for (int band = 0; band < AT_NUM_BANDS; band++) {
+        out_acoustics->rt60[band] = NAN;
+        out_acoustics->edt[band] = NAN;
+        out_acoustics->c80[band] = NAN;
+    }
+    if (etc->num_bins == 0) return AT_OK;
+
+    double *level_db = AT_MALLOC(etc->num_bins * sizeof(double));
+    if (!level_db) return AT_ERR_ALLOC_ERROR;
+
+    const uint32_t early_bins = (uint32_t)lroundf(RECEIVER_C80_TIME / etc->bin_width);
+    for (int band = 0; band < AT_NUM_BANDS; band++) {
+        //the direct sound, everything is measured from when the first energy arrived
+        uint32_t onset = 0;
+        while (onset < etc->num_bins && !(etc->energy[(size_t)onset * AT_NUM_BANDS + band] > 0.0f)) onset++;
+        if (onset == etc->num_bins) continue;
+
+        //Schroeder backward integration, level_db[i] is the energy still to arrive from bin i on
+        double remaining = 0.0;
+        double early = 0.0;
+        double late = 0.0;
+        for (uint32_t i = etc->num_bins; i-- > onset;) {
+            const double energy = etc->energy[(size_t)i * AT_NUM_BANDS + band];
+            remaining += energy;
+            level_db[i] = remaining;
+            if (i - onset < early_bins) early += energy;
+            else late += energy;
+        }
+        const double total = remaining;
+        for (uint32_t i = onset; i < etc->num_bins; i++) {
+            level_db[i] = level_db[i] > 0.0 ? 10.0 * log10(level_db[i] / total) : -INFINITY;
+        }
+
+        out_acoustics->edt[band] = acoustics_decay_time(level_db, onset, etc->num_bins, etc->bin_width, 0.0, -10.0);
+        float rt60 = acoustics_decay_time(level_db, onset, etc->num_bins, etc->bin_width, -5.0, -35.0);
+        if (isnan(rt60)) rt60 = acoustics_decay_time(level_db, onset, etc->num_bins, etc->bin_width, -5.0, -25.0);
+        out_acoustics->rt60[band] = rt60;
+
+        if (early > 0.0 && late > 0.0) out_acoustics->c80[band] = (float)(10.0 * log10(early / late));
+    }
+
+    AT_FREE(level_db);
+    return AT_OK;
+}
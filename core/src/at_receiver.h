@@ -0,0 +1,62 @@
+#ifndef AT_RECEIVER_INTERNAL_H
+#define AT_RECEIVER_INTERNAL_H
+
+#include "acoustic/at.h"
+#include "at_internal.h"
+
+#include <stdint.h>
+
+#define AT_RECEIVER_DEFAULT_BIN_WIDTH 0.001f // s
+// cells per axis of the receiver grid, bounds its memory however spread out they are
+#define AT_RECEIVER_MAX_CELLS 64
+// floats per bin of a receiver, AT_NUM_BANDS energies then a direction
+#define AT_RECEIVER_BIN_FLOATS (AT_NUM_BANDS + 3)
+
+// AT_Settings.receivers with a uniform grid over them, so a ray segment only
+// tests the receivers in the cells it passes through
+struct AT_ReceiverSet {
+    AT_Receiver *receivers;
+    uint32_t num_receivers;
+    AT_Vec3 min;           // box around every sphere
+    AT_Vec3 max;
+    AT_Vec3 cell_size;
+    uint32_t dims[3];
+    uint32_t *cell_starts; // dims product + 1, receivers of cell c are cell_items[cell_starts[c] .. cell_starts[c + 1])
+    uint32_t *cell_items;
+    uint32_t *stamps;      // per receiver, last segment it was tested against
+    uint32_t segment;
+    float bin_width;
+    uint32_t num_bins;
+    uint32_t first_traced_bin; // rays only collect from here on, the bins before belong to the image sources
+    // layer 0 holds the curves AT_simulation_receiver_etc() returns, with source channels
+    // layer 1 + s holds source s and layer 0 their sum weighted by the gains
+    uint32_t num_layers;
+    // per layer per receiver num_bins * AT_NUM_BANDS energies then num_bins * 3 directions
+    float *bins;
+};
+
+AT_Result AT_receivers_create(AT_ReceiverSet **out_set, const AT_Receiver *receivers, uint32_t num_receivers,
+                              float bin_width, uint32_t num_layers);
+
+// sizes every layer for num_bins and zeroes it, before a run collects into it
+AT_Result AT_receivers_reset(AT_ReceiverSet *set, uint32_t num_bins);
+
+// energy bins of a receiver in a layer, its directions follow at + num_bins * AT_NUM_BANDS
+static inline float *AT_receivers_bins(const AT_ReceiverSet *set, uint32_t layer, uint32_t receiver)
+{
+    return set->bins + ((size_t)layer * set->num_receivers + receiver) * set->num_bins * AT_RECEIVER_BIN_FLOATS;
+}
+
+// adds the energy of segment [ray->origin, ray_end] to every receiver it crosses in layer
+void AT_receivers_ray_step(AT_ReceiverSet *set, const AT_Simulation *simulation, uint32_t layer, const AT_Ray *ray,
+                           AT_Vec3 ray_end);
+
+// multiplies every layer by scale, e.g. to normalise a batched run that stopped early
+void AT_receivers_scale(AT_ReceiverSet *set, float scale);
+
+// sums layers 1 .. num_layers - 1 weighted by gains into layer 0
+void AT_receivers_mix(AT_ReceiverSet *set, const float *gains);
+
+void AT_receivers_destroy(AT_ReceiverSet *set);
+
+#endif // AT_RECEIVER_INTERNAL_H
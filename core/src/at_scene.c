@@ -14,11 +14,22 @@ AT_Result AT_scene_create(AT_Scene **out_scene, const AT_SceneConfig *config)
     if (config->num_sources <= 0 || !config->sources) return AT_ERR_INVALID_ARGUMENT;
     if (!config->environment) return AT_ERR_INVALID_ARGUMENT;
 
+    if (config->material >= AT_MATERIAL_COUNT) return AT_ERR_INVALID_ARGUMENT;
+
     AT_Scene *scene = calloc(1, sizeof(AT_Scene));
     if (!scene) return AT_ERR_ALLOC_ERROR;
 
-    for (uint32_t t = 0; t < config->environment->index_count / 3; t++) {
-        config->environment->triangle_materials[t] = config->material;
+    //the model is borrowed, so the scene keeps its own resolved copy,
+    // triangles the model didnt assign a material to get the scene's material
+    uint32_t num_triangles = config->environment->index_count / 3;
+    scene->triangle_materials = malloc(sizeof(*scene->triangle_materials) * num_triangles);
+    if (!scene->triangle_materials) {
+        free(scene);
+        return AT_ERR_ALLOC_ERROR;
+    }
+    for (uint32_t t = 0; t < num_triangles; t++) {
+        uint8_t material = config->environment->triangle_materials[t];
+        scene->triangle_materials[t] = (material == AT_MATERIAL_UNASSIGNED) ? (uint8_t)config->material : material;
     }
 
     scene->environment = config->environment;
@@ -29,6 +40,7 @@ AT_Result AT_scene_create(AT_Scene **out_scene, const AT_SceneConfig *config)
 
     scene->sources = malloc(sizeof(AT_Source) * config->num_sources);
     if (!scene->sources) {
+        free(scene->triangle_materials);
         free(scene);
         return AT_ERR_ALLOC_ERROR;
     }
@@ -84,6 +96,7 @@ void AT_scene_destroy(AT_Scene *scene)
         AT_MiniTree_destroy(scene->mini_trees[i]);
     }
     AT_triangle_arrays_destroy(scene->triangle_arrs);
+    free(scene->triangle_materials);
     free(scene->sources);
     free(scene);
 }
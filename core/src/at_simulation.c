@@ -4,15 +4,45 @@
 #include "acoustic/at_model.h"
 #include "acoustic/at_scene.h"
 #include "../src/at_voxel.h"
+#include "at_attenuation.h"
 #include "at_bvh.h"
+#include "at_image_source.h"
 #include "at_internal.h"
 #include "at_ray.h"
+#include "at_receiver.h"
+#include "at_store.h"
 #include "at_utils.h"
 
 #include <stdint.h>
 #include <stdlib.h>
 #include <math.h>
 #include <float.h>
+#include <time.h>
+
+//rays / segments between two checks for cancellation, a check is an atomic load and
+//a clock read, a batch of rays traces in well under a millisecond
+#define AT_CANCEL_CHECK_RAYS 64
+#define AT_CANCEL_CHECK_SEGMENTS 4096
+
+//batches a batched run traces before its error estimate may stop it, fewer give a
+//spread between batches too noisy to trust
+#define AT_BATCH_MIN_FOR_STOP 4
+
+// 4V / S, the average distance a ray travels between two reflections, V taken from the
+// scene's bounding box so open models still get one
+static float simulation_mean_free_path(const AT_Scene *scene)
+{
+    const AT_Model *model = scene->environment;
+    double area = 0.0;
+    for (size_t i = 0; i + 2 < model->index_count; i += 3) {
+        const AT_Vec3 v1 = model->vertices[model->indices[i]];
+        const AT_Vec3 edge1 = AT_vec3_sub(model->vertices[model->indices[i + 1]], v1);
+        const AT_Vec3 edge2 = AT_vec3_sub(model->vertices[model->indices[i + 2]], v1);
+        area += 0.5 * AT_vec3_length(AT_vec3_cross(edge1, edge2));
+    }
+    const AT_Vec3 size = AT_vec3_sub(scene->world_AABB.max, scene->world_AABB.min);
+    return area > 0.0 ? (float)(4.0 * size.x * size.y * size.z / area) : 0.0f;
+}
 
 AT_Result AT_simulation_create(AT_Simulation **out_simulation,
                                const AT_Scene *scene,
@@ -20,12 +50,19 @@ AT_Result AT_simulation_create(AT_Simulation **out_simulation,
 {
     if (!scene || !settings) return AT_ERR_INVALID_ARGUMENT;
     if (settings->fps <= 0 || settings->voxel_size <= 0.0f) return AT_ERR_INVALID_ARGUMENT;
+    if (settings->deposition > AT_DEPOSITION_ACCURATE) return AT_ERR_INVALID_ARGUMENT;
+
+    const AT_Attenuation attenuation = settings->attenuation ?
+        *settings->attenuation : AT_attenuation_default();
+    if (!AT_attenuation_is_valid(&attenuation)) return AT_ERR_INVALID_ARGUMENT;
+    //rays are indexed s * num_rays + r in 32 bits
+    if ((uint64_t)settings->num_rays * scene->num_sources > UINT32_MAX) return AT_ERR_INVALID_ARGUMENT;
 
     AT_Simulation *simulation = calloc(1, sizeof(AT_Simulation));
     if (!simulation) return AT_ERR_ALLOC_ERROR;
 
     //need to store all rays per source
-    simulation->rays = (AT_Ray*)calloc(settings->num_rays * scene->num_sources, sizeof(AT_Ray));
+    simulation->rays = (AT_Ray*)calloc((size_t)settings->num_rays * scene->num_sources, sizeof(AT_Ray));
     if (!simulation->rays) {
         free(simulation);
         return AT_ERR_ALLOC_ERROR;
@@ -33,6 +70,18 @@ AT_Result AT_simulation_create(AT_Simulation **out_simulation,
 
     simulation->scene = scene;
 
+    //a copy of the scene's sources, AT_simulation_set_source moves them without the scene
+    simulation->sources = malloc(sizeof(AT_Source) * scene->num_sources);
+    simulation->source_traced = calloc(scene->num_sources, sizeof(bool));
+    if (!simulation->sources || !simulation->source_traced) {
+        free(simulation->sources);
+        free(simulation->source_traced);
+        free(simulation->rays);
+        free(simulation);
+        return AT_ERR_ALLOC_ERROR;
+    }
+    memcpy(simulation->sources, scene->sources, sizeof(AT_Source) * scene->num_sources);
+
     // World dimensions
     AT_Vec3 dimensions = AT_vec3_sub(scene->world_AABB.max, scene->world_AABB.min);
 
@@ -47,6 +96,8 @@ AT_Result AT_simulation_create(AT_Simulation **out_simulation,
 
     simulation->voxel_grid = calloc(num_voxels, sizeof(AT_Voxel));
     if (!simulation->voxel_grid) {
+        free(simulation->sources);
+        free(simulation->source_traced);
         free(simulation->rays);
         free(simulation);
         return AT_ERR_ALLOC_ERROR;
@@ -65,6 +116,100 @@ AT_Result AT_simulation_create(AT_Simulation **out_simulation,
     simulation->grid_dimensions = grid;
     simulation->voxel_size = settings->voxel_size;
     simulation->bin_width = 1.0f / settings->fps;
+    simulation->inv_bin_width = (float)settings->fps;
+    simulation->deposition = settings->deposition;
+    simulation->attenuation = attenuation.model;
+    simulation->speed_of_sound = attenuation.speed_of_sound;
+    simulation->cancel = settings->cancel;
+    simulation->time_limit = settings->time_limit > 0.0f ? settings->time_limit : 0.0f;
+    simulation->batch_rays = settings->batch_rays;
+    simulation->target_error = settings->target_error > 0.0f ? settings->target_error : 0.0f;
+
+    //the error region in voxels, [min, max) per axis, whole cells around the box
+    for (int a = 0; a < 3; a++) {
+        simulation->error_min[a] = 0;
+        simulation->error_max[a] = (uint32_t)grid.arr[a];
+        if (!settings->error_region) continue;
+
+        const float lo = floorf((settings->error_region->min.arr[a] - simulation->origin.arr[a]) / settings->voxel_size);
+        const float hi = ceilf((settings->error_region->max.arr[a] - simulation->origin.arr[a]) / settings->voxel_size);
+        simulation->error_min[a] = (uint32_t)AT_clamp(0.0f, lo, grid.arr[a]);
+        simulation->error_max[a] = (uint32_t)AT_clamp(0.0f, hi, grid.arr[a]);
+        if (simulation->error_min[a] >= simulation->error_max[a]) {
+            AT_simulation_destroy(simulation);
+            return AT_ERR_INVALID_ARGUMENT;
+        }
+    }
+
+    if (settings->result_path) {
+        simulation->result_path = strdup(settings->result_path);
+        if (!simulation->result_path) {
+            free(simulation->sources);
+            free(simulation->source_traced);
+            free(simulation->voxel_grid);
+            free(simulation->rays);
+            free(simulation);
+            return AT_ERR_ALLOC_ERROR;
+        }
+    }
+
+    //every source deposits into a grid of its own, voxel_grid becomes their weighted sum
+    if (settings->source_channels) {
+        const size_t num_channel_voxels = (size_t)scene->num_sources * num_voxels;
+        simulation->channels = malloc(sizeof(AT_Voxel) * num_channel_voxels);
+        simulation->source_gains = malloc(sizeof(float) * scene->num_sources);
+        if (!simulation->channels || !simulation->source_gains) {
+            free(simulation->channels);
+            simulation->channels = NULL;
+            AT_simulation_destroy(simulation);
+            return AT_ERR_ALLOC_ERROR;
+        }
+        for (size_t i = 0; i < num_channel_voxels; i++) AT_voxel_init(&simulation->channels[i]);
+        for (uint32_t s = 0; s < scene->num_sources; s++) simulation->source_gains[s] = 1.0f;
+    }
+
+    //with channels every source collects into a layer of its own, mixed like the voxels
+    if (settings->receivers && settings->num_receivers > 0) {
+        const float bin_width = settings->receiver_bin_width > 0.0f ?
+            settings->receiver_bin_width : AT_RECEIVER_DEFAULT_BIN_WIDTH;
+        const uint32_t num_layers = simulation->channels ? 1 + scene->num_sources : 1;
+        AT_Result res = AT_receivers_create(&simulation->receivers, settings->receivers, settings->num_receivers,
+                                            bin_width, num_layers);
+        if (res != AT_OK) {
+            AT_simulation_destroy(simulation);
+            return res;
+        }
+    }
+
+    //the receivers hear image sources up to the crossover and the rays after it
+    if (simulation->receivers && settings->image_source_order > 0) {
+        AT_Result res = AT_image_sources_create(&simulation->image_sources, scene, settings->image_source_order);
+        if (res != AT_OK) {
+            AT_simulation_destroy(simulation);
+            return res;
+        }
+        const float crossover = settings->crossover_time > 0.0f ? settings->crossover_time :
+            settings->image_source_order * simulation_mean_free_path(scene) / attenuation.speed_of_sound;
+        simulation->receivers->first_traced_bin = (uint32_t)ceilf(crossover / simulation->receivers->bin_width);
+    }
+
+    //resolved once here so the DDA kernels only ever see a single coefficient
+    switch (attenuation.model) {
+        case AT_ATTENUATION_LEGACY:
+            simulation->air_coefficient = AT_bands_splat(AT_LEGACY_AIR_COEFFICIENT);
+            break;
+        case AT_ATTENUATION_NONE:
+            simulation->air_coefficient = AT_bands_splat(0.0f);
+            break;
+        default:
+            for (int b = 0; b < AT_NUM_BANDS; b++) {
+                simulation->air_coefficient[b] = AT_attenuation_air_coefficient(AT_BAND_FREQUENCIES[b],
+                                                                                attenuation.temperature,
+                                                                                attenuation.humidity,
+                                                                                attenuation.pressure);
+            }
+            break;
+    }
 
     *out_simulation = simulation;
 
@@ -75,16 +220,21 @@ AT_Result AT_simulation_create(AT_Simulation **out_simulation,
 #define SOURCE_ENERGY 1.0f //this can be the power of the sound source defined by the user
 
 
+// emits fresh rays at every source whose traced paths are stale, dropping the old paths,
+// the other sources keep theirs for the run to deposit again
 void AT_simulation_rays_init(AT_Simulation *simulation)
 {
 for (uint32_t s = 0; s < simulation->scene->num_sources; s++) {
+        if (simulation->source_traced[s]) continue;
+
         //init rays for this source
         for (uint32_t r = 0; r < simulation->num_rays; r++) {
             uint32_t ray_idx = s * simulation->num_rays + r;
-            AT_Vec3 hemisphere_dir = AT_sample_cosine_hemisphere(simulation->scene->sources[s].direction);
+            if (simulation->rays[ray_idx].child) AT_ray_destroy_children(simulation->rays[ray_idx].child);
+            AT_Vec3 hemisphere_dir = AT_sample_cosine_hemisphere(simulation->sources[s].direction);
 
             simulation->rays[ray_idx] = AT_ray_init(
-                simulation->scene->sources[s].position,
+                simulation->sources[s].position,
                 hemisphere_dir,
                 0.0f,
                 SOURCE_ENERGY / simulation->num_rays,
@@ -94,78 +244,653 @@ for (uint32_t s = 0; s < simulation->scene->num_sources; s++) {
     }
 }
 
-AT_Result AT_simulation_run(AT_Simulation *simulation)
+// true when source s's channel still holds the bins of its current paths, a source
+// is only marked traced once a run deposited it completely
+static inline bool simulation_channel_is_current(const AT_Simulation *simulation, uint32_t s)
 {
-    if (!simulation) return AT_ERR_INVALID_ARGUMENT;
+    return simulation->channels && simulation->source_traced[s];
+}
 
-    const float MIN_ENERGY_THRESHOLD = 0.8f / simulation->num_rays;
+// the grid primary ray i deposits into, its source's channel when there are channels
+static inline AT_Voxel *simulation_deposit_grid(const AT_Simulation *simulation, uint32_t i)
+{
+    if (!simulation->channels) return simulation->voxel_grid;
+    return &simulation->channels[(size_t)(i / simulation->num_rays) * simulation->num_voxels];
+}
 
-    //initialize and trace rays at every source
-    AT_simulation_rays_init(simulation);
+// empties every voxel for the next run, keeping the bin arrays allocated: a voxel
+// only zero fills the bins it grows back into, so this costs one store per voxel,
+// channels of sources that did not move keep their bins
+static void simulation_reset_bins(AT_Simulation *simulation)
+{
+    //mapped voxels go back to empty heap ones, the run maps the file afresh
+    AT_result_store_detach(simulation);
+    for (uint32_t v = 0; v < simulation->num_voxels; v++) simulation->voxel_grid[v].count = 0;
 
-    //trace rays for this source
+    if (!simulation->channels) return;
+    for (uint32_t s = 0; s < simulation->scene->num_sources; s++) {
+        if (simulation_channel_is_current(simulation, s)) continue;
+        AT_Voxel *channel = &simulation->channels[(size_t)s * simulation->num_voxels];
+        for (uint32_t v = 0; v < simulation->num_voxels; v++) channel[v].count = 0;
+    }
+}
+
+// sums the channels into the voxel grid with their gains, bins [first, last) of every
+// voxel only, the time ordered deposit mixes each frame once it is final
+static void simulation_mix_bins(AT_Simulation *simulation, size_t first, size_t last)
+{
+    const uint32_t num_sources = simulation->scene->num_sources;
+    for (uint32_t v = 0; v < simulation->num_voxels; v++) {
+        size_t count = 0;
+        for (uint32_t s = 0; s < num_sources; s++) {
+            count = AT_max(count, simulation->channels[(size_t)s * simulation->num_voxels + v].count);
+        }
+        count = AT_min(count, last);
+        if (count <= first) continue;
+
+        //mapped voxels are sized for the whole timeline already and never grow
+        AT_Voxel *mix = &simulation->voxel_grid[v];
+        AT_voxel_grow(mix, count);
+        memset(mix->items + first, 0, (count - first) * sizeof(*mix->items));
+        for (uint32_t s = 0; s < num_sources; s++) {
+            const AT_Voxel *channel = &simulation->channels[(size_t)s * simulation->num_voxels + v];
+            const float gain = simulation->source_gains[s];
+            const size_t end = AT_min(channel->count, count);
+            for (size_t b = first; b < end; b++) mix->items[b] += gain * channel->items[b];
+        }
+    }
+}
+
+static double simulation_clock(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// true once the run's token was cancelled or its time limit passed
+static bool simulation_should_stop(const AT_Simulation *simulation)
+{
+    if (AT_cancel_token_is_cancelled(simulation->cancel)) return true;
+    return simulation->deadline > 0.0 && simulation_clock() > simulation->deadline;
+}
+
+static AT_Result simulation_stop(AT_Simulation *simulation)
+{
+    atomic_store_explicit(&simulation->phase, AT_PHASE_CANCELLED, memory_order_release);
+    return AT_ERR_CANCELLED;
+}
+
+// ray_end of a traced segment, the open ended last segment of a live ray runs the AABB diagonal
+static inline bool simulation_segment_end(const AT_Simulation *simulation, const AT_Ray *ray, AT_Vec3 *out_end)
+{
+    if (ray->child) {
+        *out_end = ray->hit_point;
+        return true;
+    }
+    if (ray->has_died) return false;
+
+    *out_end = AT_vec3_add(
+        ray->origin,
+        AT_vec3_scale(ray->direction,
+                      AT_vec3_distance(simulation->scene->world_AABB.min,
+                                       simulation->scene->world_AABB.max)));
+    return true;
+}
+
+// furthest any segment reaches along its path from the source, known once every path is traced
+static double simulation_max_distance(const AT_Simulation *simulation)
+{
+    const uint32_t total_rays = simulation->scene->num_sources * simulation->num_rays;
+    double max_distance = 0.0;
+    for (uint32_t i = 0; i < total_rays; i++) {
+        for (const AT_Ray *ray = &simulation->rays[i]; ray; ray = ray->child) {
+            AT_Vec3 ray_end;
+            if (!simulation_segment_end(simulation, ray, &ray_end)) break;
+            double end = (double)ray->total_distance + AT_vec3_distance(ray->origin, ray_end);
+            if (end > max_distance) max_distance = end;
+        }
+    }
+    return max_distance;
+}
+
+// upper bound on the time bins the DDA pass can touch
+static uint32_t simulation_max_bins(const AT_Simulation *simulation)
+{
+    //the kernels compute bins in float, two spare bins cover their rounding
+    const double bins_per_metre = (double)simulation->inv_bin_width / simulation->speed_of_sound;
+    return (uint32_t)(simulation_max_distance(simulation) * bins_per_metre) + 2;
+}
+
+// collects the paths of the first rays_per_source rays of every source into the receivers,
+// times scale, and the image sources' early reflections before them, with channels each
+// source into its own layer which are then mixed
+static AT_Result simulation_collect_receivers(AT_Simulation *simulation, uint32_t rays_per_source, float scale)
+{
+    AT_ReceiverSet *receivers = simulation->receivers;
+    if (!receivers) return AT_OK;
+
+    const double bins_per_metre = 1.0 / ((double)simulation->speed_of_sound * receivers->bin_width);
+    const uint32_t num_bins = (uint32_t)(simulation_max_distance(simulation) * bins_per_metre) + 2;
+    AT_Result res = AT_receivers_reset(receivers, AT_max(num_bins, receivers->first_traced_bin));
+    if (res != AT_OK) return res;
+
+    for (uint32_t s = 0; s < simulation->scene->num_sources; s++) {
+        const uint32_t layer = simulation->channels ? 1 + s : 0;
+        for (uint32_t r = 0; r < rays_per_source; r++) {
+            if (r % AT_CANCEL_CHECK_RAYS == 0 && simulation_should_stop(simulation)) {
+                return simulation_stop(simulation);
+            }
+            for (const AT_Ray *ray = &simulation->rays[s * simulation->num_rays + r]; ray; ray = ray->child) {
+                AT_Vec3 ray_end;
+                if (!simulation_segment_end(simulation, ray, &ray_end)) break;
+                AT_receivers_ray_step(receivers, simulation, layer, ray, ray_end);
+            }
+        }
+    }
+
+    if (scale != 1.0f) AT_receivers_scale(receivers, scale);
+    if (simulation->image_sources) {
+        for (uint32_t s = 0; s < simulation->scene->num_sources; s++) {
+            AT_image_sources_collect(simulation->image_sources, receivers, simulation, s,
+                                     simulation->channels ? 1 + s : 0, SOURCE_ENERGY);
+        }
+    }
+    if (simulation->channels) AT_receivers_mix(receivers, simulation->source_gains);
+    return AT_OK;
+}
+
+// follows primary ray i through the scene, spawning a child per reflection until
+// every band has decayed below min_energy or the ray leaves the scene
+static inline AT_Result simulation_trace_ray(AT_Simulation *simulation, uint32_t i,
+                                             float min_energy, uint64_t *bounces)
+{
+    AT_Ray *ray = &simulation->rays[i];
+    //a ray lives while any band still carries energy
+    while (AT_bands_max(ray->energy) > min_energy) {
+        AT_IntersectContext ctx = AT_IntersectContext_init();
+        AT_MiniTree_intersect(&ctx,
+                              simulation->scene->mini_trees,
+                              simulation->scene->num_trees, ray);
+        if (!ctx.intersects) break;
+        AT_MaterialType mat_type = simulation->scene->triangle_materials[ctx.triangle_index];
+        AT_Ray *child = NULL;
+
+        AT_Result res = AT_ray_child_create_and_init(ray,
+                                                     ctx.out_ray,
+                                                     simulation->num_rays,
+                                                     ctx.out_normal,
+                                                     mat_type,
+                                                     &child);
+        if (res != AT_OK) return res;
+
+        ray->child = child;
+        ray = ray->child;
+        (*bounces)++;
+    }
+    if (AT_bands_max(ray->energy) < min_energy) ray->has_died = true;
+    return AT_OK;
+}
+
+// deposits the whole path of primary ray i
+static inline void simulation_deposit_ray(AT_Simulation *simulation, uint32_t i)
+{
+    AT_Voxel *grid = simulation_deposit_grid(simulation, i);
+    for (AT_Ray *ray = &simulation->rays[i]; ray; ray = ray->child) {
+        AT_Vec3 ray_end;
+        //segments end at their hit point, a live ray's last one continues for max_AABB distance
+        if (!simulation_segment_end(simulation, ray, &ray_end)) break;
+
+        AT_voxel_ray_step(simulation, grid, ray, ray_end);
+    }
+}
+
+// deposits every path ray by ray, the order the bins have always been summed in
+static AT_Result simulation_deposit(AT_Simulation *simulation)
+{
     uint32_t total_rays = simulation->scene->num_sources * simulation->num_rays;
     for (uint32_t i = 0; i < total_rays; i++) {
-        AT_Ray *ray = &simulation->rays[i];
-        while (ray->energy > MIN_ENERGY_THRESHOLD) {
-            AT_IntersectContext ctx = AT_IntersectContext_init();
-            AT_MiniTree_intersect(&ctx,
-                                  simulation->scene->mini_trees,
-                                  simulation->scene->num_trees, ray);
-            if (!ctx.intersects) break;
-            AT_MaterialType mat_type = simulation->scene->environment->triangle_materials[ctx.triangle_index];
-            AT_Ray child;
-
-            AT_Result res = AT_ray_child_create_and_init(ray, 
-                                                         ctx.out_ray,
-                                                         simulation->num_rays,
-                                                         ctx.out_normal,
-                                                         mat_type,
-                                                         &child);
-            if (res != AT_OK) return res;
-
-            ray->child = &child;
-            ray = ray->child;
-        }
-        if (ray->energy < MIN_ENERGY_THRESHOLD) ray->has_died = true;
+        if (i % AT_CANCEL_CHECK_RAYS == 0 && simulation_should_stop(simulation)) {
+            return simulation_stop(simulation);
+        }
+        if (simulation_channel_is_current(simulation, i / simulation->num_rays)) continue;
+        simulation_deposit_ray(simulation, i);
+        atomic_store_explicit(&simulation->rays_deposited, i + 1, memory_order_relaxed);
+    }
+    return AT_OK;
+}
+
+// deposits every segment in order of the frame its start time falls in, a segment
+// only deposits at or after its start, so once every segment starting in frame b
+// is in, frames [0, b] can not change anymore and are handed to on_frames, with
+// channels those frames are mixed first
+static AT_Result simulation_deposit_in_time_order(AT_Simulation *simulation,
+                                                  AT_FramesReadyFunc on_frames,
+                                                  void *user_data)
+{
+    const uint32_t total_rays = simulation->scene->num_sources * simulation->num_rays;
+    //same float expression the kernels start their bins from, so a bucket never
+    //rounds to a later frame than the segment's first deposit
+    const float bins_per_metre = simulation->inv_bin_width / simulation->speed_of_sound;
+
+    //counting sort of the segments by start frame, pass 1 sizes the buckets
+    size_t num_segments = 0;
+    uint32_t num_buckets = 0;
+    for (uint32_t i = 0; i < total_rays; i++) {
+        if (simulation_channel_is_current(simulation, i / simulation->num_rays)) continue;
+        for (const AT_Ray *ray = &simulation->rays[i]; ray; ray = ray->child) {
+            AT_Vec3 ray_end;
+            if (!simulation_segment_end(simulation, ray, &ray_end)) break;
+            uint32_t bucket = (uint32_t)(ray->total_distance * bins_per_metre);
+            if (bucket >= num_buckets) num_buckets = bucket + 1;
+            num_segments++;
+        }
+    }
+
+    size_t *starts = calloc((size_t)num_buckets + 1, sizeof(size_t));
+    const AT_Ray **segments = malloc(sizeof(AT_Ray *) * (num_segments > 0 ? num_segments : 1));
+    //the grid of every segment, only needed when sources deposit into their own channels
+    AT_Voxel **grids = simulation->channels ? malloc(sizeof(AT_Voxel *) * (num_segments > 0 ? num_segments : 1)) : NULL;
+    if (!starts || !segments || (simulation->channels && !grids)) {
+        free(starts);
+        free(segments);
+        free(grids);
+        return AT_ERR_ALLOC_ERROR;
     }
 
-    //DDA
     for (uint32_t i = 0; i < total_rays; i++) {
-        AT_Ray *ray = &simulation->rays[i];
+        if (simulation_channel_is_current(simulation, i / simulation->num_rays)) continue;
+        for (const AT_Ray *ray = &simulation->rays[i]; ray; ray = ray->child) {
+            AT_Vec3 ray_end;
+            if (!simulation_segment_end(simulation, ray, &ray_end)) break;
+            starts[(uint32_t)(ray->total_distance * bins_per_metre) + 1]++;
+        }
+    }
+    for (uint32_t b = 0; b < num_buckets; b++) starts[b + 1] += starts[b];
 
-        while (ray) {
+    //pass 2 fills them, rays in order within a bucket
+    for (uint32_t i = 0; i < total_rays; i++) {
+        if (simulation_channel_is_current(simulation, i / simulation->num_rays)) continue;
+        AT_Voxel *grid = simulation_deposit_grid(simulation, i);
+        for (const AT_Ray *ray = &simulation->rays[i]; ray; ray = ray->child) {
             AT_Vec3 ray_end;
-            //if the ray has an endpoint, set it
-            if (ray->child) {
-                ray_end = ray->hit_point;
-            //if the ray doesnt have an end point but hasnt died, continue it for max_AABB distance
-            } else if (!ray->has_died) {
-                ray_end = AT_vec3_add(
-                            ray->origin,
-                            AT_vec3_scale(
-                                ray->direction,
-                                AT_vec3_distance(
-                                    simulation->scene->world_AABB.min,
-                                    simulation->scene->world_AABB.max
-                                )
-                            )
-                        );
-            } else {
+            if (!simulation_segment_end(simulation, ray, &ray_end)) break;
+            const size_t slot = starts[(uint32_t)(ray->total_distance * bins_per_metre)]++;
+            segments[slot] = ray;
+            if (grids) grids[slot] = grid;
+        }
+    }
+    //the fill advanced every start to the next bucket's, shift them back
+    for (uint32_t b = num_buckets; b > 0; b--) starts[b] = starts[b - 1];
+    starts[0] = 0;
+
+    AT_Result res = AT_OK;
+    size_t num_mixed = 0;
+    for (uint32_t b = 0; b < num_buckets && res == AT_OK; b++) {
+        for (size_t s = starts[b]; s < starts[b + 1]; s++) {
+            if (s % AT_CANCEL_CHECK_SEGMENTS == 0 && simulation_should_stop(simulation)) {
+                res = simulation_stop(simulation);
                 break;
             }
+            AT_Vec3 ray_end;
+            simulation_segment_end(simulation, segments[s], &ray_end);
+            AT_voxel_ray_step(simulation, grids ? grids[s] : simulation->voxel_grid, segments[s], ray_end);
+        }
+        if (res != AT_OK) break;
+        //whole rays only finish at the very end in this order, report the segment share
+        atomic_store_explicit(&simulation->rays_deposited,
+                              (uint32_t)((double)total_rays * starts[b + 1] / num_segments),
+                              memory_order_relaxed);
+        if (starts[b + 1] > starts[b]) {
+            if (simulation->channels) {
+                simulation_mix_bins(simulation, num_mixed, b + 1);
+                num_mixed = b + 1;
+            }
+            res = on_frames(user_data, b + 1);
+        }
+    }
+    free(grids);
+    free(segments);
+    free(starts);
+    if (res != AT_OK) return res;
+
+    //segments of the last buckets reach on past them, everything is final now
+    if (simulation->channels) simulation_mix_bins(simulation, num_mixed, SIZE_MAX);
+    uint32_t num_frames = 0;
+    for (uint32_t v = 0; v < simulation->num_voxels; v++) {
+        if (simulation->voxel_grid[v].count > num_frames) num_frames = (uint32_t)simulation->voxel_grid[v].count;
+    }
+    return on_frames(user_data, num_frames);
+}
+
+// broadband energy of every voxel summed over its whole timeline into out_totals
+static void simulation_voxel_totals(const AT_Simulation *simulation, double *out_totals)
+{
+    for (uint32_t v = 0; v < simulation->num_voxels; v++) {
+        const AT_Voxel *voxel = &simulation->voxel_grid[v];
+        AT_Bands sum = AT_bands_splat(0.0f);
+        for (size_t b = 0; b < voxel->count; b++) sum += voxel->items[b];
+        out_totals[v] = AT_bands_sum(sum);
+    }
+}
+
+// variance of voxel v's mean energy per ray, from the spread between batches,
+// sum(delta^2 / n) - S^2 / N over the batches' degrees of freedom
+static inline double simulation_voxel_variance(const AT_Simulation *simulation, uint32_t v)
+{
+    const double mean = simulation->batch_totals[v] / simulation->rays_done;
+    const double spread = simulation->batch_squares[v] - simulation->batch_totals[v] * mean;
+    return spread > 0.0 ? spread / ((double)(simulation->num_batches - 1) * simulation->rays_done) : 0.0;
+}
+
+// relative RMS error over the error region, sqrt(sum var) / sqrt(sum mean^2), negative
+// while there is no spread to estimate it from yet
+static float simulation_region_error(const AT_Simulation *simulation)
+{
+    if (simulation->num_batches < 2) return -1.0f;
+
+    const uint32_t nx = (uint32_t)simulation->grid_dimensions.x;
+    const uint32_t ny = (uint32_t)simulation->grid_dimensions.y;
+    double variance = 0.0, magnitude = 0.0;
+    for (uint32_t z = simulation->error_min[2]; z < simulation->error_max[2]; z++) {
+        for (uint32_t y = simulation->error_min[1]; y < simulation->error_max[1]; y++) {
+            for (uint32_t x = simulation->error_min[0]; x < simulation->error_max[0]; x++) {
+                const uint32_t v = (z * ny + y) * nx + x;
+                const double mean = simulation->batch_totals[v] / simulation->rays_done;
+                variance += simulation_voxel_variance(simulation, v);
+                magnitude += mean * mean;
+            }
+        }
+    }
+    return magnitude > 0.0 ? (float)sqrt(variance / magnitude) : 0.0f;
+}
+
+// traces and deposits the rays in batches of batch_rays per source, each batch's share
+// of a voxel's energy is an independent estimate of it, their spread estimates the
+// error of the running mean, see AT_simulation_run_batched
+static AT_Result simulation_run_batches(AT_Simulation *simulation,
+                                        AT_BatchReadyFunc on_batch,
+                                        void *user_data)
+{
+    const uint32_t num_rays = simulation->num_rays;
+    const uint32_t num_sources = simulation->scene->num_sources;
+    const uint32_t batch_rays = simulation->batch_rays > 0 && simulation->batch_rays < num_rays ?
+        simulation->batch_rays : num_rays;
+    //per band, each starts with 1 / AT_NUM_BANDS of a ray's energy
+    const float MIN_ENERGY_THRESHOLD = 0.8f / num_rays / AT_NUM_BANDS;
+
+    //kept after the run for AT_simulation_voxel_errors, a new run starts them over
+    if (!simulation->batch_totals) {
+        simulation->batch_totals = calloc(simulation->num_voxels, sizeof(double));
+        simulation->batch_squares = calloc(simulation->num_voxels, sizeof(double));
+    }
+    double *totals = malloc(sizeof(double) * simulation->num_voxels);
+    if (!totals || !simulation->batch_totals || !simulation->batch_squares) {
+        free(totals);
+        free(simulation->batch_totals);
+        free(simulation->batch_squares);
+        simulation->batch_totals = simulation->batch_squares = NULL;
+        return AT_ERR_ALLOC_ERROR;
+    }
+    memset(simulation->batch_totals, 0, sizeof(double) * simulation->num_voxels);
+    memset(simulation->batch_squares, 0, sizeof(double) * simulation->num_voxels);
+    simulation->rays_done = 0;
+    simulation->num_batches = 0;
+
+    AT_Result res = AT_OK;
+    uint64_t bounces = 0;
+    while (simulation->rays_done < num_rays && res == AT_OK) {
+        const uint32_t first = simulation->rays_done;
+        const uint32_t last = AT_min(first + batch_rays, num_rays);
+
+        atomic_store_explicit(&simulation->phase, AT_PHASE_TRACING, memory_order_relaxed);
+        for (uint32_t s = 0; s < num_sources && res == AT_OK; s++) {
+            for (uint32_t r = first; r < last; r++) {
+                if (r % AT_CANCEL_CHECK_RAYS == 0 && simulation_should_stop(simulation)) {
+                    res = simulation_stop(simulation);
+                    break;
+                }
+                res = simulation_trace_ray(simulation, s * num_rays + r, MIN_ENERGY_THRESHOLD, &bounces);
+                if (res != AT_OK) break;
+            }
+        }
+        if (res != AT_OK) break;
+        atomic_store_explicit(&simulation->bounces, bounces, memory_order_relaxed);
+        atomic_store_explicit(&simulation->rays_traced, num_sources * last, memory_order_relaxed);
+
+        atomic_store_explicit(&simulation->phase, AT_PHASE_DEPOSITING, memory_order_relaxed);
+        for (uint32_t s = 0; s < num_sources && res == AT_OK; s++) {
+            for (uint32_t r = first; r < last; r++) {
+                if (r % AT_CANCEL_CHECK_RAYS == 0 && simulation_should_stop(simulation)) {
+                    res = simulation_stop(simulation);
+                    break;
+                }
+                simulation_deposit_ray(simulation, s * num_rays + r);
+            }
+        }
+        if (res != AT_OK) break;
+        if (simulation->channels) simulation_mix_bins(simulation, 0, SIZE_MAX);
+        simulation->rays_done = last;
+        simulation->num_batches++;
+        atomic_store_explicit(&simulation->rays_deposited, num_sources * last, memory_order_relaxed);
+
+        //this batch's delta per voxel, squared over its ray count
+        simulation_voxel_totals(simulation, totals);
+        const double batch_size = (double)(last - first);
+        for (uint32_t v = 0; v < simulation->num_voxels; v++) {
+            const double delta = totals[v] - simulation->batch_totals[v];
+            simulation->batch_squares[v] += delta * delta / batch_size;
+            simulation->batch_totals[v] = totals[v];
+        }
+        const float relative_error = simulation_region_error(simulation);
 
-            AT_voxel_ray_step(simulation, ray, ray_end);
-            ray = ray->child;
+        const AT_BatchProgress batch = {
+            .rays_done = last,
+            .num_rays = num_rays,
+            .scale = (float)num_rays / last,
+            .relative_error = relative_error,
+        };
+        if (on_batch) res = on_batch(user_data, &batch);
+        if (res == AT_OK && simulation->target_error > 0.0f && simulation->num_batches >= AT_BATCH_MIN_FOR_STOP &&
+            relative_error >= 0.0f && relative_error < simulation->target_error) {
+            break;
         }
     }
+    free(totals);
+    if (res != AT_OK) return res;
+
+    //stopped early, the bins hold rays_done rays of 1 / num_rays energy each, with
+    //channels those are scaled and mixed again so a later mix keeps the scale
+    const float scale = (float)num_rays / simulation->rays_done;
+    if (simulation->rays_done < num_rays) {
+        AT_Voxel *grid = simulation->channels ? simulation->channels : simulation->voxel_grid;
+        const size_t num_grid_voxels = (size_t)simulation->num_voxels * (simulation->channels ? num_sources : 1);
+        for (size_t v = 0; v < num_grid_voxels; v++) {
+            AT_Voxel *voxel = &grid[v];
+            for (size_t b = 0; b < voxel->count; b++) voxel->items[b] *= scale;
+        }
+        if (simulation->channels) simulation_mix_bins(simulation, 0, SIZE_MAX);
+    }
+
+    //the rays past rays_done were emitted but never traced
+    atomic_store_explicit(&simulation->phase, AT_PHASE_DEPOSITING, memory_order_relaxed);
+    res = simulation_collect_receivers(simulation, simulation->rays_done, scale);
+    if (res != AT_OK) return res;
+
+    //the timeline is only known once the last batch is in, the bins move into the file now
+    if (simulation->result_path) {
+        res = AT_result_store_attach(simulation, simulation->result_path, AT_voxel_get_num_bins(simulation));
+        if (res != AT_OK) return res;
+    }
     return AT_OK;
 }
 
+AT_Result AT_simulation_run(AT_Simulation *simulation)
+{
+    if (simulation && simulation->batch_rays > 0) return AT_simulation_run_batched(simulation, NULL, NULL);
+    return AT_simulation_run_progressive(simulation, NULL, NULL);
+}
+
+AT_Result AT_simulation_run_batched(AT_Simulation *simulation,
+                                    AT_BatchReadyFunc on_batch,
+                                    void *user_data)
+{
+    if (!simulation) return AT_ERR_INVALID_ARGUMENT;
+
+    simulation->deadline = simulation->time_limit > 0.0f ? simulation_clock() + simulation->time_limit : 0.0;
+
+    //the error estimate needs every batch traced afresh, so every source is re-emitted
+    //and every channel emptied
+    const uint32_t num_sources = simulation->scene->num_sources;
+    memset(simulation->source_traced, 0, sizeof(bool) * num_sources);
+    simulation_reset_bins(simulation);
+    AT_simulation_rays_init(simulation);
+
+    atomic_store_explicit(&simulation->rays_traced, 0, memory_order_relaxed);
+    atomic_store_explicit(&simulation->rays_deposited, 0, memory_order_relaxed);
+    atomic_store_explicit(&simulation->bounces, 0, memory_order_relaxed);
+
+    AT_Result res = simulation_run_batches(simulation, on_batch, user_data);
+    if (res != AT_OK) return res;
+    //a run that stopped early left rays untraced, the next one starts over
+    memset(simulation->source_traced, simulation->rays_done == simulation->num_rays, sizeof(bool) * num_sources);
+    atomic_store_explicit(&simulation->phase, AT_PHASE_DONE, memory_order_release);
+    return AT_OK;
+}
+
+AT_Result AT_simulation_run_progressive(AT_Simulation *simulation,
+                                        AT_FramesReadyFunc on_frames,
+                                        void *user_data)
+{
+    if (!simulation) return AT_ERR_INVALID_ARGUMENT;
+    //frames only become final in time order once every ray is traced
+    if (on_frames && simulation->batch_rays > 0) return AT_ERR_INVALID_ARGUMENT;
+
+    //per band, each starts with 1 / AT_NUM_BANDS of a ray's energy
+    const float MIN_ENERGY_THRESHOLD = 0.8f / simulation->num_rays / AT_NUM_BANDS;
+    simulation->deadline = simulation->time_limit > 0.0f ? simulation_clock() + simulation->time_limit : 0.0;
+
+    //a run after the first starts from empty bins but only re-traces the sources that moved
+    simulation_reset_bins(simulation);
+
+    //initialize and trace rays at every source
+    AT_simulation_rays_init(simulation);
+
+    const uint32_t num_sources = simulation->scene->num_sources;
+    uint32_t rays_traced = 0;
+    for (uint32_t s = 0; s < num_sources; s++) rays_traced += simulation->source_traced[s] ? simulation->num_rays : 0;
+    atomic_store_explicit(&simulation->rays_traced, rays_traced, memory_order_relaxed);
+    atomic_store_explicit(&simulation->rays_deposited, 0, memory_order_relaxed);
+    atomic_store_explicit(&simulation->bounces, 0, memory_order_relaxed);
+    atomic_store_explicit(&simulation->phase, AT_PHASE_TRACING, memory_order_relaxed);
+
+    //trace rays for this source
+    uint32_t total_rays = num_sources * simulation->num_rays;
+    uint64_t bounces = 0;
+    for (uint32_t i = 0; i < total_rays; i++) {
+        if (simulation->source_traced[i / simulation->num_rays]) continue;
+        if (i % AT_CANCEL_CHECK_RAYS == 0 && simulation_should_stop(simulation)) {
+            return simulation_stop(simulation);
+        }
+        AT_Result res = simulation_trace_ray(simulation, i, MIN_ENERGY_THRESHOLD, &bounces);
+        if (res != AT_OK) return res;
+
+        //published per ray, a counter per bounce would be pure cache traffic
+        atomic_store_explicit(&simulation->bounces, bounces, memory_order_relaxed);
+        atomic_store_explicit(&simulation->rays_traced, ++rays_traced, memory_order_relaxed);
+    }
+
+    //the whole timeline is known now, so the bins can be laid out in the result file up front
+    if (simulation->result_path) {
+        AT_Result res = AT_result_store_attach(simulation, simulation->result_path,
+                                               simulation_max_bins(simulation));
+        if (res != AT_OK) return res;
+    }
+
+    //DDA
+    atomic_store_explicit(&simulation->phase, AT_PHASE_DEPOSITING, memory_order_relaxed);
+    if (on_frames) {
+        AT_Result res = simulation_deposit_in_time_order(simulation, on_frames, user_data);
+        if (res != AT_OK) return res;
+    } else {
+        AT_Result res = simulation_deposit(simulation);
+        if (res != AT_OK) return res;
+        if (simulation->channels) simulation_mix_bins(simulation, 0, SIZE_MAX);
+    }
+    AT_Result res = simulation_collect_receivers(simulation, simulation->num_rays, 1.0f);
+    if (res != AT_OK) return res;
+    //marked only now, a channel is current once its source is deposited in full
+    memset(simulation->source_traced, true, sizeof(bool) * num_sources);
+    atomic_store_explicit(&simulation->phase, AT_PHASE_DONE, memory_order_release);
+    return AT_OK;
+}
+
+AT_Result AT_simulation_set_source(AT_Simulation *simulation, uint32_t index, const AT_Source *source)
+{
+    if (!simulation || !source || index >= simulation->scene->num_sources) return AT_ERR_INVALID_ARGUMENT;
+
+    simulation->sources[index] = *source;
+    simulation->sources[index].direction = AT_vec3_normalize(source->direction);
+    simulation->source_traced[index] = false;
+    return AT_OK;
+}
+
+void AT_simulation_set_cancel(AT_Simulation *simulation, AT_CancelToken *cancel)
+{
+    if (!simulation) return;
+    simulation->cancel = cancel;
+}
+
+AT_Result AT_simulation_mix_sources(AT_Simulation *simulation, const float *gains)
+{
+    if (!simulation || !gains || !simulation->channels) return AT_ERR_INVALID_ARGUMENT;
+    for (uint32_t s = 0; s < simulation->scene->num_sources; s++) {
+        if (!(gains[s] >= 0.0f)) return AT_ERR_INVALID_ARGUMENT;
+    }
+
+    memcpy(simulation->source_gains, gains, sizeof(float) * simulation->scene->num_sources);
+    simulation_mix_bins(simulation, 0, SIZE_MAX);
+    if (simulation->receivers && simulation->receivers->num_bins > 0) {
+        AT_receivers_mix(simulation->receivers, gains);
+    }
+    return AT_OK;
+}
+
+AT_Result AT_simulation_voxel_errors(const AT_Simulation *simulation, float *out_errors)
+{
+    if (!simulation || !out_errors) return AT_ERR_INVALID_ARGUMENT;
+    if (!simulation->batch_totals) return AT_ERR_INVALID_ARGUMENT;
+
+    for (uint32_t v = 0; v < simulation->num_voxels; v++) {
+        const double mean = simulation->batch_totals[v] / simulation->rays_done;
+        out_errors[v] = simulation->num_batches >= 2 && mean > 0.0 ?
+            (float)(sqrt(simulation_voxel_variance(simulation, v)) / mean) : -1.0f;
+    }
+    return AT_OK;
+}
+
+AT_SimulationProgress AT_simulation_progress(const AT_Simulation *simulation)
+{
+    if (!simulation) return (AT_SimulationProgress){0};
+
+    //atomics are not const in C11, loading them does not modify the simulation
+    AT_Simulation *sim = (AT_Simulation *)simulation;
+    return (AT_SimulationProgress){
+        .phase = (AT_SimulationPhase)atomic_load_explicit(&sim->phase, memory_order_acquire),
+        .rays_total = simulation->scene ? simulation->scene->num_sources * simulation->num_rays : 0,
+        .rays_traced = atomic_load_explicit(&sim->rays_traced, memory_order_relaxed),
+        .rays_deposited = atomic_load_explicit(&sim->rays_deposited, memory_order_relaxed),
+        .bounces = atomic_load_explicit(&sim->bounces, memory_order_relaxed),
+    };
+}
+
 void AT_simulation_destroy(AT_Simulation *simulation)
 {
     if (!simulation) return;
 
+    //voxels pointing into the mapped file are reset to empty here
+    AT_result_store_detach(simulation);
+
     uint32_t num_voxels = (uint32_t)(simulation->grid_dimensions.x *
                                      simulation->grid_dimensions.y *
                                      simulation->grid_dimensions.z);
@@ -173,6 +898,11 @@ void AT_simulation_destroy(AT_Simulation *simulation)
     for (uint32_t i = 0; i < num_voxels; i++) {
         AT_voxel_cleanup(&simulation->voxel_grid[i]);
     }
+    if (simulation->channels) {
+        for (size_t i = 0; i < (size_t)simulation->scene->num_sources * num_voxels; i++) {
+            AT_voxel_cleanup(&simulation->channels[i]);
+        }
+    }
 
     uint32_t total_rays = simulation->scene->num_sources * simulation->num_rays;
     for (uint32_t i = 0; i < total_rays; i++) {
@@ -183,5 +913,14 @@ void AT_simulation_destroy(AT_Simulation *simulation)
 
     free(simulation->voxel_grid);
     free(simulation->rays);
+    free(simulation->result_path);
+    free(simulation->batch_totals);
+    free(simulation->batch_squares);
+    free(simulation->sources);
+    free(simulation->source_traced);
+    free(simulation->channels);
+    free(simulation->source_gains);
+    AT_receivers_destroy(simulation->receivers);
+    AT_image_sources_destroy(simulation->image_sources);
     free(simulation);
 }
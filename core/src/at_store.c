@@ -0,0 +1,251 @@
+#include "at_store.h"
+#include "at_internal.h"
+#include "at_voxel.h"
+#include "acoustic/at.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static size_t store_data_offset(void)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    size_t offset = page > 0 ? (size_t)page : 4096;
+    while (offset < sizeof(AT_StoreHeader)) offset *= 2;
+    return offset;
+}
+
+static void store_unmap(AT_ResultStore *store)
+{
+    if (store->map && store->map != MAP_FAILED) munmap(store->map, store->map_size);
+    if (store->fd >= 0) close(store->fd);
+}
+
+AT_Result AT_result_store_attach(AT_Simulation *simulation, const char *path, uint32_t num_frames)
+{
+    if (!simulation || !path || num_frames == 0) return AT_ERR_INVALID_ARGUMENT;
+
+    AT_result_store_detach(simulation);
+
+    AT_ResultStore *store = calloc(1, sizeof(AT_ResultStore));
+    if (!store) return AT_ERR_ALLOC_ERROR;
+
+    const size_t data_offset = store_data_offset();
+    const size_t num_bins = (size_t)simulation->num_voxels * num_frames;
+    store->map_size = data_offset + num_bins * sizeof(AT_Bands);
+
+    //ftruncate leaves a hole, pages only get backed once a deposit touches them
+    store->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (store->fd < 0 || ftruncate(store->fd, (off_t)store->map_size) != 0) {
+        store_unmap(store);
+        free(store);
+        return AT_ERR_IO_FAILURE;
+    }
+
+    store->map = mmap(NULL, store->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, store->fd, 0);
+    if (store->map == MAP_FAILED) {
+        store_unmap(store);
+        free(store);
+        return AT_ERR_IO_FAILURE;
+    }
+
+    AT_StoreHeader *header = (AT_StoreHeader *)store->map;
+    memcpy(header->magic, AT_STORE_MAGIC, 4);
+    header->version = AT_STORE_VERSION;
+    header->num_bands = AT_NUM_BANDS;
+    header->num_frames = num_frames;
+    header->num_voxels = simulation->num_voxels;
+    for (int a = 0; a < 3; a++) {
+        header->grid[a] = (uint32_t)simulation->grid_dimensions.arr[a];
+        header->origin[a] = simulation->origin.arr[a];
+    }
+    header->voxel_size = simulation->voxel_size;
+    header->bin_width = simulation->bin_width;
+    header->data_offset = data_offset;
+    store->header = header;
+    store->bins = (AT_Bands *)(store->map + data_offset);
+
+    //every voxel spans the whole timeline up front, so the march never grows (reallocs) a mapped voxel,
+    //bins deposited before attaching (a batched run) move into the file
+    for (uint32_t v = 0; v < simulation->num_voxels; v++) {
+        AT_Voxel *voxel = &simulation->voxel_grid[v];
+        if (voxel->count > 0) {
+            memcpy(store->bins + (size_t)v * num_frames, voxel->items,
+                   AT_min(voxel->count, (size_t)num_frames) * sizeof(AT_Bands));
+        }
+        AT_voxel_cleanup(voxel);
+        voxel->items = store->bins + (size_t)v * num_frames;
+        voxel->count = num_frames;
+        voxel->capacity = num_frames;
+    }
+
+    simulation->store = store;
+    return AT_OK;
+}
+
+void AT_result_store_detach(AT_Simulation *simulation)
+{
+    if (!simulation || !simulation->store) return;
+
+    for (uint32_t v = 0; v < simulation->num_voxels; v++) {
+        AT_voxel_init(&simulation->voxel_grid[v]);
+    }
+
+    AT_ResultStore *store = simulation->store;
+    msync(store->map, store->map_size, MS_ASYNC);
+    store_unmap(store);
+    free(store);
+    simulation->store = NULL;
+}
+
+AT_Result AT_result_store_open(AT_ResultStore **out_store, const char *path)
+{
+    if (!out_store || *out_store || !path) return AT_ERR_INVALID_ARGUMENT;
+
+    AT_ResultStore *store = calloc(1, sizeof(AT_ResultStore));
+    if (!store) return AT_ERR_ALLOC_ERROR;
+
+    struct stat st;
+    store->fd = open(path, O_RDONLY);
+    if (store->fd < 0 || fstat(store->fd, &st) != 0 || (size_t)st.st_size < sizeof(AT_StoreHeader)) {
+        store_unmap(store);
+        free(store);
+        return AT_ERR_IO_FAILURE;
+    }
+
+    store->map_size = (size_t)st.st_size;
+    store->map = mmap(NULL, store->map_size, PROT_READ, MAP_SHARED, store->fd, 0);
+    if (store->map == MAP_FAILED) {
+        store_unmap(store);
+        free(store);
+        return AT_ERR_IO_FAILURE;
+    }
+
+    //every count comes from the file, checked in 64 bits so none of them can wrap around
+    //into a size that passes, reads index the bins by grid
+    const AT_StoreHeader *header = (const AT_StoreHeader *)store->map;
+    const uint64_t grid_voxels = (uint64_t)header->grid[0] * header->grid[1] * header->grid[2];
+    const uint64_t num_bins = (uint64_t)header->num_voxels * header->num_frames;
+    if (memcmp(header->magic, AT_STORE_MAGIC, 4) != 0 ||
+        header->version != AT_STORE_VERSION ||
+        header->num_bands != AT_NUM_BANDS ||
+        grid_voxels != header->num_voxels ||
+        header->data_offset < sizeof(AT_StoreHeader) ||
+        header->data_offset % sizeof(AT_Bands) != 0 ||
+        header->data_offset > store->map_size ||
+        num_bins > (store->map_size - header->data_offset) / sizeof(AT_Bands)) {
+        store_unmap(store);
+        free(store);
+        return AT_ERR_IO_FAILURE;
+    }
+
+    store->header = header;
+    store->bins = (AT_Bands *)(store->map + header->data_offset);
+    //reads walk voxels in file order
+    madvise(store->map, store->map_size, MADV_SEQUENTIAL);
+
+    *out_store = store;
+    return AT_OK;
+}
+
+void AT_result_store_close(AT_ResultStore *store)
+{
+    if (!store) return;
+    if (store->view) {
+        free(store->view->voxel_grid);
+        free(store->view);
+    }
+    store_unmap(store);
+    free(store);
+}
+
+AT_ResultInfo AT_result_store_info(const AT_ResultStore *store)
+{
+    const AT_StoreHeader *h = store->header;
+    return (AT_ResultInfo){
+        .num_frames = h->num_frames,
+        .num_voxels = h->num_voxels,
+        .grid = {h->grid[0], h->grid[1], h->grid[2]},
+        .origin = AT_vec3(h->origin[0], h->origin[1], h->origin[2]),
+        .voxel_size = h->voxel_size,
+        .bin_width = h->bin_width,
+    };
+}
+
+const float *AT_result_store_voxel(const AT_ResultStore *store, uint32_t voxel)
+{
+    if (!store || voxel >= store->header->num_voxels) return NULL;
+    return (const float *)(store->bins + (size_t)voxel * store->header->num_frames);
+}
+
+AT_Result AT_result_store_read(const AT_ResultStore *store, const AT_ResultSlice *slice, float *out_energy)
+{
+    if (!store || !slice || !out_energy) return AT_ERR_INVALID_ARGUMENT;
+
+    const AT_StoreHeader *h = store->header;
+    if (slice->frame_start >= slice->frame_end || slice->frame_end > h->num_frames) return AT_ERR_INVALID_ARGUMENT;
+    for (int a = 0; a < 3; a++) {
+        if (slice->min[a] >= slice->max[a] || slice->max[a] > h->grid[a]) return AT_ERR_INVALID_ARGUMENT;
+    }
+
+    const uint32_t nx = slice->max[0] - slice->min[0];
+    const uint32_t ny = slice->max[1] - slice->min[1];
+    const uint32_t nz = slice->max[2] - slice->min[2];
+    const size_t frame_stride = (size_t)nx * ny * nz;
+
+    //voxel outer, frame inner: each voxel's frames are contiguous in the file
+    for (uint32_t z = 0; z < nz; z++) {
+        for (uint32_t y = 0; y < ny; y++) {
+            for (uint32_t x = 0; x < nx; x++) {
+                const size_t voxel = ((size_t)(slice->min[2] + z) * h->grid[1] + (slice->min[1] + y)) * h->grid[0] +
+                                     (slice->min[0] + x);
+                const AT_Bands *bins = store->bins + voxel * h->num_frames;
+                float *out = out_energy + ((size_t)z * ny + y) * nx + x;
+                for (uint32_t f = slice->frame_start; f < slice->frame_end; f++) {
+                    out[(f - slice->frame_start) * frame_stride] = AT_bands_sum(bins[f]);
+                }
+            }
+        }
+    }
+    return AT_OK;
+}
+
+AT_Simulation *AT_result_store_view(AT_ResultStore *store)
+{
+    if (!store) return NULL;
+    if (store->view) return store->view;
+
+    const AT_StoreHeader *h = store->header;
+    AT_Simulation *view = calloc(1, sizeof(AT_Simulation));
+    AT_Voxel *voxels = calloc(h->num_voxels > 0 ? h->num_voxels : 1, sizeof(AT_Voxel));
+    if (!view || !voxels) {
+        free(view);
+        free(voxels);
+        return NULL;
+    }
+
+    for (uint32_t v = 0; v < h->num_voxels; v++) {
+        voxels[v].items = store->bins + (size_t)v * h->num_frames;
+        voxels[v].count = h->num_frames;
+        voxels[v].capacity = h->num_frames;
+    }
+
+    view->voxel_grid = voxels;
+    view->num_voxels = h->num_voxels;
+    view->grid_dimensions = AT_vec3((float)h->grid[0], (float)h->grid[1], (float)h->grid[2]);
+    view->origin = AT_vec3(h->origin[0], h->origin[1], h->origin[2]);
+    view->voxel_size = h->voxel_size;
+    view->dimensions = AT_vec3_scale(view->grid_dimensions, h->voxel_size);
+    view->bin_width = h->bin_width;
+    view->inv_bin_width = 1.0f / h->bin_width;
+    view->fps = (uint8_t)(view->inv_bin_width + 0.5f);
+    //a stored result is a finished run, it has no scene to count rays from
+    atomic_init(&view->phase, AT_PHASE_DONE);
+
+    store->view = view;
+    return view;
+}
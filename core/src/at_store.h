@@ -0,0 +1,56 @@
+#ifndef AT_STORE_INTERNAL_H
+#define AT_STORE_INTERNAL_H
+
+#include "acoustic/at.h"
+#include "at_internal.h"
+#include "at_bands.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define AT_STORE_MAGIC "ATRS"
+#define AT_STORE_VERSION 1
+
+// first page of a result file, bins start at data_offset (page aligned)
+// followed by num_voxels * num_frames AT_Bands, voxel major
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t num_bands;
+    uint32_t num_frames;
+    uint32_t num_voxels;
+    uint32_t grid[3];
+    float origin[3];
+    float voxel_size;
+    float bin_width;
+    uint32_t reserved;
+    uint64_t data_offset;
+} AT_StoreHeader;
+
+struct AT_ResultStore {
+    int fd;
+    uint8_t *map;
+    size_t map_size;
+    const AT_StoreHeader *header;
+    AT_Bands *bins;
+
+    // reader only: read only simulation whose voxels point into the mapping,
+    // lets every exporter run over a stored result
+    AT_Simulation *view;
+};
+
+/** \brief Creates the result file sized for num_frames and points every voxel's bins into it.
+
+    Any heap bins the voxels held are freed, bins start zeroed. Replaces a
+    store the simulation already had, so a re-run starts from a fresh file.
+ */
+AT_Result AT_result_store_attach(AT_Simulation *simulation, const char *path, uint32_t num_frames);
+
+// unmaps the simulation's store, the file stays on disk, voxels are left empty
+void AT_result_store_detach(AT_Simulation *simulation);
+
+// read only AT_Simulation over a store opened with AT_result_store_open, owned by the store
+AT_Simulation *AT_result_store_view(AT_ResultStore *store);
+
+#endif // AT_STORE_INTERNAL_H
@@ -34,6 +34,9 @@
 #include <stdint.h>
 #include "acoustic/at_math.h"
 
+// forces the compiler to inline, used to stamp out specialised copies of hot loops
+#define AT_ALWAYS_INLINE static inline __attribute__((always_inline))
+
 /* DYNAMIC ARRAYS */
 
 // the DA functions assume the following type definition for any type you want:
@@ -1,157 +1,233 @@
 #include "acoustic/at_math.h"
 #include "at_voxel.h"
 #include "at_internal.h"
+#include "at_attenuation.h"
 #include "../src/at_utils.h"
 #include <math.h>
 #include <stdint.h>
 
 #define VOXEL_MAX_STEPS 100
-#define SPEED_OF_SOUND 343.0f
-#define SLOWER_SPEED 50.0f
+// spreading is clamped inside this distance so energy near the source stays finite
+#define SPREADING_REFERENCE_DISTANCE 1.0f
 
-void AT_voxel_ray_step(AT_Simulation *simulation, AT_Ray *ray, AT_Vec3 ray_end)
+// maps the three t_max comparisons onto the axis with the smallest t_max
+// index bits: 2 -> (x < y), 1 -> (x < z), 0 -> (y < z)
+// ties resolve the same way as the old if/else chain (x, then y, then z)
+static const int AT_DDA_AXIS_LUT[8] = {2, 1, 2, 1, 2, 1, 0, 0};
+
+// distance falloff applied on top of air absorption for each attenuation model
+AT_ALWAYS_INLINE float AT_voxel_falloff(const AT_AttenuationModel attenuation, float total_world_dist)
+{
+    switch (attenuation) {
+        case AT_ATTENUATION_LEGACY: {
+            const float dist_from_source = fmaxf(total_world_dist, 0.1f);
+            return 1.0f / (1.0f + dist_from_source * 0.01f);
+        }
+        case AT_ATTENUATION_SPREADING: {
+            //inverse square law
+            const float dist_from_source = fmaxf(total_world_dist, SPREADING_REFERENCE_DISTANCE);
+            return 1.0f / (dist_from_source * dist_from_source);
+        }
+        default:
+            return 1.0f;
+    }
+}
+
+// marching loop shared by every kernel, deposition and attenuation are compile time
+// constants in each caller so the mode checks fold away in the specialised copies
+AT_ALWAYS_INLINE uint32_t AT_voxel_march(AT_Simulation *simulation,
+                                         AT_Voxel *grid,
+                                         const AT_Ray *ray,
+                                         AT_Vec3 ray_end,
+                                         const AT_DepositionMode deposition,
+                                         const AT_AttenuationModel attenuation)
 {
     //the ray segment spans from p0 (origin) to p1 (end)
     // out current position within the segement is "t"
 
-    float world_ray_length = AT_vec3_distance(ray->origin, ray_end);
-    if (world_ray_length <= 0.0f) return;
+    const float world_ray_length = AT_vec3_distance(ray->origin, ray_end);
+    if (world_ray_length <= 0.0f) return 0;
+
+    const float voxel_size = simulation->voxel_size;
+    const float inv_voxel_size = 1.0f / voxel_size;
 
     //origin in voxel space
-    AT_Vec3 p0 = AT_vec3_scale(
+    const AT_Vec3 p0 = AT_vec3_scale(
         AT_vec3_sub(ray->origin, simulation->origin),
-        1.0f / simulation->voxel_size
+        inv_voxel_size
     );
 
-    //ray end in voxel space
-    AT_Vec3 p1 = AT_vec3_scale(
-        AT_vec3_sub(ray_end, simulation->origin),
-        1.0f / simulation->voxel_size
-    );
-
-    const int grid_x = simulation->grid_dimensions.x;
-    const int grid_y = simulation->grid_dimensions.y;
-    const int grid_z = simulation->grid_dimensions.z;
+    const int dims[3] = {
+        (int)simulation->grid_dimensions.x,
+        (int)simulation->grid_dimensions.y,
+        (int)simulation->grid_dimensions.z
+    };
 
     if (p0.x < 0.0f || p0.y < 0.0f || p0.z < 0.0f ||
-        p0.x >= grid_x || p0.y >= grid_y || p0.z >= grid_z) {
-            return;
+        p0.x >= dims[0] || p0.y >= dims[1] || p0.z >= dims[2]) {
+            return 0;
         }
 
-    //step direction (+1 or -1 per axis)
-    //const AT_Vec3 step = AT_get_sign_vec3(ray->direction);
-    const AT_Vec3 step = (AT_Vec3) {{
-        signbit(ray->direction.x) ? -1 : 1,
-        signbit(ray->direction.y) ? -1 : 1,
-        signbit(ray->direction.z) ? -1 : 1
-    }};
-
     //distance along "t" to move one voxel
-    const AT_Vec3 delta = AT_vec3_delta(ray->direction);
+    const AT_Vec3 delta_v = AT_vec3_delta(ray->direction);
 
-    AT_Vec3i pos = (AT_Vec3i){
-        AT_clamp((int)floorf(p0.x), 0, grid_x - 1),
-        AT_clamp((int)floorf(p0.y), 0, grid_y - 1),
-        AT_clamp((int)floorf(p0.z), 0, grid_z - 1)
-    };
+    //index offset into the voxel_grid array when stepping one voxel along each axis
+    const int stride[3] = {1, dims[0], dims[0] * dims[1]};
 
     //distance along ray until we cross next voxel boundary each axis
     // aka the max "t" :|
     // since the ray can only leave through one face of the voxel first,
     // the smallest of the three t_max values tells us which face
     //this gif kinda helps visualize it: https://m4xc.dev/anim/articles/amanatides-and-woo/walk-anim.mp4
-    AT_Vec3 t_max;
-
-    t_max.x = (step.x > 0) ?
-        ((pos.x + 1.0f) - p0.x) * delta.x :
-        (p0.x - pos.x) * delta.x;
-
-    t_max.y = (step.y > 0) ?
-        ((pos.y + 1.0f) - p0.y) * delta.y :
-        (p0.y - pos.y) * delta.y;
-
-    t_max.z = (step.z > 0) ?
-        ((pos.z + 1.0f) - p0.z) * delta.z :
-        (p0.z - pos.z) * delta.z;
-
-    // printf("Ray: %i: CHILD:%p ", ray->ray_id, ray->child);
-    // printf("p0: {%f, %f, %f}, ", p0.x, p0.y, p0.z);
-    // printf("p1: {%f, %f, %f}, ", p1.x, p1.y, p1.z);
-    // printf("Step: {%.1f, %.1f, %.1f}, ", step.x, step.y, step.z);
-    // printf("Delta: {%f, %f, %f}", delta.x, delta.y, delta.z);
-    // printf("t_max: {%f, %f, %f}\n", t_max.x, t_max.y, t_max.z);
-
-    //curr pos within ray segment
-    float t = 0.0f;
-    const float t_end = AT_vec3_length(AT_vec3_sub(p1, p0));
+    int pos[3], step[3];
+    float delta[3], t_max[3];
+    for (int a = 0; a < 3; a++) {
+        //step direction (+1 or -1 per axis)
+        step[a] = signbit(ray->direction.arr[a]) ? -1 : 1;
+        pos[a] = AT_clamp((int)floorf(p0.arr[a]), 0, dims[a] - 1);
+        delta[a] = delta_v.arr[a];
+        t_max[a] = (step[a] > 0) ?
+            ((pos[a] + 1.0f) - p0.arr[a]) * delta[a] :
+            (p0.arr[a] - pos[a]) * delta[a];
+    }
+
+    int voxel_idx = pos[2] * stride[2] + pos[1] * stride[1] + pos[0];
+
+    //curr pos within ray segment, the world -> voxel scale is uniform so
+    // the voxel space length is just the world length rescaled
+    const float t_end = world_ray_length * inv_voxel_size;
     float t_prev = 0.0f;
 
-    //while we havent yet reached the end of the ray segment
-    while (t < t_end) {
-        if (pos.x < 0 || pos.x >= grid_x ||
-            pos.y < 0 || pos.y >= grid_y ||
-            pos.z < 0 || pos.z >= grid_z) break;
+    //everything below is constant for the whole segment, so it is hoisted out of the march
+    const AT_Bands energy_per_t = ray->energy * (voxel_size / world_ray_length);
+    const float bins_per_metre = simulation->inv_bin_width / simulation->speed_of_sound;
+    const float bins_per_t = voxel_size * bins_per_metre;
+    const float bin_origin = ray->total_distance * bins_per_metre;
+    const bool has_air_loss = attenuation != AT_ATTENUATION_NONE;
+    const AT_Bands air_coefficient = has_air_loss ? simulation->air_coefficient : AT_bands_splat(0.0f);
+
+    //per band air absorption exp(-a * d) evaluated at each axis' next boundary
+    // crossing one more voxel along an axis always adds delta to t, so the
+    // boundary value is carried forward by multiplying with a per-axis constant
+    const AT_Bands air_origin = AT_bands_exp(-air_coefficient * ray->total_distance);
+    AT_Bands air_step[3], air_at_t_max[3];
+    for (int a = 0; a < 3; a++) {
+        air_step[a] = AT_bands_exp(-air_coefficient * (voxel_size * delta[a]));
+        air_at_t_max[a] = air_origin * AT_bands_exp(-air_coefficient * (voxel_size * t_max[a]));
+    }
+    const AT_Bands air_end = air_origin * AT_bands_exp(-air_coefficient * world_ray_length);
+    AT_Bands air_prev = air_origin;
 
-        //index into the voxel_grid array
-        const uint32_t voxel_idx =
-            (uint32_t)pos.z * grid_y * grid_x +
-            (uint32_t)pos.y * grid_x +
-            (uint32_t)pos.x;
+    uint32_t num_visited = 0;
 
-        //printf("VOXEL IDX: %i\n", voxel_idx);
-        float t_current = fminf(t_max.x, fminf(t_max.y, t_max.z));
-        if (t_current > t_end) break; //if we reached the end of the ray segment
+    //while we havent yet reached the end of the ray segment
+    for (;;) {
+        //smallest t_max, picked without branching
+        const int axis = AT_DDA_AXIS_LUT[
+            ((t_max[0] < t_max[1]) << 2) |
+            ((t_max[0] < t_max[2]) << 1) |
+            (t_max[1] < t_max[2])
+        ];
+
+        float t_current = t_max[axis];
+        AT_Bands air_current = air_at_t_max[axis];
+
+        //if we reached the end of the ray segment
+        const bool has_reached_end = t_current > t_end;
+        if (has_reached_end) {
+            //midpoint mode drops the partial voxel the segment ends in
+            if (deposition == AT_DEPOSITION_MIDPOINT) break;
+            t_current = t_end;
+            air_current = air_end;
+        }
 
-        float t_segment = t_current - t_prev; //how far we moved in voxel space
+        const float t_segment = t_current - t_prev; //how far we moved in voxel space
 
         if (t_segment > EPSILON) {
-            float world_segment = t_segment * simulation->voxel_size; //how far in world space
-
-            float t_midpoint = t_prev + t_segment * 0.5f; //center point of curr voxel
+            const float t_midpoint = t_prev + t_segment * 0.5f; //center point of curr voxel
             //total dist from source to this midpoint
-            float total_world_dist = ray->total_distance + (t_midpoint * simulation->voxel_size);
-
-            //inverse square law - attenuation
-            float dist_from_source = fmaxf(total_world_dist, 0.1f);
-            float intensity_factor = 1.0f / (1.0f + dist_from_source * 0.01f);
+            const float total_world_dist = ray->total_distance + (t_midpoint * voxel_size);
+
+            const float intensity_factor = AT_voxel_falloff(attenuation, total_world_dist);
+
+            //exp is exponential, so the midpoint value is exactly the geometric mean of the boundaries
+            const AT_Bands air_absorbtion = has_air_loss ?
+                AT_bands_sqrt(air_prev * air_current) : AT_bands_splat(1.0f);
+            const AT_Bands energy_deposit = energy_per_t * (t_segment * intensity_factor) * air_absorbtion;
+
+            AT_Voxel *voxel = &grid[voxel_idx];
+
+            if (deposition == AT_DEPOSITION_MIDPOINT) {
+                const size_t bin_index = (size_t)(bin_origin + t_midpoint * bins_per_t);
+                if (bin_index >= voxel->count) {
+                    AT_voxel_grow(voxel, bin_index + 1);
+                }
+                voxel->items[bin_index] += energy_deposit;
+            } else {
+                //a fast ray through a big voxel can span several bins at high fps
+                AT_voxel_add_energy_span(voxel,
+                                         &energy_deposit,
+                                         bin_origin + t_prev * bins_per_t,
+                                         bin_origin + t_current * bins_per_t);
+            }
+            num_visited++;
+        }
 
-            float air_coefficient = 0.01f;
-            float air_absorbtion = expf(-air_coefficient * total_world_dist);
-            float energy_deposit = (ray->energy * world_segment / world_ray_length) * intensity_factor * air_absorbtion;
+        if (has_reached_end) break;
 
-            // float curr_time = total_world_dist / SPEED_OF_SOUND;
-            float curr_time = total_world_dist / SLOWER_SPEED;
+        t_prev = t_current;
+        air_prev = air_current;
 
-            size_t bin_index = (size_t)(curr_time / simulation->bin_width);
-            //printf("BIN INDEX: %zu\n", bin_index);
+        //advance through the face we left by, only that axis can leave the grid
+        pos[axis] += step[axis];
+        if ((unsigned)pos[axis] >= (unsigned)dims[axis]) break;
 
-            AT_Voxel *voxel = &simulation->voxel_grid[voxel_idx];
+        voxel_idx += step[axis] * stride[axis];
+        t_max[axis] += delta[axis];
+        air_at_t_max[axis] *= air_step[axis];
+    }
 
-            //grow bin count
-            while (voxel->count <= bin_index) {
-                AT_voxel_bin_append(voxel, 0.0f);
-            }
+    return num_visited;
+}
 
-            if (AT_voxel_add_energy(voxel, energy_deposit, bin_index) != AT_OK) {
-                break;
-            }
-        }
-        //printf("ENERGY: %f\n", energy_deposit);
+typedef uint32_t (*AT_VoxelMarchFunc)(AT_Simulation *, AT_Voxel *, const AT_Ray *, AT_Vec3);
 
-        t_prev = t_current;
-        t = t_current;
-
-        //now we look for smallest t_max and advance through it
-        //t_max.x smallest
-        if (t_max.x < t_max.y && t_max.x < t_max.z) {
-            pos.x += step.x;
-            t_max.x += delta.x;
-        } else if (t_max.y < t_max.z) { //smallest y
-            pos.y += step.y;
-            t_max.y += delta.y;
-        } else { //smallest z
-            pos.z += step.z;
-            t_max.z += delta.z;
-        }
+// one specialised copy of the march per deposition mode and attenuation model
+#define AT_VOXEL_KERNEL(deposition, attenuation) \
+    static uint32_t AT_voxel_march_##deposition##_##attenuation(AT_Simulation *simulation, \
+                                                              AT_Voxel *grid, \
+                                                              const AT_Ray *ray, \
+                                                              AT_Vec3 ray_end) \
+    { \
+        return AT_voxel_march(simulation, grid, ray, ray_end, AT_DEPOSITION_##deposition, AT_ATTENUATION_##attenuation); \
     }
+
+AT_VOXEL_KERNEL(MIDPOINT, AIR)
+AT_VOXEL_KERNEL(MIDPOINT, SPREADING)
+AT_VOXEL_KERNEL(MIDPOINT, LEGACY)
+AT_VOXEL_KERNEL(MIDPOINT, NONE)
+AT_VOXEL_KERNEL(ACCURATE, AIR)
+AT_VOXEL_KERNEL(ACCURATE, SPREADING)
+AT_VOXEL_KERNEL(ACCURATE, LEGACY)
+AT_VOXEL_KERNEL(ACCURATE, NONE)
+
+static const AT_VoxelMarchFunc AT_VOXEL_KERNELS[][AT_ATTENUATION_COUNT] = {
+    [AT_DEPOSITION_MIDPOINT] = {
+        [AT_ATTENUATION_AIR] = AT_voxel_march_MIDPOINT_AIR,
+        [AT_ATTENUATION_SPREADING] = AT_voxel_march_MIDPOINT_SPREADING,
+        [AT_ATTENUATION_LEGACY] = AT_voxel_march_MIDPOINT_LEGACY,
+        [AT_ATTENUATION_NONE] = AT_voxel_march_MIDPOINT_NONE,
+    },
+    [AT_DEPOSITION_ACCURATE] = {
+        [AT_ATTENUATION_AIR] = AT_voxel_march_ACCURATE_AIR,
+        [AT_ATTENUATION_SPREADING] = AT_voxel_march_ACCURATE_SPREADING,
+        [AT_ATTENUATION_LEGACY] = AT_voxel_march_ACCURATE_LEGACY,
+        [AT_ATTENUATION_NONE] = AT_voxel_march_ACCURATE_NONE,
+    },
+};
+
+uint32_t AT_voxel_ray_step(AT_Simulation *simulation, AT_Voxel *grid, const AT_Ray *ray, AT_Vec3 ray_end)
+{
+    //both are validated in AT_simulation_create, so this is a single indexed call
+    return AT_VOXEL_KERNELS[simulation->deposition][simulation->attenuation](simulation, grid, ray, ray_end);
 }
@@ -15,32 +15,80 @@ static inline AT_Result AT_voxel_init(AT_Voxel *voxel)
     return AT_OK;
 }
 
-static inline AT_Result AT_voxel_bin_append(AT_Voxel *voxel, float bin)
+static inline void AT_voxel_grow(AT_Voxel *voxel, size_t num_bins);
+
+// AT_Bands go by pointer, see at_bands.h
+static inline AT_Result AT_voxel_bin_append(AT_Voxel *voxel, const AT_Bands *bin)
 {
     if (!voxel) return AT_ERR_INVALID_ARGUMENT;
-    AT_da_append(voxel, bin);
+    AT_voxel_grow(voxel, voxel->count + 1);
+    voxel->items[voxel->count - 1] = *bin;
     return AT_OK;
 }
 
-static inline AT_Result AT_voxel_add_energy(AT_Voxel *voxel, float energy, size_t bin_index)
+static inline AT_Result AT_voxel_add_energy(AT_Voxel *voxel, const AT_Bands *energy, size_t bin_index)
 {
     if (!voxel) return AT_ERR_INVALID_ARGUMENT;
     if (bin_index >= voxel->count) return AT_ERR_INVALID_ARGUMENT;
 
-    voxel->items[bin_index] += energy;
+    voxel->items[bin_index] += *energy;
     return AT_OK;
 }
 
+// grows the bin array to exactly num_bins, zero filling the new bins in one go
+// instead of appending them one at a time
+// capacity doubles from what is first needed rather than AT_DA_INITIAL_CAPACITY,
+// a bin holds every band so most voxels would never touch a 256 bin reservation
+static inline void AT_voxel_grow(AT_Voxel *voxel, size_t num_bins)
+{
+    if (num_bins <= voxel->count) return;
+    if (num_bins > voxel->capacity) {
+        voxel->capacity = AT_max(num_bins, voxel->capacity * 2);
+        voxel->items = AT_REALLOC(voxel->items, voxel->capacity * sizeof(*voxel->items));
+        AT_ASSERT(voxel->items != NULL);
+    }
+    memset(voxel->items + voxel->count, 0, (num_bins - voxel->count) * sizeof(*voxel->items));
+    voxel->count = num_bins;
+}
+
+// deposits energy spread evenly over the fractional bin range [bin_start, bin_end)
+// each bin receives the share of energy that overlaps it
+static inline void AT_voxel_add_energy_span(AT_Voxel *voxel, const AT_Bands *energy, float bin_start, float bin_end)
+{
+    const size_t first = (size_t)bin_start;
+    const size_t last = (size_t)bin_end;
+    if (last >= voxel->count) {
+        AT_voxel_grow(voxel, last + 1);
+    }
+
+    //common case: the whole segment lands in one bin
+    if (first == last) {
+        voxel->items[first] += *energy;
+        return;
+    }
+
+    const AT_Bands energy_per_bin = *energy / (bin_end - bin_start);
+    voxel->items[first] += ((float)(first + 1) - bin_start) * energy_per_bin;
+    for (size_t b = first + 1; b < last; b++) {
+        voxel->items[b] += energy_per_bin;
+    }
+    voxel->items[last] += (bin_end - (float)last) * energy_per_bin;
+}
+
 static inline void AT_voxel_print(AT_Voxel *voxel)
 {
     printf("[");
     for (size_t i = 0; i < voxel->count; i++) {
-        printf("%.3f, ", voxel->items[i]);
+        printf("%.3f, ", AT_bands_sum(voxel->items[i]));
     }
     printf("]\n");
 }
 
-void AT_voxel_ray_step(AT_Simulation *simulation, AT_Ray *ray, AT_Vec3 ray_end);
+// marches the ray segment [ray->origin, ray_end] through the voxel grid,
+// depositing energy into each voxel it crosses of grid, the simulation's
+// voxel_grid or the channel of the ray's source
+// returns the number of voxels that received energy
+uint32_t AT_voxel_ray_step(AT_Simulation *simulation, AT_Voxel *grid, const AT_Ray *ray, AT_Vec3 ray_end);
 
 static inline uint32_t AT_voxel_get_num_bins(AT_Simulation *simulation)
 {
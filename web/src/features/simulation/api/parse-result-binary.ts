@@ -1,23 +1,184 @@
 /**
  * ATRB binary format parser for simulation results.
  *
- * Binary layout (little-endian):
- *   Header (16 B):  "ATRB" magic | numFrames u32 | numVoxels u32 | reserved u32
+ * Binary layout (little-endian), see backend/net/at_binary.h:
+ *
+ * v1:
+ *   Header (16 B):  "ATRB" magic | numFrames u32 | numVoxels u32 | reserved u32 (0)
  *   Frame table:    numFrames × (offset u32, count u32)
  *   Frame data:     per frame SoA: indices[count] u32 then energies[count] f32
  *
- * Parsing creates zero-copy typed-array views into the original ArrayBuffer.
+ * v2:
+ *   Header (24 B):  "ATRB" magic | numFrames u32 | numVoxels u32 | version u16 (2)
+ *                   | flags u16 | log2 energy min f32 | log2 energy max f32
+ *                   [| keyframeInterval u32, TEMPORAL flag only]
+ *   Frame table:    numFrames × (offset u32, count u32, size u32, rawSize u32)
+ *   Frame data:     per frame block, LZ4 block compressed when the LZ4 flag is set
+ *                   and size !== rawSize. Decompressed: varint delta indices, then
+ *                   energies as f32 or, with the QUANTIZED flag, u16 log-quantized.
+ *                   TEMPORAL blocks start with numRemoved varint + removed varint delta
+ *                   indices; non-keyframes only carry changes against their keyframe.
+ *
+ * ATRP (progressive, see parsePyramidStream):
+ *   Header (8 B):   "ATRP" magic | numLevels u32
+ *   Levels:         coarsest first, grid x/y/z u32 | size u32 | ATRB document of size bytes
+ *
+ * ATRS (live frames, see parseFrameStream):
+ *   Header (16 B):  "ATRS" magic | grid x/y/z u32
+ *   Windows:        frameStart u32 | size u32 | ATRB document of size bytes,
+ *                   ended by frameStart = total frames with size 0
+ *
+ * v1 parsing creates zero-copy typed-array views into the original ArrayBuffer,
+ * v2 frames are decoded into fresh arrays.
  */
 
-/** One frame of sparse voxel energy data (zero-copy views). */
+/** One frame of sparse voxel energy data. */
 export interface RayFrame {
   indices: Uint32Array;
   energies: Float32Array;
 }
 
+/** One mip level of an ATRP stream, voxel indices address a grid of `grid` cells. */
+export interface ResultLevel {
+  grid: [number, number, number];
+  frames: RayFrame[];
+}
+
+const FLAG_QUANTIZED = 1 << 0;
+const FLAG_LZ4 = 1 << 1;
+const FLAG_TEMPORAL = 1 << 2;
+const QUANTIZED_MAX = 65535;
+
 /** Parse an ATRB binary result buffer into frames. */
 export function parseResultBuffer(buffer: ArrayBuffer): RayFrame[] {
   const view = new DataView(buffer);
+  // v1 wrote a zero reserved word where v2 keeps its version
+  const version = view.getUint16(12, true);
+  return version === 2 ? parseV2(buffer, view) : parseV1(buffer, view);
+}
+
+/**
+ * Reads exact byte counts off a stream, chunks are only joined once a whole
+ * header / document has arrived. Resolves null when the stream ends first.
+ */
+function createStreamReader(stream: ReadableStream<Uint8Array>) {
+  const reader = stream.getReader();
+  const chunks: Uint8Array[] = [];
+  let used = 0;
+  let buffered = 0;
+  let done = false;
+
+  const read = async (size: number): Promise<Uint8Array | null> => {
+    while (buffered < size && !done) {
+      const next = await reader.read();
+      done = next.done;
+      if (next.value) {
+        chunks.push(next.value);
+        buffered += next.value.length;
+      }
+    }
+    if (buffered < size) {
+      return null;
+    }
+
+    // fresh buffer per read, so v1 typed-array views stay aligned
+    const out = new Uint8Array(size);
+    let filled = 0;
+    while (filled < size) {
+      const chunk = chunks[used];
+      const n = Math.min(chunk.length, size - filled);
+      out.set(chunk.subarray(0, n), filled);
+      filled += n;
+      if (n === chunk.length) used++;
+      else chunks[used] = chunk.subarray(n);
+    }
+    chunks.splice(0, used);
+    used = 0;
+    buffered -= size;
+    return out;
+  };
+
+  return { read, release: () => reader.releaseLock() };
+}
+
+/**
+ * Parse an ATRP stream as it arrives, calling onLevel for every complete level.
+ * Levels come coarsest first and carry the same energy, so each one can replace
+ * the previous on screen.
+ */
+export async function parsePyramidStream(
+  stream: ReadableStream<Uint8Array>,
+  onLevel: (level: ResultLevel, index: number, numLevels: number) => void,
+): Promise<void> {
+  const { read, release } = createStreamReader(stream);
+
+  const header = await read(8);
+  if (!header) {
+    throw new Error("Truncated ATRP stream");
+  }
+  const numLevels = new DataView(header.buffer).getUint32(4, true);
+
+  for (let level = 0; level < numLevels; level++) {
+    const levelHeader = await read(16);
+    const view = levelHeader && new DataView(levelHeader.buffer);
+    const document = view && (await read(view.getUint32(12, true)));
+    if (!view || !document) {
+      throw new Error("Truncated ATRP stream");
+    }
+    const grid: [number, number, number] = [
+      view.getUint32(0, true),
+      view.getUint32(4, true),
+      view.getUint32(8, true),
+    ];
+    onLevel({ grid, frames: parseResultBuffer(document.buffer) }, level, numLevels);
+  }
+  release();
+}
+
+/**
+ * Parse an ATRS stream while the run is still simulating, onWindow receives each
+ * batch of final frames in timeline order starting at frameStart. Resolves with
+ * the total frame count once the end marker arrives.
+ */
+export async function parseFrameStream(
+  stream: ReadableStream<Uint8Array>,
+  onWindow: (frames: RayFrame[], frameStart: number, grid: [number, number, number]) => void,
+): Promise<number> {
+  const { read, release } = createStreamReader(stream);
+
+  const header = await read(16);
+  if (!header) {
+    throw new Error("Truncated ATRS stream");
+  }
+  const headerView = new DataView(header.buffer);
+  const grid: [number, number, number] = [
+    headerView.getUint32(4, true),
+    headerView.getUint32(8, true),
+    headerView.getUint32(12, true),
+  ];
+
+  for (;;) {
+    const windowHeader = await read(8);
+    if (!windowHeader) {
+      throw new Error("Truncated ATRS stream");
+    }
+    const view = new DataView(windowHeader.buffer);
+    const frameStart = view.getUint32(0, true);
+    const size = view.getUint32(4, true);
+    if (size === 0) {
+      release();
+      return frameStart;
+    }
+
+    const document = await read(size);
+    if (!document) {
+      throw new Error("Truncated ATRS stream");
+    }
+    onWindow(parseResultBuffer(document.buffer), frameStart, grid);
+  }
+}
+
+function parseV1(buffer: ArrayBuffer, view: DataView): RayFrame[] {
   const numFrames = view.getUint32(4, true);
   const frames: RayFrame[] = new Array(numFrames);
 
@@ -35,3 +196,153 @@ export function parseResultBuffer(buffer: ArrayBuffer): RayFrame[] {
 
   return frames;
 }
+
+function parseV2(buffer: ArrayBuffer, view: DataView): RayFrame[] {
+  const numFrames = view.getUint32(4, true);
+  const flags = view.getUint16(14, true);
+  const logMin = view.getFloat32(16, true);
+  const logStep = (view.getFloat32(20, true) - logMin) / QUANTIZED_MAX;
+  const temporal = (flags & FLAG_TEMPORAL) !== 0;
+  const keyframeInterval = temporal ? view.getUint32(24, true) : 1;
+  const tableStart = temporal ? 28 : 24;
+  const frames: RayFrame[] = new Array(numFrames);
+
+  for (let f = 0; f < numFrames; f++) {
+    const tableEntry = tableStart + f * 16;
+    const offset = view.getUint32(tableEntry, true);
+    const count = view.getUint32(tableEntry + 4, true);
+    const size = view.getUint32(tableEntry + 8, true);
+    const rawSize = view.getUint32(tableEntry + 12, true);
+
+    let block = new Uint8Array(buffer, offset, size);
+    if (flags & FLAG_LZ4 && size !== rawSize) {
+      const raw = new Uint8Array(rawSize);
+      lz4DecompressBlock(block, raw);
+      block = raw;
+    }
+
+    const cursor = { pos: 0 };
+    const removed = temporal ? readIndices(block, cursor, readVarint(block, cursor)) : null;
+    const indices = readIndices(block, cursor, count);
+
+    const energies = new Float32Array(count);
+    const energyView = new DataView(block.buffer, block.byteOffset + cursor.pos);
+    if (flags & FLAG_QUANTIZED) {
+      for (let i = 0; i < count; i++) {
+        energies[i] = 2 ** (logMin + energyView.getUint16(i * 2, true) * logStep);
+      }
+    } else {
+      for (let i = 0; i < count; i++) {
+        energies[i] = energyView.getFloat32(i * 4, true);
+      }
+    }
+
+    frames[f] =
+      removed && f % keyframeInterval !== 0
+        ? applyDelta(frames[f - (f % keyframeInterval)], removed, { indices, energies })
+        : { indices, energies };
+  }
+
+  return frames;
+}
+
+function readVarint(block: Uint8Array, cursor: { pos: number }): number {
+  let value = 0;
+  let shift = 0;
+  let byte: number;
+  do {
+    byte = block[cursor.pos++];
+    value += (byte & 0x7f) * 2 ** shift;
+    shift += 7;
+  } while (byte & 0x80);
+  return value;
+}
+
+/** Varint delta coded, ascending voxel indices. */
+function readIndices(block: Uint8Array, cursor: { pos: number }, count: number): Uint32Array {
+  const indices = new Uint32Array(count);
+  let prev = 0;
+  for (let i = 0; i < count; i++) {
+    prev += readVarint(block, cursor);
+    indices[i] = prev;
+  }
+  return indices;
+}
+
+/** Rebuild a temporal frame: its keyframe minus removed voxels, with updates applied. */
+function applyDelta(key: RayFrame, removed: Uint32Array, updates: RayFrame): RayFrame {
+  const keyCount = key.indices.length;
+  const updateCount = updates.indices.length;
+  const indices = new Uint32Array(keyCount + updateCount);
+  const energies = new Float32Array(keyCount + updateCount);
+  let k = 0;
+  let u = 0;
+  let r = 0;
+  let n = 0;
+
+  // all three lists are sorted, one merge walk
+  while (k < keyCount || u < updateCount) {
+    const keyVoxel = k < keyCount ? key.indices[k] : Infinity;
+    const updateVoxel = u < updateCount ? updates.indices[u] : Infinity;
+
+    if (updateVoxel <= keyVoxel) {
+      indices[n] = updateVoxel;
+      energies[n++] = updates.energies[u++];
+      if (updateVoxel === keyVoxel) k++;
+      continue;
+    }
+
+    while (r < removed.length && removed[r] < keyVoxel) r++;
+    if (r < removed.length && removed[r] === keyVoxel) {
+      k++;
+      continue;
+    }
+    indices[n] = keyVoxel;
+    energies[n++] = key.energies[k++];
+  }
+
+  return { indices: indices.subarray(0, n), energies: energies.subarray(0, n) };
+}
+
+/** Decode one LZ4 block (no frame header) into dst, which must be sized exactly. */
+function lz4DecompressBlock(src: Uint8Array, dst: Uint8Array): void {
+  let ip = 0;
+  let op = 0;
+
+  while (ip < src.length) {
+    const token = src[ip++];
+
+    let literals = token >>> 4;
+    if (literals === 15) {
+      let byte: number;
+      do {
+        byte = src[ip++];
+        literals += byte;
+      } while (byte === 255);
+    }
+    dst.set(src.subarray(ip, ip + literals), op);
+    ip += literals;
+    op += literals;
+
+    // the last sequence carries literals only
+    if (ip >= src.length) break;
+
+    const matchOffset = src[ip] | (src[ip + 1] << 8);
+    ip += 2;
+
+    let matchLength = (token & 0x0f) + 4;
+    if ((token & 0x0f) === 15) {
+      let byte: number;
+      do {
+        byte = src[ip++];
+        matchLength += byte;
+      } while (byte === 255);
+    }
+
+    // byte by byte so overlapping matches repeat correctly
+    let ref = op - matchOffset;
+    for (let i = 0; i < matchLength; i++) {
+      dst[op++] = dst[ref++];
+    }
+  }
+}
@@ -1,17 +1,42 @@
 import { type Simulation } from "./simulation-repository";
+import {
+  parseFrameStream,
+  parsePyramidStream,
+  type RayFrame,
+  type ResultLevel,
+} from "./parse-result-binary";
 
 const RAYTRACER_URL =
   import.meta.env.VITE_RAYTRACER_URL;
 
+/**
+ * One of several sources of a run, sent as `sources` in place of the config's
+ * selectedSource. The server keeps each source's energy apart, so a run that
+ * only changes gains re-mixes the last result instead of tracing again.
+ */
+export interface RaytracerSource {
+  position: { x: number; y: number; z: number };
+  direction: { x: number; y: number; z: number };
+  /** Energy gain, 1 is the level it is traced at, 0 mutes it. */
+  gain?: number;
+}
+
+/**
+ * Aborting `signal` closes the connection, which stops the simulation on the
+ * server and frees its worker, e.g. when the user changed parameters mid-run.
+ */
 export async function runRaytracer(
   config: Simulation["config"],
+  signal?: AbortSignal,
+  sources?: RaytracerSource[],
 ): Promise<ArrayBuffer> {
   const response = await fetch(`${RAYTRACER_URL}/run`, {
     method: "POST",
     headers: {
       "Content-Type": "application/json",
     },
-    body: JSON.stringify(config),
+    body: JSON.stringify(sources ? { ...config, sources } : config),
+    signal,
   });
 
   if (!response.ok) {
@@ -20,3 +45,351 @@ export async function runRaytracer(
 
   return response.arrayBuffer();
 }
+
+/**
+ * Run and receive frames as soon as the simulation has finalised them, instead
+ * of waiting for the whole result. Resolves with the total frame count.
+ * Aborting `signal` stops the run on the server, as for runRaytracer.
+ */
+export async function streamRaytracerRun(
+  config: Simulation["config"],
+  onWindow: (frames: RayFrame[], frameStart: number, grid: [number, number, number]) => void,
+  signal?: AbortSignal,
+): Promise<number> {
+  const response = await fetch(`${RAYTRACER_URL}/run`, {
+    method: "POST",
+    headers: {
+      "Content-Type": "application/json",
+    },
+    body: JSON.stringify({ ...config, stream: true }),
+    signal,
+  });
+
+  if (!response.ok || !response.body) {
+    throw new Error("Error Running Raytracer");
+  }
+
+  return parseFrameStream(response.body, onWindow);
+}
+
+/**
+ * Upload a GLB so runs can use it through `modelId` instead of a file already
+ * on the server. Uploading the same bytes again reuses the parsed model.
+ */
+export async function uploadRaytracerModel(glb: ArrayBuffer): Promise<string> {
+  const response = await fetch(`${RAYTRACER_URL}/models`, {
+    method: "POST",
+    headers: {
+      "Content-Type": "model/gltf-binary",
+    },
+    body: glb,
+  });
+
+  if (!response.ok) {
+    throw new Error("Error Uploading Raytracer Model");
+  }
+
+  const { modelId } = (await response.json()) as { modelId: string };
+  return modelId;
+}
+
+/** Progress of a queued run, see AT_SimulationProgress in the backend. */
+export interface RaytracerJob {
+  id: number;
+  state: "queued" | "running" | "done" | "failed" | "cancelled";
+  phase: "idle" | "tracing" | "depositing" | "done" | "cancelled";
+  raysTotal: number;
+  raysTraced: number;
+  raysDeposited: number;
+  bounces: number;
+  /** HTTP status line of a failed job. */
+  error?: string;
+  /** Estimated relative error of a batched job, from its second batch on. */
+  relativeError?: number;
+}
+
+export interface RaytracerJobOptions {
+  /** An earlier job this one supersedes, it is cancelled. */
+  replaces?: number;
+  /** Rays traced per batch, the job's result can be fetched after every batch. */
+  batchRays?: number;
+  /** Relative error a batched job stops at before tracing every ray. */
+  targetError?: number;
+  /** World box the error is measured over, e.g. the audience, defaults to the whole room. */
+  errorRegion?: {
+    min: { x: number; y: number; z: number };
+    max: { x: number; y: number; z: number };
+  };
+  /** Several sources in place of the config's selectedSource. */
+  sources?: RaytracerSource[];
+  /** Listening spheres the job records an energy-time curve at, up to 256. */
+  receivers?: RaytracerReceiver[];
+  /** Specular reflections up to this order reach the receivers exactly from image sources, at most 8. */
+  imageSourceOrder?: number;
+  /** Seconds the receivers switch from image sources to rays at, defaults to imageSourceOrder mean free paths. */
+  crossoverTime?: number;
+}
+
+/** A listener, a sphere every ray crossing it is heard at. */
+export interface RaytracerReceiver {
+  position: { x: number; y: number; z: number };
+  /** Metres, larger ones need fewer rays but blur where they listen. */
+  radius: number;
+}
+
+/** Queue a run without holding the connection open, returns the job id. */
+export async function submitRaytracerJob(
+  config: Simulation["config"],
+  options: RaytracerJobOptions = {},
+): Promise<number> {
+  const response = await fetch(`${RAYTRACER_URL}/jobs`, {
+    method: "POST",
+    headers: {
+      "Content-Type": "application/json",
+    },
+    body: JSON.stringify({ ...config, ...options }),
+  });
+
+  if (!response.ok) {
+    throw new Error("Error Submitting Raytracer Job");
+  }
+
+  const { id } = (await response.json()) as { id: number };
+  return id;
+}
+
+export async function getRaytracerJob(id: number): Promise<RaytracerJob> {
+  const response = await fetch(`${RAYTRACER_URL}/jobs/${id}`);
+
+  if (!response.ok) {
+    throw new Error("Error Fetching Raytracer Job");
+  }
+
+  return (await response.json()) as RaytracerJob;
+}
+
+/** Normalised result of the batches a batched job has finished so far. */
+export interface RaytracerSnapshot {
+  buffer: ArrayBuffer;
+  raysDone: number;
+  raysTotal: number;
+  /** Negative after the first batch. */
+  relativeError: number;
+}
+
+/**
+ * Latest snapshot of a running batched job, null before its first batch. Once
+ * the job is done this is its final result, whose ray counts are both 0.
+ */
+export async function getRaytracerJobSnapshot(
+  id: number,
+): Promise<RaytracerSnapshot | null> {
+  const response = await fetch(`${RAYTRACER_URL}/jobs/${id}/result`);
+
+  if (response.status === 409) {
+    return null;
+  }
+  if (!response.ok) {
+    throw new Error("Error Fetching Raytracer Job Snapshot");
+  }
+
+  const raysTotal = Number(response.headers.get("X-AT-Rays-Total") ?? 0);
+  return {
+    buffer: await response.arrayBuffer(),
+    raysDone: Number(response.headers.get("X-AT-Rays-Done") ?? 0),
+    raysTotal,
+    relativeError: Number(response.headers.get("X-AT-Relative-Error") ?? 0),
+  };
+}
+
+/**
+ * Estimated relative error of every voxel of a finished batched job, x fastest
+ * then y then z, -1 where no ray arrived. Shows where more rays would help.
+ */
+export async function getRaytracerJobErrors(
+  id: number,
+): Promise<{ errors: Float32Array; grid: [number, number, number] }> {
+  const response = await fetch(`${RAYTRACER_URL}/jobs/${id}/errors`);
+
+  if (!response.ok) {
+    throw new Error("Error Fetching Raytracer Job Errors");
+  }
+
+  const grid = (response.headers.get("X-AT-Grid") ?? "0,0,0").split(",").map(Number);
+  return {
+    errors: new Float32Array(await response.arrayBuffer()),
+    grid: [grid[0], grid[1], grid[2]],
+  };
+}
+
+/**
+ * Room acoustic parameters of one receiver, a value per octave band from 63 Hz to
+ * 8 kHz, null where the curve did not decay far enough to measure one.
+ */
+export interface RaytracerRoomAcoustics {
+  /** Reverberation time in seconds. */
+  rt60: (number | null)[];
+  /** Early decay time in seconds. */
+  edt: (number | null)[];
+  /** Clarity in dB, the first 80 ms over the rest. */
+  c80: (number | null)[];
+}
+
+/** RT60, EDT and C80 at every receiver of a finished job, in the order they were sent. */
+export async function getRaytracerJobReceivers(
+  id: number,
+): Promise<RaytracerRoomAcoustics[]> {
+  const response = await fetch(`${RAYTRACER_URL}/jobs/${id}/receivers`);
+
+  if (!response.ok) {
+    throw new Error("Error Fetching Raytracer Job Receivers");
+  }
+
+  const { receivers } = (await response.json()) as { receivers: RaytracerRoomAcoustics[] };
+  return receivers;
+}
+
+export interface EnergyTimeCurve {
+  /** numBins * 8 band energies, bin major. */
+  energy: Float32Array;
+  /** numBins * 3, energy weighted direction sound arrived from in each bin. */
+  direction: Float32Array;
+  numBins: number;
+  /** Seconds per bin, bin 0 starts at emission. */
+  binWidth: number;
+}
+
+/** Energy-time curve one receiver of a finished job recorded, its impulse response. */
+export async function getRaytracerJobEnergyTimeCurve(
+  id: number,
+  receiver: number,
+): Promise<EnergyTimeCurve> {
+  const response = await fetch(`${RAYTRACER_URL}/jobs/${id}/receivers/${receiver}`);
+
+  if (!response.ok) {
+    throw new Error("Error Fetching Raytracer Energy-Time Curve");
+  }
+
+  const numBins = Number(response.headers.get("X-AT-Bins") ?? 0);
+  const buffer = await response.arrayBuffer();
+  return {
+    energy: new Float32Array(buffer, 0, numBins * 8),
+    direction: new Float32Array(buffer, numBins * 8 * 4, numBins * 3),
+    numBins,
+    binWidth: Number(response.headers.get("X-AT-Bin-Width") ?? 0),
+  };
+}
+
+/** Stop a queued or running job, resolves once the server has flagged it. */
+export async function cancelRaytracerJob(id: number): Promise<void> {
+  const response = await fetch(`${RAYTRACER_URL}/jobs/${id}`, {
+    method: "DELETE",
+  });
+
+  // 409: it finished first, nothing left to stop
+  if (!response.ok && response.status !== 409) {
+    throw new Error("Error Cancelling Raytracer Job");
+  }
+}
+
+/**
+ * Poll a job until it has finished, then fetch its result. Each poll is a short
+ * request, so long runs never run into client or proxy timeouts.
+ */
+export async function waitForRaytracerJob(
+  id: number,
+  onProgress?: (job: RaytracerJob) => void,
+  pollIntervalMs = 500,
+): Promise<ArrayBuffer> {
+  for (;;) {
+    const job = await getRaytracerJob(id);
+    onProgress?.(job);
+    if (job.state === "failed") {
+      throw new Error(`Raytracer Job Failed: ${job.error}`);
+    }
+    if (job.state === "cancelled") {
+      throw new Error("Raytracer Job Cancelled");
+    }
+    if (job.state === "done") {
+      break;
+    }
+    await new Promise((resolve) => setTimeout(resolve, pollIntervalMs));
+  }
+
+  const response = await fetch(`${RAYTRACER_URL}/jobs/${id}/result`);
+
+  if (!response.ok) {
+    throw new Error("Error Fetching Raytracer Job Result");
+  }
+
+  return response.arrayBuffer();
+}
+
+/** Window onto the last finished run, see AT_FrameQuery in the backend. */
+export interface ResultQuery {
+  frameStart?: number;
+  /** Exclusive, defaults to the last frame. */
+  frameEnd?: number;
+  /** Voxel box [regionMin, regionMax) in grid coordinates. */
+  regionMin?: [number, number, number];
+  regionMax?: [number, number, number];
+  /** 2 or 4 sums cells of n^3 voxels into one. */
+  downsample?: 1 | 2 | 4;
+}
+
+export interface ResultWindow {
+  buffer: ArrayBuffer;
+  /** Timeline frame of the buffer's frame 0. */
+  frameStart: number;
+  totalFrames: number;
+  /** Cells per axis the buffer's voxel indices address. */
+  grid: [number, number, number];
+}
+
+/** Fetch part of the last run, lets the viewer load the timeline progressively. */
+export async function queryRaytracerResult(
+  query: ResultQuery,
+): Promise<ResultWindow> {
+  const response = await fetch(`${RAYTRACER_URL}/query`, {
+    method: "POST",
+    headers: {
+      "Content-Type": "application/json",
+    },
+    body: JSON.stringify(query),
+  });
+
+  if (!response.ok) {
+    throw new Error("Error Querying Raytracer Result");
+  }
+
+  const grid = (response.headers.get("X-AT-Grid") ?? "0,0,0").split(",").map(Number);
+  return {
+    buffer: await response.arrayBuffer(),
+    frameStart: Number(response.headers.get("X-AT-Frame-Start") ?? 0),
+    totalFrames: Number(response.headers.get("X-AT-Total-Frames") ?? 0),
+    grid: [grid[0], grid[1], grid[2]],
+  };
+}
+
+/**
+ * Stream the last run (or a window of it) as a mip pyramid, onLevel fires for each
+ * level as soon as it has arrived, a single cell first and the full grid last.
+ */
+export async function streamRaytracerPyramid(
+  query: ResultQuery,
+  onLevel: (level: ResultLevel, index: number, numLevels: number) => void,
+): Promise<void> {
+  const response = await fetch(`${RAYTRACER_URL}/query`, {
+    method: "POST",
+    headers: {
+      "Content-Type": "application/json",
+    },
+    body: JSON.stringify({ ...query, pyramid: true }),
+  });
+
+  if (!response.ok || !response.body) {
+    throw new Error("Error Querying Raytracer Result");
+  }
+
+  await parsePyramidStream(response.body, onLevel);
+}